@@ -0,0 +1,55 @@
+#include "bench.hpp"
+
+#include <rubbishrsa/arena.hpp>
+#include <rubbishrsa/attack.hpp>
+#include <rubbishrsa/metrics.hpp>
+
+#include <optional>
+
+namespace rubbishrsa::bench {
+  namespace {
+    // Runs the function with and without pooling, reporting its speed and how often it went to the allocator
+    void compare(const std::string& name, const std::function<void()>& func, unsigned int threads = 0) {
+      for (bool pooled : {false, true}) {
+        std::optional<rubbishrsa::arena::scope> scope;
+        if (pooled)
+          scope.emplace();
+        const std::string full_name = "arena/" + name + (pooled ? "/pooled" : "/heap");
+
+        metrics::reset();
+        func();
+        report(full_name + "/gmp_allocations", metrics::total(metrics::counter::gmp_allocations), "allocs/op", threads);
+        report(full_name + "/heap_allocations", metrics::total(metrics::counter::heap_allocations), "allocs/op", threads);
+        report(full_name, ops_per_sec(func), "ops/s", threads);
+      }
+    }
+  }
+
+  void arena() {
+    // main installs the hooks before anything else when this group is asked for, as they cannot be added later
+    if (!rubbishrsa::arena::installed())
+      return;
+    metrics::enable(true);
+
+    const auto prime = fixed_prime(1024, 7);
+    compare("is_prime/1024", [&]() { (void)is_prime(prime); });
+
+    const auto semiprime = fixed_prime(25, 50) * fixed_prime(25, 51);
+    for (auto threads : settings().thread_counts)
+      compare("pollard_rho/50", [&]() { (void)pollard_rho(semiprime, threads); }, threads);
+
+    const auto key = fixed_key(1024);
+    const auto cyphertext = key.raw_encrypt(key.n - 1);
+    for (auto threads : settings().thread_counts)
+      compare("brute_force_ptext/range", [&]() {
+        (void)attack::brute_force_ptext(key, cyphertext, 0, 2000 * threads - 1, threads);
+      }, threads);
+
+    // Small enough that every signature below the modulus is tried in a fraction of a second
+    const auto tiny_key = fixed_key(16);
+    const auto unreachable = ascii2bigint("zzzz");
+    compare("brute_force_sig_invis", [&]() { (void)attack::brute_force_sig_invis(tiny_key, unreachable); });
+
+    metrics::enable(false);
+  }
+}
@@ -0,0 +1,33 @@
+#include "bench.hpp"
+
+#include <rubbishrsa/maths.hpp>
+
+namespace rubbishrsa::bench {
+  void arith() {
+    for (uint_fast16_t bits : {512, 1024, 2048, 4096}) {
+      const auto key = fixed_key(bits);
+      // lambda(n) is what modinv is used against when making keys
+      const auto [p, q] = recover_factors(key.n, key.e, key.d);
+      const auto lambda_n = carmichael_semiprime(p, q);
+      const auto suffix = '/' + std::to_string(bits);
+
+      report("arith/egcd" + suffix, ops_per_sec([&]() { (void)egcd(key.d, key.n); }));
+      report("arith/modinv" + suffix, ops_per_sec([&]() { (void)modinv(key.e, lambda_n); }));
+    }
+
+    // Inverses per second, of the same values one at a time and all at once
+    const auto key = fixed_key(2048);
+    std::vector<bigint> values(4096);
+    // Encrypting makes them look random, where something like n / i would have an unusually short egcd
+    for (size_t i = 0; i < values.size(); ++i)
+      values[i] = key.raw_encrypt(i + 2);
+    const auto size = static_cast<double>(values.size());
+    report("arith/modinv_each/2048", size * ops_per_sec([&]() {
+      for (const auto& i : values)
+        (void)modinv(i, key.n);
+    }), "inverses/s");
+    for (auto threads : settings().thread_counts)
+      report("arith/batch_modinv/2048", size * ops_per_sec([&]() { (void)batch_modinv(values, key.n, threads); }),
+             "inverses/s", threads);
+  }
+}
@@ -0,0 +1,163 @@
+#include "bench.hpp"
+
+#include <rubbishrsa/attack.hpp>
+#include <rubbishrsa/candidates.hpp>
+#include <rubbishrsa/factordb.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
+#include <numeric>
+#include <unistd.h>
+
+namespace rubbishrsa::bench {
+  namespace {
+    // The number of steps a single walk takes to find a factor (or to cycle without one)
+    uint64_t rho_steps_to_factor(const bigint& n, size_t walk, unsigned long increment) {
+      const std::atomic<bool> stop = false;
+      bigint x = pollard_rho_start(walk), y = x;
+      uint64_t steps = 0;
+      // In batch sized chunks, and then a step at a time through the chunk that finds it
+      constexpr uint_fast32_t chunk = 64;
+      for (bigint chunk_x, chunk_y;; steps += chunk) {
+        chunk_x = x;
+        chunk_y = y;
+        if (pollard_rho_steps(n, x, y, chunk, stop, increment) != 0) {
+          x = std::move(chunk_x);
+          y = std::move(chunk_y);
+          while (pollard_rho_steps(n, x, y, 1, stop, increment) == 0)
+            ++steps;
+          return steps + 1;
+        }
+      }
+    }
+  }
+
+  void factor() {
+    // Small enough that each run takes well under a second on one core
+    for (uint_fast16_t bits : {40, 50, 60}) {
+      const auto n = fixed_prime(bits / 2, bits) * fixed_prime(bits / 2, bits + 1);
+      for (auto threads : settings().thread_counts)
+        report("factor/pollard_rho/" + std::to_string(bits), ops_per_sec([&]() {
+          (void)pollard_rho(n, threads);
+        }), "factorisations/s", threads);
+    }
+
+    // How many times fewer steps the first of t independent walks takes to find a factor than a single walk does.
+    // This is a step count, not a timing, so it says nothing about this machine's cores, and it averages over many
+    // semiprimes, as any one semiprime is all luck. Racing independent walks can at best give sqrt(t), and walks
+    // that share a polynomial (as pollard_rho's once did) fall short of that
+    constexpr size_t scaling_walks = 64, scaling_semiprimes = 32;
+    for (uint_fast16_t bits : {40, 56}) {
+      std::vector<std::vector<uint64_t>> own_steps, shared_steps;
+      for (uint64_t seed = 0; seed < scaling_semiprimes; ++seed) {
+        const auto n = fixed_prime(bits / 2, 1000 + 2 * seed) * fixed_prime(bits / 2, 1001 + 2 * seed);
+        auto& own = own_steps.emplace_back();
+        auto& shared = shared_steps.emplace_back();
+        for (size_t walk = 0; walk < scaling_walks; ++walk) {
+          own.push_back(rho_steps_to_factor(n, walk, pollard_rho_increment(walk)));
+          shared.push_back(rho_steps_to_factor(n, walk, 1));
+        }
+      }
+      for (auto [steps, name] : {std::pair{&own_steps, "own_polynomials"}, {&shared_steps, "shared_polynomial"}}) {
+        for (size_t threads = 1; threads <= scaling_walks; threads *= 2) {
+          double single = 0, first = 0;
+          for (const auto& per_walk : *steps) {
+            single += std::accumulate(per_walk.begin(), per_walk.end(), 0.0) / static_cast<double>(per_walk.size());
+            // Each group of t walks is a separate trial, so that every walk counts
+            double trials = 0, total = 0;
+            for (size_t begin = 0; begin + threads <= per_walk.size(); begin += threads, ++trials)
+              total += static_cast<double>(*std::min_element(per_walk.begin() + begin, per_walk.begin() + begin + threads));
+            first += total / trials;
+          }
+          report("factor/pollard_rho_walks/" + std::to_string(bits) + '/' + name, single / first, "x fewer steps",
+                 static_cast<unsigned int>(threads));
+        }
+      }
+    }
+
+    // Keys with a d just inside Wiener's bound, which should fall however big they are
+    for (uint_fast16_t bits : {1024, 2048, 4096}) {
+      const auto p = fixed_prime(bits / 2, bits), q = fixed_prime(bits / 2, bits + 1);
+      const auto lambda_n = carmichael_semiprime(p, q);
+      bigint d = (bigint{1} << (bits / 4 - 12)) + 1;
+      while (egcd(d, lambda_n).gcd != 1)
+        d += 2;
+      public_key weak;
+      weak.n = p * q;
+      weak.e = modinv(d, lambda_n);
+      report("factor/wiener/" + std::to_string(bits), ops_per_sec([&]() { (void)attack::wiener(weak); }), "keys/s");
+    }
+
+    // What a modulus that has been cracked before costs, in a database of a few thousand 2048 bit moduli. The
+    // "factors" are not prime, but the database only checks that they multiply up to the modulus
+    const auto db_path = (std::filesystem::temp_directory_path()
+                          / ("rubbishrsa-bench-" + std::to_string(getpid()) + ".factordb")).string();
+    {
+      factor_db db{db_path};
+      const auto q = fixed_prime(1024, 1);
+      std::vector<bigint> moduli;
+      report("factor/factor_db/add", ops_per_sec([&]() {
+        const bigint p = q + 2 * (moduli.size() + 1);
+        moduli.push_back(p * q);
+        (void)db.add(moduli.back(), p, q);
+      }), "moduli/s");
+
+      size_t next = 0;
+      report("factor/factor_db/hit", ops_per_sec([&]() {
+        (void)db.find(moduli[next++ % moduli.size()]);
+      }), "lookups/s");
+      const bigint absent = q * q;
+      report("factor/factor_db/miss", ops_per_sec([&]() { (void)db.find(absent); }), "lookups/s");
+    }
+    for (const auto* suffix : {"", ".idx", ".lock"})
+      std::filesystem::remove(db_path + suffix);
+  }
+
+  void brute() {
+    const auto key = fixed_key(1024);
+    // Nothing in the range encrypts to this, so the whole range is always searched
+    const auto cyphertext = key.raw_encrypt(key.n - 1);
+
+    for (auto threads : settings().thread_counts) {
+      // Scale the range with the threads, so each run takes about as long
+      const unsigned int range = 2000 * threads;
+      report("brute/brute_force_ptext/range", range * ops_per_sec([&]() {
+        (void)attack::brute_force_ptext(key, cyphertext, 0, range - 1, threads);
+      }), "candidates/s", threads);
+
+      const attack::mask_generator mask{"?l?d?d"};
+      const auto mask_size = mask.size().convert_to<double>();
+      report("brute/brute_force_ptext/mask", mask_size * ops_per_sec([&]() {
+        (void)attack::brute_force_ptext(key, cyphertext, mask, threads);
+      }), "candidates/s", threads);
+    }
+
+    // Coppersmith's attack against searching for the same unknown bits, with e = 3, as the time each takes to find
+    // the message. A search takes 2^(bits - 1) candidates on average, which is far too many to time beyond the
+    // smallest, so it is worked out from the rate, and only up to 64 bits, as the numbers are silly after that
+    {
+      std::vector<bigint> primes;
+      for (uint64_t seed = 1; primes.size() < 2; ++seed)
+        if (auto p = fixed_prime(512, seed); p % 3 == 2)
+          primes.push_back(std::move(p));
+      const auto small_e = private_key::from_primes(std::move(primes), 3);
+      const auto prefix = ascii2bigint("The password is: ");
+      const unsigned int range = 20000;
+      const auto rate = range * ops_per_sec([&]() {
+        (void)attack::brute_force_ptext(small_e, small_e.raw_encrypt(small_e.n - 1), 0, range - 1, 1);
+      });
+      for (unsigned int bits : {16u, 32u, 64u, 128u, 200u, 240u}) {
+        const bigint message = (prefix << bits) + (fixed_prime(bits, bits) >> 1);
+        const auto cyphertext = small_e.raw_encrypt(message);
+        const auto name = "brute/known_prefix/1024/" + std::to_string(bits) + "_bits/";
+        report(name + "coppersmith", 1000 / ops_per_sec([&]() {
+          (void)attack::stereotyped_ptext(small_e, cyphertext, prefix, bits);
+        }), "ms");
+        if (bits <= 64)
+          report(name + "search", 1000 * std::ldexp(1.0, bits - 1) / rate, "ms", 1);
+      }
+    }
+  }
+}
@@ -0,0 +1,101 @@
+#include "bench.hpp"
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+namespace rubbishrsa::bench {
+  namespace {
+    std::vector<result> all_results;
+
+    // Only our own names go in here, but quotes and backslashes are escaped all the same
+    std::string json_string(std::string_view str) {
+      std::string ret = "\"";
+      for (char c : str) {
+        if (c == '"' || c == '\\')
+          ret.push_back('\\');
+        ret.push_back(c);
+      }
+      return ret + '"';
+    }
+  }
+
+  config& settings() {
+    static config instance;
+    return instance;
+  }
+
+  const std::vector<result>& results() {
+    return all_results;
+  }
+
+  double ops_per_sec(const std::function<void()>& func) {
+    using clock = std::chrono::steady_clock;
+
+    // Double the batch size until we have run for long enough, so the clock is only read rarely
+    size_t total = 0;
+    auto start = clock::now();
+    std::chrono::duration<double> elapsed{0};
+    for (size_t batch = 1; elapsed < settings().min_time; batch *= 2) {
+      for (size_t i = 0; i < batch; ++i)
+        func();
+      total += batch;
+      elapsed = clock::now() - start;
+    }
+    return total / elapsed.count();
+  }
+
+  void report(std::string_view name, double value, std::string_view unit, unsigned int threads) {
+    all_results.push_back({std::string{name}, value, std::string{unit}, threads});
+
+    std::string full_name{name};
+    if (threads)
+      full_name += "/threads:" + std::to_string(threads);
+    std::cout << std::left << std::setw(48) << full_name << ' '
+              << std::right << std::setw(16) << std::fixed << std::setprecision(1) << value
+              << ' ' << unit << std::endl;
+  }
+
+  void write_json(std::ostream& os) {
+    os << "{\n"
+       << "  \"timestamp\": " << std::time(nullptr) << ",\n"
+       << "  \"hardware_concurrency\": " << std::thread::hardware_concurrency() << ",\n"
+       << "  \"min_time\": " << settings().min_time.count() << ",\n"
+       << "  \"results\": [";
+    for (size_t i = 0; i < all_results.size(); ++i) {
+      const auto& res = all_results[i];
+      os << (i ? ",\n" : "\n")
+         << "    {\"name\": " << json_string(res.name)
+         << ", \"value\": " << std::setprecision(17) << res.value
+         << ", \"unit\": " << json_string(res.unit)
+         << ", \"threads\": " << res.threads << '}';
+    }
+    os << "\n  ]\n}\n";
+  }
+
+  bigint fixed_prime(uint_fast16_t bits, uint64_t seed) {
+    boost::random::mt19937 rng{static_cast<uint32_t>(seed)};
+    bigint min = 1; min <<= (bits - 1);
+    bigint max = min * 2 - 1;
+    boost::random::uniform_int_distribution<bigint> dist{min, max};
+    // Walk up from a random odd starting point to the next prime
+    bigint candidate = dist(rng) | 1;
+    while (!is_prime(candidate, 32))
+      candidate += 2;
+    return candidate;
+  }
+
+  private_key fixed_key(uint_fast16_t bits, uint64_t seed, unsigned int prime_count) {
+    // The same shape of key as private_key::generate makes
+    if (prime_count == 2)
+      return private_key::from_factors(fixed_prime(bits / 2 + 4, seed * 2), fixed_prime(bits / 2 - 3, seed * 2 + 1));
+    std::vector<bigint> primes;
+    for (unsigned int i = 0; i < prime_count; ++i)
+      primes.push_back(fixed_prime(bits / prime_count + (i < bits % prime_count), seed * prime_count + i));
+    return private_key::from_primes(std::move(primes));
+  }
+}
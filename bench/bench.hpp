@@ -0,0 +1,57 @@
+//! A tiny, dependency free benchmarking harness
+
+#pragma once
+
+#include <rubbishrsa/keys.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rubbishrsa::bench {
+  /// Settings shared by every benchmark, filled in from the command line
+  struct config {
+    /// How long to repeat each measurement for
+    std::chrono::duration<double> min_time{1};
+    /// The thread counts to sweep over, for the benchmarks that are parallel
+    std::vector<unsigned int> thread_counts;
+  };
+  config& settings();
+
+  /// A single measurement, as written to the JSON output
+  struct result {
+    std::string name;
+    double value;
+    std::string unit;
+    /// Zero if the benchmark is not parallel
+    unsigned int threads;
+  };
+  const std::vector<result>& results();
+
+  /// Runs the function repeatedly for at least settings().min_time, and returns how many times it ran per second
+  double ops_per_sec(const std::function<void()>& func);
+
+  /// Records and prints a single result
+  void report(std::string_view name, double value, std::string_view unit = "ops/s", unsigned int threads = 0);
+
+  /// Writes all the results so far as JSON
+  void write_json(std::ostream& os);
+
+  /// A deterministic prime of exactly the given number of bits, so runs can be compared
+  bigint fixed_prime(uint_fast16_t bits, uint64_t seed);
+  /// A deterministic key with a modulus of (about) the given number of bits, made of prime_count primes
+  private_key fixed_key(uint_fast16_t bits, uint64_t seed = 1, unsigned int prime_count = 2);
+
+  // Each group of benchmarks
+  void keys();
+  void codecs();
+  void primes();
+  void arith();
+  void rsa();
+  void factor();
+  void brute();
+  void arena();
+}
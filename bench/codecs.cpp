@@ -0,0 +1,70 @@
+#include "bench.hpp"
+
+#include <rubbishrsa/maths.hpp>
+
+#include <random>
+#include <string>
+
+namespace rubbishrsa::bench {
+  namespace {
+    // The original byte-at-a-time codecs, kept for comparison
+    bigint legacy_ascii2bigint(std::string_view str) {
+      bigint data = 0;
+      for (auto i : str) {
+        data <<= 8;
+        data += static_cast<unsigned char>(i);
+      }
+      return data;
+    }
+
+    std::string legacy_bigint2ascii(bigint data) {
+      std::string str;
+      str.reserve(2048);
+      while (data) {
+        str.push_back(static_cast<char>(data & 0xFF));
+        data >>= 8;
+      }
+      std::reverse(str.begin(), str.end());
+      return str;
+    }
+
+    bigint legacy_hex2bigint(std::string_view str) {
+      std::string con_str{"0x"};
+      con_str += str;
+      return bigint{con_str};
+    }
+
+    // The quadratic versions take far too long beyond this
+    constexpr size_t legacy_max_size = 100 * 1024;
+  }
+
+  void codecs() {
+    std::mt19937_64 rng{42};
+    for (size_t size : {1024ul, 10 * 1024ul, 100 * 1024ul, 1024 * 1024ul, 10 * 1024 * 1024ul}) {
+      std::string data(size, '\0');
+      for (auto& c : data)
+        c = static_cast<char>(rng());
+      // Avoid a leading zero, so the round trip is exact
+      data[0] |= 1;
+      const auto num = ascii2bigint(data);
+      const auto hex = num.str(0, std::ios::hex);
+      const auto suffix = '/' + std::to_string(size / 1024) + "KiB";
+
+      // Reported in bytes per second, so the sizes can be compared
+      report("codecs/ascii2bigint" + suffix, size * ops_per_sec([&]() { (void)ascii2bigint(data); }), "B/s");
+      report("codecs/bigint2ascii" + suffix, size * ops_per_sec([&]() { (void)bigint2ascii(num); }), "B/s");
+      report("codecs/hex2bigint" + suffix, size * ops_per_sec([&]() { (void)hex2bigint(hex); }), "B/s");
+
+      bigint num_out;
+      std::string data_out(size, '\0');
+      report("codecs/ascii2bigint_noalloc" + suffix, size * ops_per_sec([&]() { ascii2bigint(data, num_out); }), "B/s");
+      report("codecs/bigint2ascii_noalloc" + suffix, size * ops_per_sec([&]() { (void)bigint2ascii(num, data_out); }), "B/s");
+
+      if (size <= legacy_max_size) {
+        report("codecs/legacy_ascii2bigint" + suffix, size * ops_per_sec([&]() { (void)legacy_ascii2bigint(data); }), "B/s");
+        report("codecs/legacy_bigint2ascii" + suffix, size * ops_per_sec([&]() { (void)legacy_bigint2ascii(num); }), "B/s");
+        report("codecs/legacy_hex2bigint" + suffix, size * ops_per_sec([&]() { (void)legacy_hex2bigint(hex); }), "B/s");
+      }
+    }
+  }
+}
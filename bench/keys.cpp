@@ -0,0 +1,61 @@
+#include "bench.hpp"
+
+#include <rubbishrsa/keys.hpp>
+#include <rubbishrsa/keystore.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace rubbishrsa::bench {
+  void keys() {
+    // Key generation is not what we are measuring, so a fixed key will do
+    auto key = fixed_key(1024);
+
+    for (auto [format, name] : {std::pair{key_format::json, "json"}, {key_format::der, "der"}, {key_format::pem, "pem"}}) {
+      std::ostringstream pub_ss, priv_ss;
+      static_cast<const public_key&>(key).serialise(pub_ss, format);
+      key.serialise(priv_ss, format);
+      const auto pub = pub_ss.str(), priv = priv_ss.str();
+
+      report(std::string{"keys/load_public/"} + name, ops_per_sec([&]() {
+        std::istringstream is{pub};
+        (void)public_key::deserialise(is);
+      }), "keys/s");
+      report(std::string{"keys/load_private/"} + name, ops_per_sec([&]() {
+        std::istringstream is{priv};
+        (void)private_key::deserialise(is);
+      }), "keys/s");
+    }
+
+    // Generation is random, so these vary a lot from run to run, but more primes are smaller and quicker to find
+    for (unsigned int prime_count : {2, 3, 4})
+      report("keys/generate/1024/" + std::to_string(prime_count) + "_primes", ops_per_sec([&]() {
+        (void)private_key::generate(1024, prime_count);
+      }), "keys/s");
+
+    // A keystore with a realistic number of keys in it, so the lookups are not trivially cached
+    keystore::builder builder;
+    builder.add(key);
+    for (unsigned int i = 0; i < 10000; ++i) {
+      public_key filler;
+      filler.n = key.n + 2 * (i + 1);
+      builder.add(filler);
+    }
+    const auto path = std::filesystem::temp_directory_path() / "rubbishrsa-bench.rks";
+    {
+      std::ofstream os{path, std::ios::binary};
+      builder.write(os);
+    }
+    {
+      keystore store{path.string()};
+      report("keys/load_public/keystore", ops_per_sec([&]() {
+        (void)store.find(key.n)->to_public_key();
+      }), "keys/s");
+      report("keys/load_private/keystore", ops_per_sec([&]() {
+        (void)store.find(key.n)->to_private_key();
+      }), "keys/s");
+    }
+    std::filesystem::remove(path);
+  }
+}
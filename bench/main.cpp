@@ -0,0 +1,97 @@
+//! Benchmarks for the hot paths of the library
+//!
+//! Pass the names of the groups to run, or nothing to run them all
+
+#include "bench.hpp"
+
+#include <rubbishrsa/arena.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+
+namespace po = boost::program_options;
+
+int main(int argc, char** argv) {
+  const std::map<std::string, void(*)()> groups = {
+    {"keys", &rubbishrsa::bench::keys},
+    {"codecs", &rubbishrsa::bench::codecs},
+    {"primes", &rubbishrsa::bench::primes},
+    {"arith", &rubbishrsa::bench::arith},
+    {"rsa", &rubbishrsa::bench::rsa},
+    {"factor", &rubbishrsa::bench::factor},
+    {"brute", &rubbishrsa::bench::brute},
+    {"arena", &rubbishrsa::bench::arena},
+  };
+
+  std::string json_path;
+  double min_time;
+  std::vector<unsigned int> thread_counts;
+  std::vector<std::string> selected;
+
+  po::options_description options;
+  options.add_options()
+      ("help,h", "Prints a help message")
+      ("json,j", po::value(&json_path)->value_name("path"), "Also writes the results to the given file as JSON")
+      ("min-time", po::value(&min_time)->value_name("secs")->default_value(1), "How long to repeat each measurement for")
+      ("threads,t", po::value(&thread_counts)->value_name("n")->multitoken(), "The thread counts to sweep over. Defaults to powers of two up to the number of cores")
+      ("group", po::value(&selected)->value_name("name"), "A group of benchmarks to run. May be given as positional arguments");
+  po::positional_options_description positional;
+  positional.add("group", -1);
+
+  po::variables_map args;
+  po::store(po::command_line_parser(argc, argv).options(options).positional(positional).run(), args);
+  po::notify(args);
+
+  if (args.count("help")) {
+    std::cout << "Usage: " << argv[0] << " [options] [groups...]" << std::endl
+              << std::endl
+              << "Groups:";
+    for (auto& [name, func] : groups)
+      std::cout << ' ' << name;
+    std::cout << std::endl << std::endl << options << std::endl;
+    return 0;
+  }
+
+  auto& settings = rubbishrsa::bench::settings();
+  settings.min_time = std::chrono::duration<double>{min_time};
+  if (thread_counts.empty()) {
+    const auto cores = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int i = 1; i < cores; i *= 2)
+      thread_counts.push_back(i);
+    thread_counts.push_back(cores);
+  }
+  settings.thread_counts = thread_counts;
+
+  if (selected.empty())
+    for (auto& [name, func] : groups)
+      selected.push_back(name);
+
+  // The arena group counts allocations, which needs the hooks in before any number is made
+  if (std::find(selected.begin(), selected.end(), "arena") != selected.end())
+    rubbishrsa::arena::install();
+
+  for (const auto& name : selected) {
+    auto iter = groups.find(name);
+    if (iter == groups.end()) {
+      std::cerr << "ERROR: Unknown benchmark group '" << name << '\'' << std::endl;
+      return 1;
+    }
+    iter->second();
+  }
+
+  if (json_path.size()) {
+    std::ofstream os{json_path};
+    if (!os) {
+      std::cerr << "ERROR: Could not open JSON output file!" << std::endl;
+      return 1;
+    }
+    rubbishrsa::bench::write_json(os);
+  }
+  return 0;
+}
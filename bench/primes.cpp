@@ -0,0 +1,35 @@
+#include "bench.hpp"
+
+#include <rubbishrsa/maths.hpp>
+
+namespace rubbishrsa::bench {
+  void primes() {
+    for (uint_fast16_t bits : {256, 512, 1024})
+      for (auto threads : settings().thread_counts)
+        report("primes/generate_prime/" + std::to_string(bits), ops_per_sec([&]() {
+          (void)generate_prime(bits, threads);
+        }), "primes/s", threads);
+
+    for (uint_fast16_t bits : {512, 1024, 2048}) {
+      const auto prime = fixed_prime(bits, 7);
+      // A composite with no small factors, so it is not rejected by the first round
+      const auto composite = fixed_prime(bits / 2, 8) * fixed_prime(bits / 2, 9);
+      report("primes/is_prime/prime/" + std::to_string(bits), ops_per_sec([&]() { (void)is_prime(prime); }));
+      report("primes/is_prime/composite/" + std::to_string(bits), ops_per_sec([&]() { (void)is_prime(composite); }));
+    }
+
+    // Near the start, and up against the limit, where there are far more base primes to sieve with
+    constexpr uint64_t span = uint64_t{1} << 26;
+    for (uint64_t start : {uint64_t{0}, sieve_limit - span}) {
+      const auto suffix = start ? "/2^40" : "/0";
+      report(std::string{"primes/prime_sieve"} + suffix, span * ops_per_sec([&]() {
+        for (auto p : prime_sieve{start, start + span})
+          (void)p;
+      }), "numbers/s");
+      for (auto threads : settings().thread_counts)
+        report(std::string{"primes/count_primes"} + suffix, span * ops_per_sec([&]() {
+          (void)count_primes(start, start + span, threads);
+        }), "numbers/s", threads);
+    }
+  }
+}
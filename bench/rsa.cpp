@@ -0,0 +1,103 @@
+#include "bench.hpp"
+
+#include <rubbishrsa/context_cache.hpp>
+
+namespace rubbishrsa::bench {
+  namespace {
+    // Compares checking a batch of signatures one at a time with verify_batch, in signatures per second
+    void verify_batch(const std::string& name, const private_key& key, size_t batch_size) {
+      std::vector<bigint> messages(batch_size), signatures(batch_size);
+      for (size_t i = 0; i < batch_size; ++i) {
+        messages[i] = key.n / (i + 2);
+        signatures[i] = key.raw_sign(messages[i]);
+      }
+      const auto suffix = '/' + name + '/' + std::to_string(batch_size);
+      const auto size = static_cast<double>(batch_size);
+
+      report("rsa/verify_each" + suffix, size * ops_per_sec([&]() {
+        bigint recovered;
+        for (size_t i = 0; i < batch_size; ++i) {
+          key.raw_verify(signatures[i], recovered);
+          (void)(recovered == messages[i]);
+        }
+      }), "sigs/s");
+      report("rsa/verify_batch" + suffix, size * ops_per_sec([&]() { (void)key.verify_batch(messages, signatures); }), "sigs/s");
+
+      // Two signatures swapped for n - s, which verify to -m, and so cancel out unless the sign is checked
+      auto negated = signatures;
+      negated[0] = key.n - negated[0];
+      negated[batch_size / 2] = key.n - negated[batch_size / 2];
+      uint64_t runs = 0, accepted = 0;
+      report("rsa/verify_batch" + suffix + "/negated_pair", size * ops_per_sec([&]() {
+        const auto valid = key.verify_batch(messages, negated);
+        ++runs;
+        accepted += valid[0] || valid[batch_size / 2];
+      }), "sigs/s");
+      report("rsa/verify_batch" + suffix + "/negated_pair/accepted", 100 * static_cast<double>(accepted) / runs, "%");
+    }
+  }
+
+  void rsa() {
+    for (uint_fast16_t bits : {1024, 2048, 4096}) {
+      // Without its primes, like a key that was stored with only d, which is what the context cache is for
+      auto key = fixed_key(bits);
+      key.primes.clear();
+      const auto message = key.n / 3;
+      const auto cyphertext = key.raw_encrypt(message);
+      const auto suffix = '/' + std::to_string(bits);
+
+      report("rsa/raw_encrypt" + suffix, ops_per_sec([&]() { (void)key.raw_encrypt(message); }));
+      report("rsa/raw_decrypt" + suffix, ops_per_sec([&]() { (void)key.raw_decrypt(cyphertext); }));
+      enable_context_cache(1 << 20);
+      report("rsa/raw_decrypt_cached" + suffix, ops_per_sec([&]() { (void)key.raw_decrypt(cyphertext); }));
+      enable_context_cache(0);
+
+      // Keys that hold their primes, which do the CRT over all of them
+      for (unsigned int prime_count : {2, 3, 4}) {
+        const auto multi_prime = fixed_key(bits, 1, prime_count);
+        const auto multi_cyphertext = multi_prime.raw_encrypt(multi_prime.n / 3);
+        report("rsa/raw_decrypt_crt" + suffix + '/' + std::to_string(prime_count) + "_primes", ops_per_sec([&]() {
+          (void)multi_prime.raw_decrypt(multi_cyphertext);
+        }));
+      }
+    }
+
+    // Going round many keys, with room in the cache for all of them and then only for half
+    std::vector<private_key> keys;
+    for (uint64_t seed = 1; seed <= 32; ++seed) {
+      keys.push_back(fixed_key(1024, seed));
+      keys.back().primes.clear();
+    }
+    const auto key_bytes = key_context::from_private_key(keys.front()).memory_used();
+    for (size_t room : {keys.size(), keys.size() / 2}) {
+      enable_context_cache(room * key_bytes + key_bytes / 2);
+      size_t next = 0;
+      const auto suffix = "/1024/" + std::to_string(keys.size()) + "_keys/room_for_" + std::to_string(room);
+      const auto before = shared_context_cache().stats();
+      report("rsa/raw_decrypt_cached" + suffix, ops_per_sec([&]() {
+        const auto& key = keys[next++ % keys.size()];
+        (void)key.raw_decrypt(key.n / 3);
+      }));
+      const auto after = shared_context_cache().stats();
+      const auto hits = static_cast<double>(after.hits - before.hits);
+      report("rsa/raw_decrypt_cached" + suffix + "/hits", 100 * hits / (hits + static_cast<double>(after.misses - before.misses)), "%");
+    }
+    enable_context_cache(0);
+
+    // With the usual e, screening costs about as much as checking each signature, so verify_batch does that instead
+    const auto key = fixed_key(2048);
+    for (size_t batch_size : {64, 4096})
+      verify_batch("e65537", key, batch_size);
+    // Whereas a long e makes each check expensive, and the screen shares one exponentiation between them all.
+    // The sign of each signature is checked differently for each n mod 4, so there is a key for both
+    const auto p = fixed_prime(1028, 2);
+    for (unsigned int residue : {1, 3}) {
+      uint64_t seed = 3;
+      while (p * fixed_prime(1021, seed) % 4 != residue)
+        ++seed;
+      const auto long_e_key = private_key::from_factors(p, fixed_prime(1021, seed), fixed_prime(1000, 4));
+      for (size_t batch_size : {64, 4096})
+        verify_batch("e1000/n" + std::to_string(residue) + "mod4", long_e_key, batch_size);
+    }
+  }
+}
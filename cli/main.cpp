@@ -2,17 +2,38 @@
 //!
 //! It's a tiny bit hacky, but all UI stuff is...
 
+#include <rubbishrsa/arena.hpp>
 #include <rubbishrsa/attack.hpp>
+#include <rubbishrsa/blocks.hpp>
+#include <rubbishrsa/candidates.hpp>
+#include <rubbishrsa/checkpoint.hpp>
+#include <rubbishrsa/context_cache.hpp>
+#include <rubbishrsa/distributed.hpp>
+#include <rubbishrsa/factordb.hpp>
+#include <rubbishrsa/job.hpp>
 #include <rubbishrsa/keys.hpp>
+#include <rubbishrsa/keystore.hpp>
 #include <rubbishrsa/log.hpp>
+#include <rubbishrsa/metrics.hpp>
+#include <rubbishrsa/pipeline.hpp>
+#include <rubbishrsa/server.hpp>
 
 #include <boost/program_options.hpp>
 
+#include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 
 namespace po = boost::program_options;
 
+// Thrown by the helpers below once they have reported an error, so that we leave through main (with this code)
+// rather than exit, which would skip the destructors, and with them the --stats and --trace output
+struct exit_status {
+  int code;
+};
+
 // A class that handles where the output goes
 class output_handler {
 private:
@@ -24,11 +45,12 @@ public:
 
   output_handler() { out = &std::cout; }
   output_handler(const std::string& path) {
-    maybe_outfile = std::make_unique<std::ofstream>(path);
+    // Binary, so that DER keys survive on Windows
+    maybe_outfile = std::make_unique<std::ofstream>(path, std::ios::binary);
     if (!*maybe_outfile) {
       // Since we are only used in main, we can just do the error handling here
       std::cerr << "ERROR: Could not open private key output file!" << std::endl;
-      exit(-1);
+      throw exit_status{-1};
     }
     out = maybe_outfile.get();
   }
@@ -44,7 +66,7 @@ rubbishrsa::bigint read_hex_input(const std::string& not_file_indicator, const p
     std::ifstream in{args2.at("in").as<std::string>()};
     if (!in) {
       std::cerr << "ERROR: Cannot open input file!" << std::endl;
-      exit(1);
+      throw exit_status{1};
     }
     in >> std::hex >> data;
   }
@@ -65,7 +87,7 @@ rubbishrsa::bigint read_message(const po::variables_map& args2) {
     std::ifstream in{args2.at("in").as<std::string>()};
     if (!in) {
       std::cerr << "ERROR: Cannot open input file!" << std::endl;
-      exit(1);
+      throw exit_status{1};
     }
     if (args2.count("hex"))
       in >> std::hex >> data;
@@ -76,25 +98,377 @@ rubbishrsa::bigint read_message(const po::variables_map& args2) {
   return data;
 }
 
-rubbishrsa::public_key read_pubkey(const po::variables_map& args2) {
-  std::ifstream ifs{args2.at("pubkey").as<std::string>()};
+// Writes out the metrics when main returns, if they were asked for
+class metrics_output {
+private:
+  std::string stats_path, trace_path;
+
+public:
+  metrics_output(std::string stats_path, std::string trace_path) :
+    stats_path{std::move(stats_path)}, trace_path{std::move(trace_path)} {
+    if (this->stats_path.size() || this->trace_path.size())
+      rubbishrsa::metrics::enable(this->stats_path.size(), this->trace_path.size());
+  }
+
+  ~metrics_output() {
+    if (stats_path.size()) {
+      std::ofstream os{stats_path};
+      if (os)
+        rubbishrsa::metrics::write_stats_json(os);
+      else
+        std::cerr << "WARNING: Could not open stats output file!" << std::endl;
+    }
+    if (trace_path.size()) {
+      std::ofstream os{trace_path};
+      if (os)
+        rubbishrsa::metrics::write_chrome_trace(os);
+      else
+        std::cerr << "WARNING: Could not open trace output file!" << std::endl;
+    }
+  }
+};
+
+// Finds a key in the keystore given by --keystore, by its hex fingerprint or full hex modulus
+template<typename Func>
+auto read_from_keystore(const po::variables_map& args2, const std::string& key_arg, Func&& convert) {
+  try {
+    rubbishrsa::keystore store{args2.at("keystore").as<std::string>()};
+    const auto& id = args2.at(key_arg).as<std::string>();
+    auto num = rubbishrsa::hex2bigint(id);
+
+    std::optional<rubbishrsa::keystore::key_view> view;
+    // Anything that fits in a fingerprint is treated as one
+    if (id.size() <= 2 * sizeof(rubbishrsa::keystore::fingerprint_t)) {
+      auto matches = store.find(num.convert_to<rubbishrsa::keystore::fingerprint_t>());
+      if (matches.size() > 1) {
+        std::cerr << "ERROR: Fingerprint is ambiguous, please give the whole modulus" << std::endl;
+        throw exit_status{1};
+      }
+      if (matches.size())
+        view = matches.front();
+    }
+    else
+      view = store.find(num);
+
+    if (!view) {
+      std::cerr << "ERROR: Could not find the key in the keystore" << std::endl;
+      throw exit_status{1};
+    }
+    return convert(*view);
+  }
+  catch (const std::exception& e) {
+    std::cerr << "ERROR: Could not read keystore: " << e.what() << std::endl;
+    throw exit_status{1};
+  }
+}
+
+rubbishrsa::public_key read_pubkey_file(const std::string& path) {
+  std::ifstream ifs{path, std::ios::binary};
   if (!ifs) {
     std::cerr << "ERROR: Could not open RSA public key" << std::endl;
-    exit(1);
+    throw exit_status{1};
+  }
+  try {
+    return rubbishrsa::public_key::deserialise(ifs);
+  }
+  catch (const std::exception& e) {
+    std::cerr << "ERROR: Could not read RSA public key: " << e.what() << std::endl;
+    throw exit_status{1};
   }
-  return rubbishrsa::public_key::deserialise(ifs);
+}
+
+rubbishrsa::public_key read_pubkey(const po::variables_map& args2) {
+  if (args2.count("keystore"))
+    return read_from_keystore(args2, "pubkey", [](const auto& view) { return view.to_public_key(); });
+  return read_pubkey_file(args2.at("pubkey").as<std::string>());
 }
 
 rubbishrsa::private_key read_privkey(const po::variables_map& args2) {
-  std::ifstream ifs{args2.at("privkey").as<std::string>()};
+  if (args2.count("keystore"))
+    return read_from_keystore(args2, "privkey", [](const auto& view) { return view.to_private_key(); });
+
+  std::ifstream ifs{args2.at("privkey").as<std::string>(), std::ios::binary};
   if (!ifs) {
     std::cerr << "ERROR: Could not open RSA private key" << std::endl;
-    exit(1);
+    throw exit_status{1};
+  }
+  try {
+    return rubbishrsa::private_key::deserialise(ifs);
+  }
+  catch (const std::exception& e) {
+    std::cerr << "ERROR: Could not read RSA private key: " << e.what() << std::endl;
+    throw exit_status{1};
   }
-  return rubbishrsa::private_key::deserialise(ifs);
 }
 
-int main(int argc, char** argv) {
+rubbishrsa::key_format read_key_format(const std::string& name) {
+  if (name == "json")
+    return rubbishrsa::key_format::json;
+  if (name == "der")
+    return rubbishrsa::key_format::der;
+  if (name == "pem")
+    return rubbishrsa::key_format::pem;
+  std::cerr << "ERROR: Unknown key format '" << name << "' (expected json, der or pem)" << std::endl;
+  throw exit_status{1};
+}
+
+// Sets up --checkpoint (and loads it, if --resume was given), returning nullptr if checkpointing is off
+//
+// job should describe everything that determines the search, so that a checkpoint cannot be resumed into the wrong one
+std::unique_ptr<rubbishrsa::checkpoint> open_checkpoint(const po::variables_map& args2, std::string job) {
+  if (!args2.count("checkpoint")) {
+    if (args2.count("resume")) {
+      std::cerr << "ERROR: --resume needs --checkpoint to say where to resume from!" << std::endl;
+      throw exit_status{1};
+    }
+    return nullptr;
+  }
+
+  auto ret = std::make_unique<rubbishrsa::checkpoint>(args2.at("checkpoint").as<std::string>(), std::move(job),
+                                                      std::chrono::seconds{args2.at("checkpoint-interval").as<unsigned int>()});
+  if (args2.count("resume")) {
+    try {
+      if (!ret->load())
+        RUBBISHRSA_LOG_INFO(std::cerr << "No checkpoint found, so starting from the beginning" << std::endl);
+    }
+    catch (const std::invalid_argument& e) {
+      std::cerr << "ERROR: " << e.what() << std::endl;
+      throw exit_status{1};
+    }
+  }
+  return ret;
+}
+
+// Runs a (possibly checkpointed) search, giving up after --timeout
+//
+// The checkpoint is deleted once the search finishes, but saved if it is stopped, so that it can be resumed
+template<typename Func>
+auto run_search(const po::variables_map& args2, rubbishrsa::checkpoint* ckpt, Func&& func) {
+  rubbishrsa::job_options options;
+  if (args2.count("timeout"))
+    options.deadline = rubbishrsa::job_options::clock::now() + std::chrono::seconds{args2.at("timeout").as<unsigned int>()};
+  RUBBISHRSA_LOG_TRACE(
+    options.progress_interval = std::chrono::seconds{5};
+    options.on_progress = [](const rubbishrsa::job_progress& progress) {
+      const auto secs = std::chrono::duration<double>(progress.elapsed).count();
+      std::cerr << "Tried " << progress.done << " in " << secs << "s (" << progress.done / secs << "/s)" << std::endl;
+    }
+  );
+  rubbishrsa::job_control job{std::move(options)};
+
+  try {
+    auto ret = func(&job);
+    if (ckpt)
+      ckpt->remove();
+    return ret;
+  }
+  catch (const rubbishrsa::job_cancelled& e) {
+    std::cerr << "ERROR: " << e.what();
+    if (ckpt) {
+      try {
+        ckpt->save();
+        std::cerr << " (the checkpoint has been saved, so it can be resumed)";
+      }
+      catch (const std::exception& save_error) {
+        std::cerr << " (and the checkpoint could not be saved: " << save_error.what() << ')';
+      }
+    }
+    std::cerr << std::endl;
+    throw exit_status{1};
+  }
+  // Such as a checkpoint with a value that is not what the search expected
+  catch (const std::invalid_argument& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    throw exit_status{1};
+  }
+}
+
+// Hands the search out to the workers that connect to --listen
+std::optional<rubbishrsa::bigint> run_coordinator(const po::variables_map& args2, rubbishrsa::distributed::work_source& source) {
+  if (args2.count("checkpoint")) {
+    std::cerr << "ERROR: --checkpoint and --listen cannot be used together!" << std::endl;
+    throw exit_status{1};
+  }
+  try {
+    return rubbishrsa::distributed::coordinate(args2.at("listen").as<std::string>(), source,
+                                               std::chrono::seconds{args2.at("lease-timeout").as<unsigned int>()});
+  }
+  catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    throw exit_status{1};
+  }
+}
+
+// Opens --in for a batch, or returns stdin if there is none. Returns nullptr if the file cannot be opened
+std::istream* open_batch_input(const po::variables_map& args2, std::ifstream& ifs) {
+  if (!args2.count("in"))
+    return &std::cin;
+  ifs.open(args2.at("in").as<std::string>());
+  if (!ifs) {
+    std::cerr << "ERROR: Cannot open input file!" << std::endl;
+    return nullptr;
+  }
+  return &ifs;
+}
+
+bool read_batch_line(std::istream& in, std::string& line) {
+  if (!std::getline(in, line))
+    return false;
+  // Be nice to files from Windows
+  if (line.size() && line.back() == '\r')
+    line.pop_back();
+  return true;
+}
+
+// Runs func over each line of --in (or stdin) on a pool of threads, writing the results in order
+//
+// func may throw to report a problem with a single line, which leaves a blank line in the output
+int run_batch(const po::variables_map& args2, std::ostream& out, unsigned int thread_count,
+              const std::function<std::string(const std::string&)>& func) {
+  std::ifstream ifs;
+  std::istream* in = open_batch_input(args2, ifs);
+  if (!in)
+    return 1;
+
+  struct batch_result { std::string text; std::string error; };
+  size_t line_no = 0;
+  bool had_error = false;
+
+  rubbishrsa::ordered_parallel_map(
+    [&]() -> std::optional<std::string> {
+      std::string line;
+      if (!read_batch_line(*in, line))
+        return std::nullopt;
+      return line;
+    },
+    [&](std::string line) -> batch_result {
+      try {
+        return {func(line), {}};
+      }
+      catch (const std::exception& e) {
+        return {{}, e.what()};
+      }
+    },
+    [&](batch_result res) {
+      ++line_no;
+      if (res.error.size()) {
+        std::cerr << "ERROR: line " << line_no << ": " << res.error << std::endl;
+        had_error = true;
+      }
+      // Flush every line, so that results stream out as they are ready
+      out << res.text << std::endl;
+    },
+    thread_count);
+
+  return had_error ? 1 : 0;
+}
+
+// Checks lines of "message signature" from --in (or stdin), writing valid or invalid for each in order
+//
+// The lines are gathered into chunks, which are each screened with verify_batch on a pool of threads
+int run_batch_verify(const po::variables_map& args2, std::ostream& out, unsigned int thread_count,
+                     const rubbishrsa::public_key& key) {
+  // Big enough that the screen's fixed costs disappear, and small enough to keep every thread busy
+  constexpr size_t chunk_size = 4096;
+
+  std::ifstream ifs;
+  std::istream* in = open_batch_input(args2, ifs);
+  if (!in)
+    return 1;
+  const bool is_hex = args2.count("hex");
+
+  struct chunk {
+    std::vector<rubbishrsa::bigint> messages, signatures;
+    // Lines that could not be parsed are left out of the screen, and reported in their place
+    std::vector<std::string> errors;
+    std::vector<bool> valid;
+  };
+  size_t line_no = 0;
+  bool had_error = false, had_invalid = false;
+
+  rubbishrsa::ordered_parallel_map(
+    [&]() -> std::optional<chunk> {
+      chunk ret;
+      std::string line;
+      while (ret.errors.size() < chunk_size && read_batch_line(*in, line)) {
+        ret.errors.emplace_back();
+        ret.messages.emplace_back();
+        ret.signatures.emplace_back();
+        try {
+          // Text messages may have spaces of their own, so the signature is whatever follows the last one
+          const auto split = line.rfind(' ');
+          if (split == std::string::npos)
+            throw std::invalid_argument("Expected a message and a signature, separated by a space");
+          const auto message = std::string_view{line}.substr(0, split);
+          ret.messages.back() = is_hex ? rubbishrsa::hex2bigint(message) : rubbishrsa::ascii2bigint(message);
+          ret.signatures.back() = rubbishrsa::hex2bigint(std::string_view{line}.substr(split + 1));
+        }
+        catch (const std::exception& e) {
+          ret.errors.back() = e.what();
+        }
+      }
+      if (ret.errors.empty())
+        return std::nullopt;
+      return ret;
+    },
+    [&](chunk c) {
+      c.valid = key.verify_batch(c.messages, c.signatures);
+      return c;
+    },
+    [&](chunk c) {
+      for (size_t i = 0; i < c.errors.size(); ++i) {
+        ++line_no;
+        if (c.errors[i].size()) {
+          std::cerr << "ERROR: line " << line_no << ": " << c.errors[i] << std::endl;
+          had_error = true;
+          out << '\n';
+          continue;
+        }
+        had_invalid |= !c.valid[i];
+        out << (c.valid[i] ? "valid" : "invalid") << '\n';
+      }
+      out.flush();
+    },
+    thread_count);
+
+  return had_error || had_invalid ? 1 : 0;
+}
+
+// Streams --message, --in or stdin through one of the block mode functions
+template<typename Func>
+int run_blocks(const po::variables_map& args2, std::ostream& out, Func&& func) {
+  if (args2.count("batch")) {
+    std::cerr << "ERROR: --batch and --blocks cannot be used together!" << std::endl;
+    return 1;
+  }
+
+  std::ifstream ifs;
+  std::istringstream iss;
+  std::istream* in = &std::cin;
+  if (args2.count("message")) {
+    iss.str(args2.at("message").as<std::string>());
+    in = &iss;
+  }
+  else if (args2.count("in")) {
+    ifs.open(args2.at("in").as<std::string>(), std::ios::binary);
+    if (!ifs) {
+      std::cerr << "ERROR: Cannot open input file!" << std::endl;
+      return 1;
+    }
+    in = &ifs;
+  }
+
+  try {
+    func(*in, out);
+  }
+  catch (const std::invalid_argument& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+int run(int argc, char** argv) {
   // Here we will set up our options
   uint_fast16_t keysize;
   std::string outfile_path;
@@ -103,16 +477,59 @@ int main(int argc, char** argv) {
   std::string target;
   std::string min, max;
   std::string candidates_path;
-
-  po::options_description common_options, gen_options, enc_options, dec_options, crack_options, brute_options, sign_options, verify_options, forge_options;
+  std::string mask, rules_path;
+  std::string format;
+  std::string keystore_path;
+  std::string stats_path, trace_path;
+  int verbosity;
+  std::vector<std::string> key_paths;
+  unsigned int thread_count;
+
+  po::options_description common_options, gen_options, enc_options, dec_options, crack_options, brute_options, sign_options, verify_options, forge_options, store_options, parallel_options, search_options, distributed_options, worker_options, serve_options, factordb_options;
   {
     common_options.add_options()
         ("help,h", "Prints a help message")
-        ("out,o", po::value(&outfile_path)->value_name("path"), "The file in which the result should be placed instead of printed to the terminal");
+        ("out,o", po::value(&outfile_path)->value_name("path"), "The file in which the result should be placed instead of printed to the terminal")
+        ("keystore,K", po::value(&keystore_path)->value_name("path"), "Look keys up in a keystore made by the store mode. --pubkey and --privkey then give the hex fingerprint or modulus of the key")
+        ("verbosity,v", po::value(&verbosity)->value_name("level")->default_value(1), "How much to log to stderr: 0 is silent, 1 is info, 2 is trace")
+        ("stats", po::value(&stats_path)->value_name("path"), "Writes counters (such as candidates tried per second) and time spent in each phase to the given file as JSON")
+        ("trace", po::value(&trace_path)->value_name("path"), "Writes a Chrome trace (for chrome://tracing or Perfetto) of each timed phase to the given file")
+        ("arena", "Pools the memory used by numbers on each thread, which cuts the time the threads of a search spend in (and fighting over) malloc")
+        ("key-cache", po::value<size_t>()->value_name("KiB"), "Keeps the CRT form of the private keys used, in up to this much memory, which makes decrypting and signing about three times quicker after the first use of each key")
+        ("factor-db", po::value<std::string>()->value_name("path"), "A database of factorised moduli (created if missing) that cracking checks before doing any work, and adds whatever it finds to. Any number of processes can share one");
+
+    parallel_options.add_options()
+        ("batch,b", "Treats each line of --in (or stdin, if --in is missing) as a separate item, and processes them in parallel")
+        ("blocks,B", "Splits a message of any size from --in, --message or stdin into modulus sized blocks, and processes them in parallel. The cyphertexts and signatures are binary")
+        ("threads,t", po::value(&thread_count)->value_name("n")->default_value(0), "The number of worker threads used by --batch and --blocks. Defaults to one per core");
+
+    search_options.add_options()
+        ("timeout", po::value<unsigned int>()->value_name("secs"), "Gives up if the search has not finished after this long")
+        ("checkpoint", po::value<std::string>()->value_name("path"), "Periodically saves the progress of the search to the given file, which is deleted once the search finishes")
+        ("resume", "Continues the search from the file given by --checkpoint, rather than starting again")
+        ("checkpoint-interval", po::value<unsigned int>()->value_name("secs")->default_value(60), "How often to save the checkpoint");
+
+    distributed_options.add_options()
+        ("listen", po::value<std::string>()->value_name("addr"), "Rather than searching here, hands the search out to workers that connect to this address (host:port, [ipv6]:port or unix:path)")
+        ("lease-timeout", po::value<unsigned int>()->value_name("secs")->default_value(60), "How long a worker has to finish a unit of work before it is given to another")
+        ("unit-size", po::value<uint64_t>()->value_name("n")->default_value(65536), "The number of candidates (or rho steps) in each unit of work");
+
+    worker_options.add_options()
+        ("connect", po::value<std::string>()->value_name("addr")->required(), "The address of the coordinator (host:port, [ipv6]:port or unix:path)")
+        ("threads,t", po::value(&thread_count)->value_name("n")->default_value(0), "The number of threads to work with. Defaults to one per core");
+
+    serve_options.add_options()
+        ("socket", po::value<std::string>()->value_name("path")->required(), "The path of the Unix socket to listen on")
+        ("key", po::value(&key_paths)->value_name("path")->composing(), "A key file (in any format) for requests to use, named by its file name without the extension. May be given many times, or as positional arguments")
+        ("threads,t", po::value(&thread_count)->value_name("n")->default_value(0), "The number of threads to work on requests with. Defaults to one per core")
+        ("max-in-flight", po::value<size_t>()->value_name("n")->default_value(64), "How many requests each connection can have in progress before we stop reading more from it")
+        ("max-cracks", po::value<unsigned int>()->value_name("n")->default_value(1), "How many crack requests can run at once (each uses every core). Any more are refused, and 0 refuses them all");
 
     gen_options.add_options()
         ("keysize,s", po::value(&keysize)->default_value(2048)->value_name("bits"), "Sets the RSA keysize")
-        ("pubkey,p", po::value(&inkey_path)->value_name("path"), "An optional path to place a generated public key");
+        ("primes,P", po::value<unsigned int>()->value_name("n")->default_value(2), "The number of primes in the modulus. More make decrypting and signing quicker (about 2x for 3 primes, and 3.5x for 4), but the primes are smaller, so keep to 3 for up to 2048 bits, and 4 for 4096")
+        ("pubkey,p", po::value(&inkey_path)->value_name("path"), "An optional path to place a generated public key")
+        ("format,f", po::value(&format)->value_name("fmt")->default_value("json"), "The format to write the keys in: json, der or pem");
 
     enc_options.add_options()
         ("hex,x", po::value(&target)->value_name("num"), "Indicates that the message is in hexadecimal, not text")
@@ -136,11 +553,14 @@ int main(int argc, char** argv) {
         ("hex,x", "Indicates that the output should be in hexadecimal. Without this options, invisible characters can be added to the end of the string to fake signatures")
         ("pubkey,p", po::value(&inkey_path)->value_name("path")->required(), "The path to the public key")
         ("sig,s", po::value(&target)->value_name("num"), "The cyphertext created by encrypt")
-        ("in,i", po::value(&target)->value_name("path"), "The path to the cyphertext file created by encrypt");
+        ("in,i", po::value(&target)->value_name("path"), "The path to the cyphertext file created by encrypt")
+        ("pairs", "With --batch, each line is a message (hexadecimal with --hex) and its signature, separated by a space. Rather than recovering each message, all of the signatures are checked together, writing valid or invalid for each line, and failing if any are invalid");
 
     crack_options.add_options()
         ("hex,x", "Indicates that the two factors should be returned (in decimal), instead of incorporated into a private key")
-        ("pubkey,p", po::value(&inkey_path)->value_name("path")->required(), "The path to the public key");
+        ("pubkey,p", po::value(&inkey_path)->value_name("path")->required(), "The path to the public key")
+        ("format,f", po::value(&format)->value_name("fmt")->default_value("json"), "The format to write the private key in: json, der or pem")
+        ("method", po::value<std::string>()->value_name("name")->default_value("auto"), "How to crack the key: wiener (instant, but only works if d is small), factor (always works, given long enough), or auto to try wiener and then factor");
 
     brute_options.add_options()
         ("hex,x", "Indicates the output should be in hexadecimal, not as text")
@@ -148,9 +568,15 @@ int main(int argc, char** argv) {
         ("ctext,c", po::value(&target)->value_name("num"), "The cyphertext created by encrypt")
         ("in,i", po::value(&target)->value_name("path"), "The path to the cyphertext file created by encrypt")
         ("list,l", po::value(&candidates_path)->value_name("path"), "A file containing all the candidate plaintexts, with newlines between them")
-        ("num,n", "Indicates that the lines in the file are hexadecimal numbers, not text")
+        ("num,n", "Indicates that the lines in the file (or the --known-prefix) are hexadecimal numbers, not text")
         ("min", po::value(&min)->value_name("num")->default_value("0"), "In the context of a range search, gives the lowest candidate value")
-        ("max", po::value(&max)->value_name("num"), "In the context of a range search, gives the largest candidate value. If missing, we use the modulus");
+        ("max", po::value(&max)->value_name("num"), "In the context of a range search, gives the largest candidate value. If missing, we use the modulus")
+        ("mask", po::value(&mask)->value_name("mask"), "Generates the candidates from a mask such as ?u?l?l?d?d (?l, ?u, ?d, ?h, ?H, ?s, ?a, ?b and ?? are supported)")
+        ("rules,r", po::value(&rules_path)->value_name("path"), "A file of hashcat-style mangling rules (one per line) to apply to each entry in the candidates file")
+        ("known-prefix", po::value<std::string>()->value_name("text"), "The start of the plaintext, which leaves only the --unknown-bits at the end to find. If e is small enough, Coppersmith's attack finds these without searching, and otherwise they are brute forced")
+        ("unknown-bits", po::value<unsigned int>()->value_name("bits"), "How many bits at the end of the plaintext are unknown (8 for each character), for --known-prefix")
+        ("also-pubkey", po::value<std::vector<std::string>>()->value_name("path")->composing(), "Another public key that the same message was encrypted with, for the common modulus and broadcast attacks. May be given many times, and is paired up in order with --also-ctext")
+        ("also-ctext", po::value<std::vector<std::string>>()->value_name("num")->composing(), "The cyphertext of the same message under the matching --also-pubkey");
 
     forge_options.add_options()
         ("hex,x",  "Indicates that the message is in hexadecimal, not text")
@@ -158,6 +584,14 @@ int main(int argc, char** argv) {
         ("invisible,u", "Indicates that invisible characters are allowed")
         ("message,m", po::value(&target)->value_name("str"), "A text (or hexadecimal) string that will be used as the RSA message")
         ("in,i", po::value(&target)->value_name("path"), "The path to the message file");
+
+    store_options.add_options()
+        ("key", po::value(&key_paths)->value_name("path")->composing(), "A key file (in any format) to add to the keystore. May be given many times, or as positional arguments")
+        ("list,l", po::value(&candidates_path)->value_name("path"), "A file containing the paths of key files to add, with newlines between them");
+
+    factordb_options.add_options()
+        ("import", po::value<std::vector<std::string>>()->value_name("path")->composing(), "A file of \"n p q\" lines of hex (such as one made by --export) to add to the database. May be given many times, or as positional arguments")
+        ("export", "Writes every modulus in the database and its factors as \"n p q\" lines of hex, after any imports");
   }
 
   // We use a copy capture so that our hidden options go unnoticed
@@ -186,15 +620,36 @@ int main(int argc, char** argv) {
               << brute_options << std::endl
               << "forge: Forges signatures for small moduli" << std::endl
               << forge_options << std::endl
+              << "store: Bundles many keys into a single memory mapped keystore (requires --out)" << std::endl
+              << store_options << std::endl
+              << "worker: Works on a crack, brute or forge that was started elsewhere with --listen" << std::endl
+              << worker_options << std::endl
+              << "serve: Keeps keys loaded, and answers enc, dec, sign, verify and crack requests on a Unix socket until interrupted" << std::endl
+              << serve_options << std::endl
+              << "factordb: Imports into and exports from the database given by --factor-db" << std::endl
+              << factordb_options << std::endl
               << std::endl;
   };
 
   // Add in the common_options option to each mode so it doesn't complain
-  for (auto* desc : {&gen_options, &enc_options, &dec_options, &crack_options, &brute_options, &sign_options, &verify_options})
+  for (auto* desc : {&gen_options, &enc_options, &dec_options, &crack_options, &brute_options, &sign_options, &verify_options, &forge_options, &store_options, &worker_options, &serve_options, &factordb_options})
     for (auto& i : common_options.options())
       desc->add(i);
 
 
+  // Add in the batch options to each mode that supports them
+  for (auto* desc : {&enc_options, &dec_options, &sign_options, &verify_options})
+    for (auto& i : parallel_options.options())
+      desc->add(i);
+
+  // And the search and distributed options to the long running searches
+  for (auto* desc : {&crack_options, &brute_options, &forge_options}) {
+    for (auto& i : search_options.options())
+      desc->add(i);
+    for (auto& i : distributed_options.options())
+      desc->add(i);
+  }
+
   // Actually parse the arguments
   po::variables_map args;
   po::store(po::command_line_parser(argc, argv)
@@ -208,6 +663,29 @@ int main(int argc, char** argv) {
     return 0;
   }
 
+  rubbishrsa::log::verbosity = verbosity;
+  metrics_output metrics{stats_path, trace_path};
+
+  // This has to happen before any number is given a value
+  std::optional<rubbishrsa::arena::scope> arena;
+  if (args.count("arena")) {
+    rubbishrsa::arena::install();
+    arena.emplace();
+  }
+  if (args.count("key-cache"))
+    rubbishrsa::enable_context_cache(args.at("key-cache").as<size_t>() * 1024);
+  std::shared_ptr<rubbishrsa::factor_db> factor_db;
+  if (args.count("factor-db")) {
+    try {
+      factor_db = std::make_shared<rubbishrsa::factor_db>(args.at("factor-db").as<std::string>());
+    }
+    catch (const std::exception& e) {
+      std::cerr << "ERROR: Could not open the factor database: " << e.what() << std::endl;
+      return 1;
+    }
+    rubbishrsa::use_factor_db(factor_db);
+  }
+
   output_handler out = args.count("out") ? output_handler{outfile_path} : output_handler{};
 
   std::string_view mode{argv[1]};
@@ -224,16 +702,23 @@ int main(int argc, char** argv) {
       return 1;
     }
 
-    auto key = rubbishrsa::private_key::generate(keysize);
+    const auto prime_count = args2.at("primes").as<unsigned int>();
+    if (prime_count < 2 || (prime_count > 2 && keysize / prime_count < 16)) {
+      std::cerr << "ERROR: A key needs at least two primes, and (beyond two) at least 16 bits for each" << std::endl;
+      return 1;
+    }
 
-    key.serialise(out.get()); // TODO: impl this as json
+    auto key_format = read_key_format(format);
+    auto key = rubbishrsa::private_key::generate(keysize, prime_count);
+
+    key.serialise(out.get(), key_format);
     if (inkey_path.size()) {
-      std::ofstream pubkey_out{inkey_path};
+      std::ofstream pubkey_out{inkey_path, std::ios::binary};
       if (!pubkey_out)
         // Don't crash, this is only a warning, as the public key could be generated later
         std::cerr << "WARNING: Could not open public key output file!" << std::endl;
       else
-        static_cast<rubbishrsa::public_key>(key).serialise(pubkey_out);
+        static_cast<rubbishrsa::public_key>(key).serialise(pubkey_out, key_format);
     }
   }
   else if (mode == "enc") {
@@ -243,6 +728,26 @@ int main(int argc, char** argv) {
                                       .run(), args2);
     po::notify(args2);
 
+    if (args2.count("blocks")) {
+      rubbishrsa::public_key key = read_pubkey(args2);
+      return run_blocks(args2, out.get(), [&](auto& in, auto& os) { rubbishrsa::encrypt_blocks(key, in, os, thread_count); });
+    }
+
+    if (args2.count("batch")) {
+      if (args2.count("message")) {
+        std::cerr << "ERROR: --message cannot be used with --batch!" << std::endl;
+        return 1;
+      }
+      rubbishrsa::public_key key = read_pubkey(args2);
+      const bool is_hex = args2.count("hex");
+      return run_batch(args2, out.get(), thread_count, [&](const std::string& line) {
+        auto data = is_hex ? rubbishrsa::hex2bigint(line) : rubbishrsa::ascii2bigint(line);
+        if (data >= key.n)
+          throw std::invalid_argument("Message is too big to be encrypted with a modulus this small!");
+        return key.raw_encrypt(data).str(0, std::ios::hex);
+      });
+    }
+
     if (args2.count("hex-message") + args2.count("message") + args2.count("in") != 1) {
       std::cerr << "ERROR: Exactly one of --hex-message, --message, --in must be specified!" << std::endl;
       return 1;
@@ -267,6 +772,27 @@ int main(int argc, char** argv) {
                                       .run(), args2);
     po::notify(args2);
 
+    if (args2.count("blocks")) {
+      rubbishrsa::private_key key = read_privkey(args2);
+      return run_blocks(args2, out.get(), [&](auto& in, auto& os) { rubbishrsa::decrypt_blocks(key, in, os, thread_count); });
+    }
+
+    if (args2.count("batch")) {
+      if (args2.count("ctext")) {
+        std::cerr << "ERROR: --ctext cannot be used with --batch!" << std::endl;
+        return 1;
+      }
+      rubbishrsa::private_key key = read_privkey(args2);
+      const bool is_hex = args2.count("hex");
+      return run_batch(args2, out.get(), thread_count, [&](const std::string& line) {
+        auto data = rubbishrsa::hex2bigint(line);
+        if (data >= key.n)
+          throw std::invalid_argument("Cyphertext too large! Maybe you used the wrong key?");
+        auto result = key.raw_decrypt(data);
+        return is_hex ? result.str(0, std::ios::hex) : rubbishrsa::bigint2ascii(result);
+      });
+    }
+
     if (args2.count("ctext") + args2.count("in") != 1) {
       std::cerr << "ERROR: Exactly one of --ctext, --in must be specified!" << std::endl;
       return 1;
@@ -296,6 +822,26 @@ int main(int argc, char** argv) {
                                       .run(), args2);
     po::notify(args2);
 
+    if (args2.count("blocks")) {
+      rubbishrsa::private_key key = read_privkey(args2);
+      return run_blocks(args2, out.get(), [&](auto& in, auto& os) { rubbishrsa::sign_blocks(key, in, os, thread_count); });
+    }
+
+    if (args2.count("batch")) {
+      if (args2.count("message")) {
+        std::cerr << "ERROR: --message cannot be used with --batch!" << std::endl;
+        return 1;
+      }
+      rubbishrsa::private_key key = read_privkey(args2);
+      const bool is_hex = args2.count("hex");
+      return run_batch(args2, out.get(), thread_count, [&](const std::string& line) {
+        auto data = is_hex ? rubbishrsa::hex2bigint(line) : rubbishrsa::ascii2bigint(line);
+        if (data >= key.n)
+          throw std::invalid_argument("Message is too big to be signed with a modulus this small!");
+        return key.raw_sign(data).str(0, std::ios::hex);
+      });
+    }
+
     rubbishrsa::private_key key = read_privkey(args2);
     rubbishrsa::bigint data = read_message(args2);
 
@@ -317,6 +863,29 @@ int main(int argc, char** argv) {
                                       .run(), args2);
     po::notify(args2);
 
+    if (args2.count("blocks")) {
+      rubbishrsa::public_key key = read_pubkey(args2);
+      return run_blocks(args2, out.get(), [&](auto& in, auto& os) { rubbishrsa::verify_blocks(key, in, os, thread_count); });
+    }
+
+    if (args2.count("batch")) {
+      if (args2.count("sig")) {
+        std::cerr << "ERROR: --sig cannot be used with --batch!" << std::endl;
+        return 1;
+      }
+      rubbishrsa::public_key key = read_pubkey(args2);
+      if (args2.count("pairs"))
+        return run_batch_verify(args2, out.get(), thread_count, key);
+      const bool is_hex = args2.count("hex");
+      return run_batch(args2, out.get(), thread_count, [&](const std::string& line) {
+        auto data = rubbishrsa::hex2bigint(line);
+        if (data >= key.n)
+          throw std::invalid_argument("Signature too large! Maybe you used the wrong key?");
+        auto result = key.raw_verify(data);
+        return is_hex ? result.str(0, std::ios::hex) : rubbishrsa::bigint2ascii(result);
+      });
+    }
+
     rubbishrsa::public_key key = read_pubkey(args2);
     rubbishrsa::bigint data = read_hex_input("sig", args2);
 
@@ -339,16 +908,46 @@ int main(int argc, char** argv) {
                                       .run(), args2);
     po::notify(args2);
 
+    const auto& method = args2.at("method").as<std::string>();
+    if (method != "auto" && method != "wiener" && method != "factor") {
+      std::cerr << "ERROR: Unknown method '" << method << "'!" << std::endl;
+      return 1;
+    }
+
     rubbishrsa::public_key key = read_pubkey(args2);
 
-    if (args2.count("hex")) {
-      auto fact = rubbishrsa::factorise_semiprime(key.n);
-      out.get() << std::hex << fact.first << std::endl << std::hex << fact.second << std::endl;
+    const auto crack_method = method == "wiener" ? rubbishrsa::attack::crack_method::wiener
+                            : method == "factor" ? rubbishrsa::attack::crack_method::factor
+                            : rubbishrsa::attack::crack_method::automatic;
+
+    rubbishrsa::private_key cracked;
+    try {
+      if (args2.count("listen")) {
+        cracked = rubbishrsa::attack::crack_key(key, crack_method, [&](const rubbishrsa::bigint& n) {
+          auto source = rubbishrsa::distributed::rho_source(n, args2.at("unit-size").as<uint64_t>());
+          auto p = run_coordinator(args2, *source);
+          // Walks never run out, so this should not happen
+          if (!p)
+            throw std::runtime_error("The workers ran out of walks without finding a factor!");
+          return std::move(*p);
+        });
+      }
+      else {
+        auto ckpt = open_checkpoint(args2, "crack " + key.n.str(0, std::ios::hex));
+        cracked = run_search(args2, ckpt.get(), [&](rubbishrsa::job_control* job) {
+          return rubbishrsa::attack::crack_key(key, ckpt.get(), job, crack_method);
+        });
+      }
     }
-    else {
-      auto k = rubbishrsa::attack::crack_key(key);
-      k.serialise(out.get());
+    catch (const std::exception& e) {
+      std::cerr << "ERROR: " << e.what() << std::endl;
+      return 1;
     }
+
+    if (args2.count("hex"))
+      out.get() << std::hex << cracked.primes[0].prime << std::endl << std::hex << cracked.primes[1].prime << std::endl;
+    else
+      cracked.serialise(out.get(), read_key_format(format));
   }
   else if (mode == "brute") {
     po::variables_map args2;
@@ -362,30 +961,133 @@ int main(int argc, char** argv) {
       return 1;
     }
     // For various API reasons, we cannot check if a defaulted argument was given
-    if ((args2.count("max")) && (args2.count("list") || args2.count("num"))) {
+    if ((args2.count("max")) && (args2.count("list") || args2.count("num") || args2.count("mask"))) {
       std::cerr << "ERROR: Invalid option combination!" << std::endl;
       return 1;
     }
+    if ((args2.count("mask") && (args2.count("list") || args2.count("num"))) || (args2.count("rules") && (!args2.count("list") || args2.count("num")))) {
+      std::cerr << "ERROR: Invalid option combination!" << std::endl;
+      return 1;
+    }
+    if (args2.count("known-prefix") != args2.count("unknown-bits") ||
+        (args2.count("known-prefix") && (!args2.at("min").defaulted() || args2.count("max") || args2.count("list") || args2.count("mask")))) {
+      std::cerr << "ERROR: Invalid option combination!" << std::endl;
+      return 1;
+    }
+    if ((args2.count("checkpoint") || args2.count("listen")) && (args2.count("mask") || args2.count("rules"))) {
+      std::cerr << "ERROR: Only range and plain list searches can be checkpointed or distributed!" << std::endl;
+      return 1;
+    }
 
     rubbishrsa::public_key key = read_pubkey(args2);
 
     rubbishrsa::bigint data = read_hex_input("ctext", args2);
 
-    std::optional<rubbishrsa::bigint> result;
+    const auto job_prefix = "brute " + key.n.str(0, std::ios::hex) + ' ' + data.str(0, std::ios::hex) + ' ';
+
+    // The algebraic attacks take no time at all when they work, so they always get a go first
+    std::vector<rubbishrsa::public_key> keys{key};
+    std::vector<rubbishrsa::bigint> ctexts{data};
+    {
+      auto also_keys = args2.count("also-pubkey") ? args2.at("also-pubkey").as<std::vector<std::string>>() : std::vector<std::string>{};
+      auto also_ctexts = args2.count("also-ctext") ? args2.at("also-ctext").as<std::vector<std::string>>() : std::vector<std::string>{};
+      if (also_keys.size() != also_ctexts.size()) {
+        std::cerr << "ERROR: Each --also-pubkey needs an --also-ctext!" << std::endl;
+        return 1;
+      }
+      for (size_t i = 0; i < also_keys.size(); ++i) {
+        keys.push_back(read_pubkey_file(also_keys[i]));
+        ctexts.push_back(rubbishrsa::hex2bigint(also_ctexts[i]));
+      }
+    }
+    std::optional<rubbishrsa::bigint> result = rubbishrsa::attack::shortcut_ptext(keys, ctexts);
+
+    // A known prefix is just a range of candidates, but one that the lattice attack can often skip searching
+    rubbishrsa::bigint known_prefix;
+    unsigned int unknown_bits = 0;
+    if (args2.count("known-prefix")) {
+      const auto& prefix = args2.at("known-prefix").as<std::string>();
+      known_prefix = args2.count("num") ? rubbishrsa::hex2bigint(prefix) : rubbishrsa::ascii2bigint(prefix);
+      unknown_bits = args2.at("unknown-bits").as<unsigned int>();
+    }
 
+    if (result)
+      RUBBISHRSA_LOG_INFO(std::cerr << "Found the plaintext without searching" << std::endl);
+    else if (args2.count("known-prefix") && (result = rubbishrsa::attack::stereotyped_ptext(key, data, known_prefix, unknown_bits)))
+      RUBBISHRSA_LOG_INFO(std::cerr << "Found the plaintext with Coppersmith's attack" << std::endl);
     // Are we in range mode?
-    if (args2.count("list")) {
+    else if (args2.count("mask")) {
+      try {
+        rubbishrsa::attack::mask_generator generator{mask};
+        result = run_search(args2, nullptr, [&](rubbishrsa::job_control* job) {
+          return rubbishrsa::attack::brute_force_ptext(key, data, generator, 0, job);
+        });
+      }
+      catch (const std::invalid_argument& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return 1;
+      }
+    }
+    else if (args2.count("list")) {
       std::ifstream ifs{candidates_path};
       if (!ifs) {
         std::cerr << "ERROR: Could not open candidates file!" << std::endl;
         return 1;
       }
-      // XXX: may not work on Windows due to CRLF bs
-      result = rubbishrsa::attack::brute_force_ptext(key, data, ifs, '\n', args2.count("num"));
+      if (args2.count("rules")) {
+        std::ifstream rules_ifs{rules_path};
+        if (!rules_ifs) {
+          std::cerr << "ERROR: Could not open rules file!" << std::endl;
+          return 1;
+        }
+        std::vector<rubbishrsa::attack::mangle_rule> rules;
+        try {
+          rules = rubbishrsa::attack::mangle_rule::parse_all(rules_ifs);
+        }
+        catch (const std::invalid_argument& e) {
+          std::cerr << "ERROR: " << e.what() << std::endl;
+          return 1;
+        }
+        // Rules need random access to the words, so we have to load them all
+        std::vector<std::string> words;
+        for (std::string line; std::getline(ifs, line);)
+          words.push_back(std::move(line));
+        result = run_search(args2, nullptr, [&](rubbishrsa::job_control* job) {
+          return rubbishrsa::attack::brute_force_ptext(key, data, words, rules, 0, job);
+        });
+      }
+      else if (args2.count("listen")) {
+        auto source = rubbishrsa::distributed::list_source(key, data, ifs, args2.count("num"), args2.at("unit-size").as<uint64_t>());
+        result = run_coordinator(args2, *source);
+      }
+      else {
+        auto ckpt = open_checkpoint(args2, job_prefix + "list " + candidates_path + (args2.count("num") ? " num" : ""));
+        // XXX: may not work on Windows due to CRLF bs
+        result = run_search(args2, ckpt.get(), [&](rubbishrsa::job_control* job) {
+          return rubbishrsa::attack::brute_force_ptext(key, data, ifs, '\n', args2.count("num"), ckpt.get(), job);
+        });
+      }
+    }
+    else {
+      auto min_num = rubbishrsa::hex2bigint(min);
+      auto max_num = args2.count("max") ? rubbishrsa::hex2bigint(max) : key.n;
+      if (args2.count("known-prefix")) {
+        // stereotyped_ptext has already said why it gave up
+        RUBBISHRSA_LOG_INFO(std::cerr << "Searching the unknown bits instead" << std::endl);
+        min_num = known_prefix << unknown_bits;
+        max_num = min_num + (rubbishrsa::bigint{1} << unknown_bits) - 1;
+      }
+      if (args2.count("listen")) {
+        auto source = rubbishrsa::distributed::range_source(key, data, min_num, max_num, args2.at("unit-size").as<uint64_t>());
+        result = run_coordinator(args2, *source);
+      }
+      else {
+        auto ckpt = open_checkpoint(args2, job_prefix + "range " + min_num.str(0, std::ios::hex) + ' ' + max_num.str(0, std::ios::hex));
+        result = run_search(args2, ckpt.get(), [&](rubbishrsa::job_control* job) {
+          return rubbishrsa::attack::brute_force_ptext(key, data, min_num, max_num, 0, ckpt.get(), job);
+        });
+      }
     }
-    else
-      result = rubbishrsa::attack::brute_force_ptext(key, data, rubbishrsa::hex2bigint(min),
-                                                     args2.count("max") ? rubbishrsa::hex2bigint(max) : key.n);
 
     if (result) {
       if (args.count("hex"))
@@ -416,16 +1118,178 @@ int main(int argc, char** argv) {
 
     std::optional<rubbishrsa::bigint> result;
 
-    if (args2.count("invisible"))
-      result = rubbishrsa::attack::brute_force_sig_invis(key, data);
-    else
-      result = rubbishrsa::attack::brute_force_sig(key, [&](const auto& i) {return i == data;});
+    if (args2.count("listen")) {
+      auto source = rubbishrsa::distributed::sig_source(key, data, args2.count("invisible"), args2.at("unit-size").as<uint64_t>());
+      result = run_coordinator(args2, *source);
+    }
+    else {
+      auto ckpt = open_checkpoint(args2, "forge " + key.n.str(0, std::ios::hex) + ' ' + data.str(0, std::ios::hex)
+                                         + (args2.count("invisible") ? " invisible" : ""));
+
+      result = run_search(args2, ckpt.get(), [&](rubbishrsa::job_control* job) {
+        if (args2.count("invisible"))
+          return rubbishrsa::attack::brute_force_sig_invis(key, data, ckpt.get(), job);
+        else
+          return rubbishrsa::attack::brute_force_sig(key, [&](const auto& i) {return i == data;}, ckpt.get(), job);
+      });
+    }
 
-    if (!result)
+    if (!result) {
       std::cerr << "ERROR: Could not find a conforming signature!" << std::endl;
+      return 1;
+    }
 
     out.get() << std::hex << *result << std::endl;
   }
+  else if (mode == "worker") {
+    po::variables_map args2;
+    po::store(po::command_line_parser(argc - 1, argv + 1)
+                                      .options(worker_options)
+                                      .run(), args2);
+    po::notify(args2);
+
+    try {
+      rubbishrsa::distributed::work(args2.at("connect").as<std::string>(), thread_count);
+    }
+    catch (const std::exception& e) {
+      std::cerr << "ERROR: " << e.what() << std::endl;
+      return 1;
+    }
+  }
+  else if (mode == "serve") {
+    po::positional_options_description positional;
+    positional.add("key", -1);
+    po::variables_map args2;
+    po::store(po::command_line_parser(argc - 1, argv + 1)
+                                      .options(serve_options)
+                                      .positional(positional)
+                                      .run(), args2);
+    po::notify(args2);
+
+    rubbishrsa::server::options opts;
+    opts.thread_count = thread_count;
+    opts.max_in_flight = args2.at("max-in-flight").as<size_t>();
+    opts.max_cracks = args2.at("max-cracks").as<unsigned int>();
+    for (const auto& path : key_paths) {
+      std::ifstream ifs{path, std::ios::binary};
+      if (!ifs) {
+        std::cerr << "ERROR: Could not open key file '" << path << '\'' << std::endl;
+        return 1;
+      }
+      const auto name = std::filesystem::path{path}.stem().string();
+      if (opts.private_keys.count(name) || opts.public_keys.count(name)) {
+        std::cerr << "ERROR: There is already a key called '" << name << '\'' << std::endl;
+        return 1;
+      }
+      // We need to try twice, so we read it all up front
+      std::string raw{std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{}};
+      try {
+        std::istringstream ss{raw};
+        opts.private_keys.emplace(name, rubbishrsa::private_key::deserialise(ss));
+      }
+      catch (const std::exception&) {
+        try {
+          std::istringstream ss{raw};
+          opts.public_keys.emplace(name, rubbishrsa::public_key::deserialise(ss));
+        }
+        catch (const std::exception& e) {
+          std::cerr << "ERROR: Could not read key file '" << path << "': " << e.what() << std::endl;
+          return 1;
+        }
+      }
+    }
+
+    try {
+      rubbishrsa::server::serve(args2.at("socket").as<std::string>(), opts);
+    }
+    catch (const std::exception& e) {
+      std::cerr << "ERROR: " << e.what() << std::endl;
+      return 1;
+    }
+  }
+  else if (mode == "store") {
+    po::positional_options_description positional;
+    positional.add("key", -1);
+    po::variables_map args2;
+    po::store(po::command_line_parser(argc - 1, argv + 1)
+                                      .options(store_options)
+                                      .positional(positional)
+                                      .run(), args2);
+    po::notify(args2);
+
+    if (!args2.count("out")) {
+      std::cerr << "ERROR: The keystore is binary, so --out must be given!" << std::endl;
+      return 1;
+    }
+
+    if (args2.count("list")) {
+      std::ifstream ifs{candidates_path};
+      if (!ifs) {
+        std::cerr << "ERROR: Could not open key list file!" << std::endl;
+        return 1;
+      }
+      for (std::string line; std::getline(ifs, line);)
+        if (line.size())
+          key_paths.push_back(std::move(line));
+    }
+
+    rubbishrsa::keystore::builder builder;
+    for (const auto& path : key_paths) {
+      std::ifstream ifs{path, std::ios::binary};
+      if (!ifs) {
+        std::cerr << "ERROR: Could not open key file '" << path << '\'' << std::endl;
+        return 1;
+      }
+      try {
+        auto fingerprint = builder.add_serialised(ifs);
+        std::cerr << std::hex << std::setw(16) << std::setfill('0') << fingerprint << ' ' << path << std::endl;
+      }
+      catch (const std::exception& e) {
+        std::cerr << "ERROR: Could not read key file '" << path << "': " << e.what() << std::endl;
+        return 1;
+      }
+    }
+
+    builder.write(out.get());
+  }
+  else if (mode == "factordb") {
+    po::positional_options_description positional;
+    positional.add("import", -1);
+    po::variables_map args2;
+    po::store(po::command_line_parser(argc - 1, argv + 1)
+                                      .options(factordb_options)
+                                      .positional(positional)
+                                      .run(), args2);
+    po::notify(args2);
+
+    if (!factor_db) {
+      std::cerr << "ERROR: --factor-db must be given!" << std::endl;
+      return 1;
+    }
+
+    if (args2.count("import")) {
+      for (const auto& path : args2.at("import").as<std::vector<std::string>>()) {
+        std::ifstream ifs{path};
+        if (!ifs) {
+          std::cerr << "ERROR: Could not open '" << path << '\'' << std::endl;
+          return 1;
+        }
+        try {
+          auto added = factor_db->import_from(ifs);
+          RUBBISHRSA_LOG_INFO(std::cerr << "Added " << added << " new moduli from '" << path << '\'' << std::endl);
+        }
+        catch (const std::exception& e) {
+          std::cerr << "ERROR: Could not import '" << path << "': " << e.what() << std::endl;
+          return 1;
+        }
+      }
+    }
+
+    if (args2.count("export"))
+      factor_db->export_to(out.get());
+
+    RUBBISHRSA_LOG_INFO(std::cerr << "The database holds " << factor_db->size() << " moduli" << std::endl);
+  }
   else {
     std::cerr << "ERROR: Unknown mode '" << argv[1] << '\'' << std::endl << std::endl;
     print_help();
@@ -433,3 +1297,12 @@ int main(int argc, char** argv) {
 
   return 0;
 }
+
+int main(int argc, char** argv) {
+  try {
+    return run(argc, argv);
+  }
+  catch (const exit_status& e) {
+    return e.code;
+  }
+}
@@ -0,0 +1,48 @@
+//! Pooled allocation for GMP's temporaries, so hot loops stay out of malloc
+//!
+//! Every bigint that is created, grown or destroyed goes through GMP's memory functions. Once these are
+//! installed, and whilst any scope is alive, each thread keeps freed blocks in per-size-class free lists and
+//! hands them straight back out again, so the threads of a search no longer fight over the heap.
+//!
+//! This is all opt-in: either call install() first thing in main and open a scope around the work, or build
+//! with RUBBISHRSA_GMP_ARENA to have both done for the whole program.
+
+#pragma once
+
+namespace rubbishrsa::arena {
+  /// Routes all of GMP's allocations through us, counting them in the gmp_allocations and heap_allocations metrics
+  ///
+  /// GMP cannot tell us where memory it already holds came from, so this must be called before any bigint is
+  /// given a value. It does nothing if already installed
+  void install();
+  bool installed();
+
+  /// Pools GMP's allocations on every thread for as long as it (or any other scope) is alive
+  ///
+  /// Does nothing unless install() has been called
+  class scope {
+  public:
+    scope();
+    ~scope();
+
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+  };
+
+  /// Hands the blocks this thread has pooled back to the heap
+  ///
+  /// This happens by itself when the thread exits, or when the last scope ends on this thread
+  void trim();
+
+#ifdef RUBBISHRSA_GMP_ARENA
+  namespace detail {
+    // Installs the hooks and opens a scope before main, which is never closed
+    //
+    // This is defined in everything that includes this header (which maths.hpp does), so that it is always linked in
+    struct whole_program_arena {
+      whole_program_arena();
+    };
+    inline const whole_program_arena whole_program;
+  }
+#endif
+}
@@ -0,0 +1,42 @@
+//! Non-blocking versions of the long running functions, for embedding the library in something that cannot wait
+//!
+//! Each of these starts the job on its own thread and returns straight away. The future then holds the result,
+//! or job_cancelled (or deadline_exceeded) if the job was stopped by options.stop or options.deadline first.
+
+#pragma once
+
+#include "rubbishrsa/candidates.hpp"
+#include "rubbishrsa/job.hpp"
+#include "rubbishrsa/keys.hpp"
+
+#include <functional>
+#include <future>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace rubbishrsa::async {
+  std::future<bigint> generate_prime(uint_fast16_t bits, job_options options = {}, unsigned int thread_count = 0);
+
+  std::future<std::pair<bigint, bigint>> factorise_semiprime(bigint semiprime, job_options options = {});
+
+  std::future<private_key> crack_key(public_key pubkey, job_options options = {});
+
+  /// Brute forces with all the plaintexts between two numbers (inclusive)
+  std::future<std::optional<bigint>> brute_force_ptext(public_key pubkey, bigint encrypted_message, bigint min, bigint max,
+                                                       job_options options = {}, unsigned int thread_count = 0);
+
+  /// Brute forces with every candidate described by the mask
+  std::future<std::optional<bigint>> brute_force_ptext(public_key pubkey, bigint encrypted_message, attack::mask_generator mask,
+                                                       job_options options = {}, unsigned int thread_count = 0);
+
+  /// Brute forces with every rule applied to every word in the list
+  std::future<std::optional<bigint>> brute_force_ptext(public_key pubkey, bigint encrypted_message,
+                                                       std::vector<std::string> words, std::vector<attack::mangle_rule> rules,
+                                                       job_options options = {}, unsigned int thread_count = 0);
+
+  std::future<std::optional<bigint>> brute_force_sig(public_key pubkey, std::function<bool(const bigint&)> check_result,
+                                                     job_options options = {});
+
+  std::future<std::optional<bigint>> brute_force_sig_invis(public_key pubkey, bigint msg, job_options options = {});
+}
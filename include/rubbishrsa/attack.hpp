@@ -2,11 +2,14 @@
 
 #pragma once
 
+#include "rubbishrsa/checkpoint.hpp"
+#include "rubbishrsa/job.hpp"
 #include "rubbishrsa/keys.hpp"
 
 #include <functional>
 #include <ios>
 #include <optional>
+#include <span>
 
 namespace rubbishrsa::attack {
   /// Derives the result of encrypting the product of the unknown plaintext and the given value (mod n)
@@ -26,14 +29,86 @@ namespace rubbishrsa::attack {
   // Returns true if the given char is invisible
   bool is_invisible(char);
 
-  /// Attempt to factorise the key
-  private_key crack_key(const public_key& pubkey);
+  /// Returns true if the two strings (as numbers) are the same once invisible chars are removed from the candidate
+  bool equal_up_to_invisible(const bigint& candidate, const bigint& msg);
+
+  /// Wiener's attack, which recovers the key from the continued fraction of e/n if d is below about n^(1/4)
+  ///
+  /// This takes a fraction of a second however big the key is
+  ///
+  /// @returns the private key, or std::nullopt if d is too big for this to work
+  std::optional<private_key> wiener(const public_key& pubkey);
+
+  /// Which attacks crack_key is allowed to try
+  enum class crack_method {
+    /// Wiener's attack, and then factorising the modulus if d is too big for it
+    automatic,
+    /// Only Wiener's attack
+    wiener,
+    /// Only factorising the modulus
+    factor
+  };
+
+  /// Attempt to crack the key, with Wiener's attack and then by factorising the modulus
+  ///
+  /// If use_factor_db has been called, the database is checked first, and whatever is found is added to it.
+  /// Throws std::invalid_argument if the method is crack_method::wiener and d is too big for it
+  ///
+  /// @param ckpt: If given, the factorisation periodically saves its progress here, and resumes from anything loaded into it
+  /// @param job: If given, lets the factorisation be cancelled (throwing job_cancelled) and report its progress
+  private_key crack_key(const public_key& pubkey, checkpoint* ckpt = nullptr, job_control* job = nullptr,
+                        crack_method method = crack_method::automatic);
+
+  /// The same, but factorises the modulus with find_factor, which is given n and returns a nontrivial factor of it
+  ///
+  /// This is for factorising somewhere else, such as with distributed::coordinate
+  private_key crack_key(const public_key& pubkey, crack_method method,
+                        const std::function<bigint(const bigint&)>& find_factor);
+
+  // The shortcuts below only work in special cases, but take no time at all when they do
+
+  /// Takes the integer e'th root of the cyphertext, which is the plaintext if m^e never reached n
+  std::optional<bigint> small_message_root(const public_key& pubkey, const bigint& encrypted_message);
+
+  /// Recovers a message encrypted under two keys that share a modulus, but have coprime exponents
+  //
+  // If a*e_1 + b*e_2 = 1, then c_1^a * c_2^b = m^(a*e_1 + b*e_2) = m
+  std::optional<bigint> common_modulus(const public_key& key_1, const bigint& encrypted_1,
+                                       const public_key& key_2, const bigint& encrypted_2);
+
+  /// Hastad's broadcast attack, which recovers a message encrypted under e different keys that all use the same e
+  //
+  // The CRT gives m^e mod the product of the moduli, which is more than m^e, so we just take the root
+  ///
+  /// Throws std::invalid_argument if the keys do not all have the same e, or there are fewer than e of them
+  std::optional<bigint> hastad_broadcast(std::span<const public_key> keys, std::span<const bigint> encrypted_messages);
+
+  /// Tries every shortcut on any encryptions of the same message, and returns the message if one works
+  ///
+  /// This picks out the keys that share a modulus, and the groups that share a small enough e, by itself
+  std::optional<bigint> shortcut_ptext(std::span<const public_key> keys, std::span<const bigint> encrypted_messages);
+
+  /// Coppersmith's attack on stereotyped messages, which recovers the end of a message from its start, if e is small
+  ///
+  /// The message is known_prefix * 2^unknown_bits + x, so x is a small root of (known_prefix * 2^unknown_bits + x)^e - c
+  /// (mod n). A lattice of multiples of this polynomial and powers of n is reduced with LLL, which leaves a polynomial
+  /// with the same root over the integers, where it is easy to find. This works for up to a little under
+  /// (log2 n) / e unknown bits: with e = 3 and a 1024 bit n, 128 bits take half a millisecond and 240 take 40
+  /// milliseconds, but the lattice (and the time LLL takes) grows quickly towards the limit, so it gives up past
+  /// about 270. Brute forcing, on the other hand, is hopeless past about 40 bits
+  ///
+  /// @returns the message, or std::nullopt if there are too many unknown bits (or e is too big) for this to work, or
+  ///          no small root was found. Which of these it was is logged
+  std::optional<bigint> stereotyped_ptext(const public_key& pubkey, const bigint& encrypted_message,
+                                          const bigint& known_prefix, unsigned int unknown_bits);
 
   /// Exploits the lack of semantic security in textbook RSA
   ///
   /// @param get_next_candidate: A function that returns a new candidate, or std::nullopt if the space is exhausted.
   ///                            Be aware that this may be accessed concurrently, and so should be thread safe.
   ///                            It will be passed the thread count and the thread id
+  /// @param job: If given, lets the search be cancelled (throwing job_cancelled) and report the candidates tried.
+  ///             Every other overload passes this on to here
   ///
   /// @returns the plaintext that encrypts to encrypted_message or std::nullopt if no matching plaintext was found
   //
@@ -42,25 +117,36 @@ namespace rubbishrsa::attack {
   // plaintext was
   std::optional<bigint> brute_force_ptext(const public_key& pubkey, const bigint& encrypted_message,
                                           std::function<std::optional<bigint>(unsigned int)> get_next_candidate,
-                                          unsigned int thread_count = 0);
+                                          unsigned int thread_count = 0, job_control* job = nullptr);
 
   /// A simple wrapper that brute forces with all the plaintexts in a file, with the given delimiter (defaults to a newline)
   ///
   /// @param convert_str_to_num If false, the entries in the file will be treated as a hexadecimal number,
   ///                           as opposed to text to be converted
+  /// @param ckpt: If given, the offset of the earliest unchecked line is saved here, and a loaded offset is seeked to.
+  ///              The stream must then be seekable
   std::optional<bigint> brute_force_ptext(const public_key& pubkey, const bigint& encrypted_message,
-                                          std::istream& in, char delim = '\n', bool convert_hex_to_num = false);
+                                          std::istream& in, char delim = '\n', bool convert_hex_to_num = false,
+                                          checkpoint* ckpt = nullptr, job_control* job = nullptr);
 
   /// A simple wrapper that brute forces with all the plaintexts between two numbers (inclusive)
+  ///
+  /// @param ckpt: If given, each thread's position is saved here, and resumed from if loaded.
+  ///              The thread count of a resumed search is the one it was saved with
   std::optional<bigint> brute_force_ptext(const public_key& pubkey, const bigint& encrypted_message,
-                                          const bigint& min, const bigint& max);
+                                          const bigint& min, const bigint& max, unsigned int thread_count = 0,
+                                          checkpoint* ckpt = nullptr, job_control* job = nullptr);
 
   /// Attempt to brute force the space to find a valid signature.
   ///
-  /// This can be used to
+  /// This tries every signature below the modulus, so it always finishes, even if that may take a while
   ///
   /// @param check_result: A function that returns true if a valid result was found. Will be run in parallel
-  std::optional<bigint> brute_force_sig(const public_key& pubkey, std::function<bool(const bigint&)> check_result);
+  /// @param ckpt: If given, each thread's next guess is saved here, and resumed from if loaded
+  /// @param job: If given, lets the search be cancelled (throwing job_cancelled) and report the guesses tried
+  std::optional<bigint> brute_force_sig(const public_key& pubkey, std::function<bool(const bigint&)> check_result,
+                                        checkpoint* ckpt = nullptr, job_control* job = nullptr);
 
-  std::optional<bigint> brute_force_sig_invis(const public_key& pubkey, bigint msg);
+  std::optional<bigint> brute_force_sig_invis(const public_key& pubkey, bigint msg, checkpoint* ckpt = nullptr,
+                                              job_control* job = nullptr);
 }
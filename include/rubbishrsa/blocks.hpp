@@ -0,0 +1,28 @@
+//! Encrypting and signing streams that are larger than the modulus
+
+#pragma once
+
+#include "rubbishrsa/keys.hpp"
+
+#include <iosfwd>
+
+namespace rubbishrsa {
+  /// The number of message bytes carried by each block for the given modulus
+  ///
+  /// Each block holds a two byte length followed by the message bytes, which together are one byte shorter
+  /// than the modulus, so they are always less than it. Every block is full except the last, which may be empty,
+  /// so the end of the message is always unambiguous.
+  size_t block_payload_size(const bigint& n);
+
+  /// Splits the stream into blocks, encrypts them in parallel, and writes each as a fixed size big endian number
+  ///
+  /// Only a bounded number of blocks are held in memory at once, so this works on arbitrarily large streams
+  void encrypt_blocks(const public_key& key, std::istream& in, std::ostream& out, unsigned int thread_count = 0);
+  /// Reverses encrypt_blocks, throwing std::invalid_argument if the stream is truncated or the wrong key was used
+  void decrypt_blocks(const private_key& key, std::istream& in, std::ostream& out, unsigned int thread_count = 0);
+
+  /// Like encrypt_blocks, but signs each block instead
+  void sign_blocks(const private_key& key, std::istream& in, std::ostream& out, unsigned int thread_count = 0);
+  /// Recovers the message signed by sign_blocks, throwing std::invalid_argument if any block does not verify
+  void verify_blocks(const public_key& key, std::istream& in, std::ostream& out, unsigned int thread_count = 0);
+}
@@ -0,0 +1,95 @@
+//! Generators for structured plaintext spaces, for use with the brute forcer
+
+#pragma once
+
+#include "rubbishrsa/keys.hpp"
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rubbishrsa::attack {
+  /// A hashcat-style charset mask, such as `?u?l?l?l?d?d`
+  ///
+  /// Supported placeholders are `?l` (a-z), `?u` (A-Z), `?d` (0-9), `?h` (0-9a-f), `?H` (0-9A-F),
+  /// `?s` (printable symbols), `?a` (?l?u?d?s), `?b` (every byte) and `??` (a literal '?').
+  /// Every other character is taken literally.
+  //
+  // Candidates are ordered so that the last character changes fastest. As the last character
+  // is the least significant byte of the resulting bigint, stepping through the candidates only
+  // ever touches the low-order bytes, and the bigint can be updated with a single addition
+  // instead of being rebuilt with ascii2bigint.
+  class mask_generator {
+  public:
+    /// Walks a contiguous slice of the candidates, updating the bigint in place
+    class cursor {
+    public:
+      /// Writes the next candidate into out, or returns false if the slice is exhausted
+      bool next(bigint& out);
+
+    private:
+      friend mask_generator;
+
+      const mask_generator* mask = nullptr;
+      std::vector<uint_fast16_t> digits;
+      bigint value;
+      bigint remaining;
+      bool started = false;
+    };
+
+    /// Parses the mask, throwing std::invalid_argument if it is malformed
+    explicit mask_generator(std::string_view mask);
+
+    /// The total number of candidates covered by this mask
+    const bigint& size() const { return total; }
+
+    /// Returns the index'th candidate as a string
+    std::string at(bigint index) const;
+
+    /// Returns a cursor that will yield `count` candidates, starting at `index`
+    cursor slice(bigint index, bigint count) const;
+
+  private:
+    // The characters allowed at each position, from left to right
+    std::vector<std::string> charsets;
+    // step[p][j] is what must be added to the bigint when position p moves from charset[j] to charset[j + 1]
+    std::vector<std::vector<bigint>> step;
+    // wrap[p] is what must be added to the bigint when position p wraps back to its first character
+    std::vector<bigint> wrap;
+    bigint total = 1;
+
+    // Splits the index into a digit for each position
+    std::vector<uint_fast16_t> decompose(bigint index) const;
+  };
+
+  /// A single hashcat-style mangling rule, such as `c $1 $!`
+  ///
+  /// Supported functions are `:` `l` `u` `c` `C` `t` `TN` `r` `d` `f` `{` `}` `$X` `^X` `[` `]` `DN` `'N` `sXY` and `@X`,
+  /// where N is a position (0-9, then A-Z for 10-35). Whitespace between functions is ignored.
+  class mangle_rule {
+  public:
+    /// Parses the rule, throwing std::invalid_argument if it is malformed
+    static mangle_rule parse(std::string_view rule);
+
+    /// Reads one rule per line, skipping blank lines and `#` comments
+    static std::vector<mangle_rule> parse_all(std::istream& in);
+
+    /// Applies the rule to the given word
+    std::string apply(std::string word) const;
+
+  private:
+    struct op { char func; char arg_1; char arg_2; };
+    std::vector<op> ops;
+  };
+
+  /// Brute forces with every candidate described by the mask
+  std::optional<bigint> brute_force_ptext(const public_key& pubkey, const bigint& encrypted_message,
+                                          const mask_generator& mask, unsigned int thread_count = 0,
+                                          job_control* job = nullptr);
+
+  /// Brute forces with every rule applied to every word in the list
+  std::optional<bigint> brute_force_ptext(const public_key& pubkey, const bigint& encrypted_message,
+                                          const std::vector<std::string>& words, const std::vector<mangle_rule>& rules,
+                                          unsigned int thread_count = 0, job_control* job = nullptr);
+}
@@ -0,0 +1,65 @@
+//! Saving the progress of long running searches, so they can be resumed later
+
+#pragma once
+
+#include "rubbishrsa/maths.hpp"
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace rubbishrsa {
+  /// A small text file of key=value pairs holding the state of a search
+  ///
+  /// The searches that accept one publish their state every so often, and the file is rewritten
+  /// (atomically, via a rename) at most once per interval, so the overhead is negligible.
+  /// Every method is thread safe.
+  class checkpoint {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    /// @param job: Describes the search, so that a checkpoint is never resumed into a different one
+    checkpoint(std::string path, std::string job, clock::duration interval = std::chrono::minutes{1});
+
+    /// Loads the saved state, returning false if there is no file
+    ///
+    /// Throws std::invalid_argument if the file belongs to a different job, or is malformed (including any value
+    /// that is not a number)
+    bool load();
+
+    /// The saved values, or std::nullopt if there are none
+    ///
+    /// These throw std::invalid_argument if the value is not of that type, so searches read them before starting
+    /// their threads, where an exception would take the whole process down
+    std::optional<std::string> get(const std::string& key) const;
+    std::optional<bigint> get_bigint(const std::string& key) const;
+    std::optional<unsigned long long> get_uint(const std::string& key) const;
+
+    /// Sets a value, but does not save it
+    void set(const std::string& key, std::string value);
+    void set(const std::string& key, const bigint& value);
+    void set(const std::string& key, unsigned long long value);
+
+    /// Saves if the interval has passed since the last save
+    ///
+    /// This never throws, as it is called from the threads doing the search: a save that fails is logged, and
+    /// tried again an interval later
+    void maybe_save();
+    /// Saves now, throwing std::runtime_error (or std::filesystem::filesystem_error) if the file cannot be written
+    void save();
+    /// Deletes the file, for when the search has finished
+    void remove();
+
+  private:
+    mutable std::mutex mutex;
+    std::string path;
+    std::string job;
+    clock::duration interval;
+    clock::time_point last_save;
+    std::map<std::string, std::string> values;
+
+    void save_locked();
+  };
+}
@@ -0,0 +1,83 @@
+//! An opt-in cache of what is worth precomputing for each key, for processes that keep coming back to the same keys
+//!
+//! GMP's powm sets up its Montgomery constants and windows afresh for each call, cheaply, and gives us no way to
+//! keep them. What is worth keeping is the CRT form of each private key: p, q, d mod (p - 1), d mod (q - 1) and
+//! q^-1 mod p. Finding these takes a recover_factors and a modinv, but after that each decryption or signature is
+//! a pair of half size exponentiations, which is about three times quicker than one with d.
+//!
+//! Public key operations have nothing worth precomputing (e is tiny), so they never look at the cache. Nor do keys
+//! that already hold their primes, which do the CRT by themselves.
+
+#pragma once
+
+#include "rubbishrsa/keys.hpp"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace rubbishrsa {
+  /// The precomputed form of a private key
+  struct key_context {
+    bigint n, e, d;
+    /// The CRT parameters, which are all 0 if two prime factors could not be recovered from d
+    bigint p, q, d_p, d_q, q_inv;
+
+    /// Works out the CRT parameters for the key
+    static key_context from_private_key(const private_key& key);
+
+    /// x^d (mod n), by the CRT if it can
+    bigint exponentiate_private(const bigint& x) const;
+
+    /// Roughly how much memory this takes up
+    size_t memory_used() const;
+  };
+
+  /// A thread safe, least recently used cache of key contexts, keyed by modulus
+  class context_cache {
+  public:
+    struct statistics {
+      uint64_t hits = 0, misses = 0, evictions = 0;
+      size_t entries = 0, bytes = 0;
+    };
+
+    /// @param max_bytes: The most memory the contexts can take up before the least recently used are dropped
+    explicit context_cache(size_t max_bytes);
+
+    /// The context for the key, which is worked out (and added) if it is not already cached
+    ///
+    /// The context stays valid for as long as it is held, even if it is dropped from the cache meanwhile
+    std::shared_ptr<const key_context> get(const private_key& key);
+
+    /// Drops the least recently used contexts until they fit
+    void set_max_bytes(size_t max_bytes);
+    void clear();
+
+    statistics stats() const;
+
+  private:
+    struct entry {
+      uint64_t fingerprint;
+      std::shared_ptr<const key_context> context;
+    };
+
+    mutable std::mutex mutex;
+    // Most recently used at the front
+    std::list<entry> lru;
+    // Almost every fingerprint has a single key, but two keys can share one (or a modulus, with different d)
+    std::unordered_multimap<uint64_t, std::list<entry>::iterator> index;
+    size_t max_bytes;
+    statistics counts;
+
+    // Only to be called with the mutex held
+    void evict_to(size_t max_bytes);
+  };
+
+  /// The cache that raw_decrypt and raw_sign go through, once enable_context_cache has been called
+  context_cache& shared_context_cache();
+
+  /// Turns on the shared cache, with room for max_bytes of contexts, or turns it off (and empties it) given 0
+  void enable_context_cache(size_t max_bytes);
+}
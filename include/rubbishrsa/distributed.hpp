@@ -0,0 +1,62 @@
+//! Splitting searches between many machines: a coordinator hands out leased units of work to workers that connect to it
+
+#pragma once
+
+#include "rubbishrsa/keys.hpp"
+
+#include <chrono>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace rubbishrsa::distributed {
+  /// A search that can be split into units of work
+  ///
+  /// Units are single lines of text, so that a unit whose lease runs out can simply be handed out again
+  //
+  // The wire protocol is line based too. A worker sends "hello <threads>" and gets describe() back, then asks
+  // for work with "next", and gets "unit <id> <unit>", "wait" (everything is leased out), "cancel" or "done".
+  // It answers each unit with "found <id> <hex>" or "none <id> <report>".
+  class work_source {
+  public:
+    virtual ~work_source() = default;
+
+    /// The line that tells a worker what kind of search this is, and its parameters
+    virtual std::string describe() const = 0;
+    /// Returns the next unit for a worker with the given number of threads, or std::nullopt if everything has been handed out
+    virtual std::optional<std::string> next_unit(unsigned int worker_threads) = 0;
+    /// Called when a unit finishes without success, with whatever else the worker reported
+    virtual void unit_done(const std::string& /* unit */, const std::string& /* report */) {}
+    /// Checks a result claimed by a worker, so that a broken worker cannot end the search
+    virtual bool check(const bigint& result) const = 0;
+  };
+
+  /// Hands out the plaintexts between min and max (inclusive), unit_size at a time
+  std::unique_ptr<work_source> range_source(const public_key& pubkey, const bigint& encrypted_message,
+                                            bigint min, bigint max, uint64_t unit_size);
+  /// Hands out the lines of a file (treated like brute_force_ptext does), unit_size lines at a time
+  std::unique_ptr<work_source> list_source(const public_key& pubkey, const bigint& encrypted_message,
+                                           std::istream& in, bool convert_hex_to_num, uint64_t unit_size);
+  /// Hands out signature guesses, looking for one that verifies to msg (up to invisible chars, if allowed)
+  std::unique_ptr<work_source> sig_source(const public_key& pubkey, bigint msg, bool allow_invisible, uint64_t unit_size);
+  /// Hands out independent Pollard's rho walks on n, one per worker thread, for unit_size steps at a time
+  ///
+  /// A walk that cycles without a factor is replaced by a new one, as pollard_rho does
+  std::unique_ptr<work_source> rho_source(const bigint& n, uint64_t unit_size);
+
+  /// Listens on the given address, handing out work to anyone that connects, until a worker succeeds or the work runs out
+  ///
+  /// As soon as a worker succeeds, every other worker is told to cancel.
+  ///
+  /// @param address: host:port (or [ipv6]:port) for TCP, or unix:path for a Unix socket
+  /// @param lease_timeout: How long a worker has to finish a unit before it is handed to someone else
+  /// @returns the result, or std::nullopt if every unit was finished without one
+  std::optional<bigint> coordinate(const std::string& address, work_source& source,
+                                   std::chrono::seconds lease_timeout = std::chrono::seconds{60});
+
+  /// Connects to a coordinator, and works on whatever it hands out until it says to stop
+  ///
+  /// @param thread_count: The number of threads to work on each unit with, or 0 for one per core
+  void work(const std::string& address, unsigned int thread_count = 0);
+}
@@ -0,0 +1,124 @@
+//! A persistent database of moduli we have already factorised, so that no modulus is ever factorised twice
+//!
+//! The database is kept in two files. The log (at the path given) is the truth: one "n p q" line of hex per modulus,
+//! only ever appended to, so it survives crashes and can be read, grepped and merged by hand. The index (at the
+//! path with ".idx" on the end) is a memory mapped open addressing hash table from each modulus' fingerprint to
+//! the offset of its line, so that a lookup reads a single line however big the log gets. The index can always be
+//! rebuilt from the log, and is whenever it is missing, malformed or behind.
+//!
+//! Any number of processes can use the same database at once. Everything is done under a lock on a third file
+//! (the path with ".lock" on the end), which lookups share and additions hold to themselves.
+
+#pragma once
+
+#include "rubbishrsa/keys.hpp"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+
+namespace rubbishrsa {
+  /// A thread and process safe map from moduli to their factors, kept on disk
+  ///
+  /// Record locks do not keep threads of the same process apart, so each process should open a database only once,
+  /// and share that between its threads
+  class factor_db {
+  public:
+    /// The on-disk header of the index
+    struct header {
+      char magic[8];
+      uint32_t version;
+      uint32_t reserved_0;
+      /// The number of slots, which is always a power of two
+      uint64_t capacity;
+      uint64_t count;
+      /// How much of the log has been indexed. Anything after this is scanned on each lookup until it is indexed
+      uint64_t indexed_bytes;
+      uint64_t reserved[3];
+    };
+
+    /// A slot in the index
+    struct slot {
+      uint64_t fingerprint;
+      /// One past the offset of the line in the log, so that 0 marks an empty slot
+      uint64_t offset_plus_one;
+    };
+
+    /// Opens the database at the given path, creating it if it does not exist
+    ///
+    /// Throws std::runtime_error if the files cannot be created or opened
+    explicit factor_db(const std::string& path);
+
+    /// The factors of n, if they are in the database
+    std::optional<std::pair<bigint, bigint>> find(const bigint& n);
+
+    /// Adds the factors of n, throwing std::invalid_argument if they are not factors of n
+    ///
+    /// @returns false if n was already in the database, in which case nothing is written
+    bool add(const bigint& n, const bigint& p, const bigint& q);
+
+    /// Writes every modulus and its factors as "n p q" lines of hex, which is what import reads
+    void export_to(std::ostream& os);
+    /// Adds each "n p q" line of hex, throwing std::invalid_argument (after adding the lines before it) if a line
+    /// is malformed or has the wrong factors
+    ///
+    /// @returns the number of moduli that were not already in the database
+    size_t import_from(std::istream& is);
+
+    size_t size();
+
+  private:
+    struct record {
+      bigint n, p, q;
+    };
+
+    std::string log_path, index_path;
+    std::mutex mutex;
+    // This is a POSIX record lock on Linux, which is dropped if the process closes *any* handle to the file, so
+    // nothing else ever opens the lock file
+    boost::interprocess::file_lock lock;
+    std::ifstream log_in;
+    std::ofstream log_out;
+    boost::interprocess::file_mapping index_file;
+    boost::interprocess::mapped_region index_region;
+
+    // Everything below needs the mutex and the file lock (shared, unless it writes)
+    header& index_header();
+    slot* slots();
+    bool index_valid();
+    void remap_if_grown();
+    uint64_t log_size();
+    std::optional<record> read_record(uint64_t offset);
+    // Calls func(offset, record) for each valid, complete line from the offset on, returning where the last ended
+    template<typename Func>
+    uint64_t for_each_record(uint64_t from, Func&& func);
+    std::optional<record> find_indexed(const bigint& n);
+    std::optional<record> find_locked(const bigint& n);
+    bool add_locked(const bigint& n, const bigint& p, const bigint& q);
+    // These need the lock to ourselves
+    void catch_up();
+    void reset(uint64_t capacity);
+    void grow();
+    void insert(uint64_t fingerprint, uint64_t offset);
+  };
+
+  /// Makes factorise_semiprime and crack_key look in the database before doing any work, and add whatever they
+  /// find to it, or stops them doing so given nullptr
+  void use_factor_db(std::shared_ptr<factor_db> db);
+
+  /// The database given to use_factor_db, if any
+  std::shared_ptr<factor_db> active_factor_db();
+
+  /// Adds the factors to the database, but logs rather than throws if that fails (say, on a read only file or a
+  /// full disk), for callers whose factors are worth more than the record of them
+  void remember_factors(factor_db& db, const bigint& n, const bigint& p, const bigint& q);
+}
@@ -0,0 +1,122 @@
+//! Cancellation, deadlines and progress reporting for the long running functions
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace rubbishrsa {
+  /// Thrown when a job is stopped before it finishes
+  class job_cancelled : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+  /// Thrown when a job is stopped because it ran past its deadline
+  class deadline_exceeded : public job_cancelled {
+  public:
+    using job_cancelled::job_cancelled;
+  };
+
+  /// How far a job has got
+  struct job_progress {
+    /// Candidates, rho steps or prime candidates tried so far
+    uint64_t done;
+    std::chrono::steady_clock::duration elapsed;
+  };
+
+  struct job_options {
+    using clock = std::chrono::steady_clock;
+
+    std::stop_token stop = {};
+    std::optional<clock::time_point> deadline = std::nullopt;
+    /// Called from whichever worker thread notices it is due, so it should be quick and thread safe
+    std::function<void(const job_progress&)> on_progress = {};
+    /// The least time between calls to on_progress
+    clock::duration progress_interval = std::chrono::milliseconds{250};
+  };
+
+  /// The state of a running job, which the long running functions take an optional pointer to
+  ///
+  /// Hot loops never look at the stop token or the clock. A stop request (or the deadline, via a watchdog
+  /// thread) sets the flags the loops already check to see if another thread has finished, so stopping is
+  /// free until it happens, and then takes effect within a single iteration.
+  class job_control {
+  public:
+    using clock = job_options::clock;
+
+    /// Keeps a flag linked to the job until destroyed
+    class link_guard {
+    public:
+      link_guard() = default;
+      link_guard(link_guard&& other) noexcept : job{std::exchange(other.job, nullptr)}, flag{other.flag} {}
+      link_guard& operator=(link_guard&&) = delete;
+      ~link_guard();
+
+    private:
+      friend job_control;
+
+      job_control* job = nullptr;
+      std::atomic<bool>* flag = nullptr;
+
+      link_guard(job_control* job, std::atomic<bool>* flag) : job{job}, flag{flag} {}
+    };
+
+    explicit job_control(job_options options = {});
+    ~job_control();
+
+    job_control(const job_control&) = delete;
+    job_control& operator=(const job_control&) = delete;
+
+    bool stopped() const { return stop_flag.load(std::memory_order_relaxed); }
+    /// Stops the job, as if its stop token had been triggered
+    void request_stop();
+    /// Throws job_cancelled (or deadline_exceeded) if the job has been stopped
+    void throw_if_stopped() const;
+
+    /// Sets the given flag whenever the job is stopped (including if it already has been), for as long as the guard lives
+    [[nodiscard]] link_guard link(std::atomic<bool>& flag);
+
+    /// Records that some more work was done, calling on_progress if it is due. Thread safe
+    ///
+    /// Hot loops should call this every so often, rather than every iteration
+    void add_progress(uint64_t n);
+    uint64_t progress() const { return done.load(std::memory_order_relaxed); }
+
+  private:
+    struct stopper {
+      job_control* job;
+      void operator()() const { job->request_stop(); }
+    };
+
+    job_options options;
+    const clock::time_point start = clock::now();
+    std::atomic<bool> stop_flag = false;
+    std::atomic<bool> timed_out = false;
+    std::atomic<uint64_t> done = 0;
+
+    std::mutex link_mutex;
+    std::vector<std::atomic<bool>*> links;
+
+    std::mutex progress_mutex;
+    clock::time_point next_report = start;
+
+    std::mutex watchdog_mutex;
+    std::condition_variable watchdog_cv;
+    bool finishing = false;
+    std::thread watchdog;
+
+    // Last, so that it can only fire once everything else exists
+    std::optional<std::stop_callback<stopper>> on_stop;
+  };
+}
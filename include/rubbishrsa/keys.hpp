@@ -2,7 +2,24 @@
 
 #include "rubbishrsa/maths.hpp"
 
+#include <atomic>
+#include <vector>
+
 namespace rubbishrsa {
+  /// The on-disk encodings a key can be written in
+  ///
+  /// Reading always auto-detects the format
+  enum class key_format {
+    json, ///< Our original format, with decimal strings for each number
+    der, ///< PKCS#1 RSAPublicKey/RSAPrivateKey, in binary DER
+    pem ///< PKCS#1 DER wrapped in base64, as produced by `openssl rsa -traditional`
+  };
+
+  namespace detail {
+    // Set by enable_context_cache (see context_cache.hpp)
+    inline std::atomic<bool> context_cache_on = false;
+  }
+
   struct public_key {
     /// The public exponent
     bigint e = 65537; // Recommended numebr due to low hamming weight
@@ -16,32 +33,84 @@ namespace rubbishrsa {
       // in binary modpow
       return bmp::powm(message, e, n);
     }
+    /// Reuses the limbs already held by out, so a loop can encrypt without allocating
+    inline void raw_encrypt(const bigint& message, bigint& out) const {
+      out = bmp::powm(message, e, n);
+    }
     inline bigint raw_verify(const bigint& signature) const {
       // Note that this is the same as the encryption state, as $m^{k\lambda(n) + 1} \equiv m \pmod{n}$
       return bmp::powm(signature, e, n);
     }
+    /// Reuses the limbs already held by out, so a loop can verify without allocating
+    inline void raw_verify(const bigint& signature, bigint& out) const {
+      out = bmp::powm(signature, e, n);
+    }
+
+    /// Checks each signature against the message at the same index, returning which ones are valid
+    ///
+    /// Rather than verifying each one, the whole batch is screened at once by checking that
+    /// (prod s_i^r_i)^e = prod m_i^r_i (mod n), which needs a single exponentiation by e. The r_i are random
+    /// and security_bits (at most 64) long, so that bad signatures cannot cancel each other out. That still lets
+    /// through a signature that is only wrong by an element of small order, and while the only such element
+    /// anyone can find without the factors of n is -1, n - s is exactly that. So when n = 3 (mod 4) each
+    /// signature's Jacobi symbol is checked as well, which tells s^e from -s^e, and otherwise each screen also
+    /// checks security_bits random halves of the batch. Either way, a batch with a bad signature in it only
+    /// passes with probability 2^-security_bits. A batch that fails is split in half, and each half screened
+    /// again, until the bad signatures are found.
+    ///
+    /// Throws std::invalid_argument if the spans differ in length
+    std::vector<bool> verify_batch(std::span<const bigint> messages, std::span<const bigint> signatures,
+                                   unsigned int security_bits = 64) const;
 
     /// Write the key to the given stream
     //
     // This is not vritual, and so the private key can have a different impl safely
-    void serialise(std::ostream&) const;
-    /// Reads the key from the given stream
+    void serialise(std::ostream&, key_format format = key_format::json) const;
+    /// Reads the key from the given stream, in any of the supported formats
+    ///
+    /// A private key may be read as a public key
     static public_key deserialise(std::istream&);
 
     // C++ requires this for inhertiable classes
     virtual ~public_key() = default;
   };
 
+  /// A prime factor of a private key's modulus, and what the CRT needs from it
+  struct crt_prime {
+    bigint prime;
+    /// d mod (prime - 1)
+    bigint exponent;
+    /// The inverse (mod this prime) of the product of the primes that are combined before it
+    ///
+    /// As in PKCS#1, the CRT starts from the second prime and then adds in the first and the rest in order. The
+    /// first prime's coefficient is therefore the inverse of the second, and the second's is 0
+    bigint coefficient;
+  };
+
   // Whilst we could derive the public key each time, that takes ages.
   // Instead, we can just inherit all the members of the public key
   struct private_key : public public_key {
     bigint d; /// The decryption modulus
+    /// The prime factors of n, in PKCS#1 order, or empty if they are not known
+    ///
+    /// With these, raw_decrypt and raw_sign exponentiate once modulo each prime, by its exponent, rather than
+    /// once modulo n by d. With k primes, each of these is k times shorter in both base and exponent, so all k
+    /// of them take about k^2 times less time in total
+    std::vector<crt_prime> primes;
 
     inline bigint raw_decrypt(const bigint& cyphertext) const {
+      if (!primes.empty())
+        return exponentiate_crt(cyphertext);
+      if (detail::context_cache_on.load(std::memory_order_relaxed))
+        return exponentiate_cached(cyphertext);
       // Again, $m^{k\lambda(n) + 1} \equiv m \pmod{n}$
       return bmp::powm(cyphertext, d, n);
     }
     inline bigint raw_sign(const bigint& message) const {
+      if (!primes.empty())
+        return exponentiate_crt(message);
+      if (detail::context_cache_on.load(std::memory_order_relaxed))
+        return exponentiate_cached(message);
       // This is, interestingly, exactly the same as decryption
       // as this is encrypting with the private key, so all people
       // with the public key can decrypt, but only one with the
@@ -50,13 +119,40 @@ namespace rubbishrsa {
     }
 
     /// Write the key to the given stream
-    void serialise(std::ostream&) const;
-    /// Reads the key from the given stream
+    ///
+    /// PKCS#1 needs the factors, so if they are not known, they are recovered from d for the DER and PEM formats.
+    /// That only works for two primes, so a key with more is only written from its stored primes, as a version 1
+    /// (multi-prime) PKCS#1 key. Without them, it throws std::invalid_argument
+    void serialise(std::ostream&, key_format format = key_format::json) const;
+    /// Reads the key from the given stream, in any of the supported formats
+    ///
+    /// Throws std::invalid_argument if the key has primes that do not multiply up to its modulus. The primes are not
+    /// tested for primality, as that would take far longer than the rest of loading
     static private_key deserialise(std::istream&);
 
-    static private_key generate(uint_fast16_t bits);
+    /// Generates a key with a modulus of (about) the given number of bits, made of prime_count primes
+    ///
+    /// All the primes are searched for at once, sharing out the cores between them. More primes make
+    /// generation quicker as well as raw_decrypt and raw_sign, but the smaller primes are easier to find by ECM.
+    /// The usual advice is at most 3 primes for a 2048 bit modulus, 4 for 4096 bits and 5 for 8192 bits.
+    ///
+    /// Throws std::invalid_argument if there are fewer than two primes, or they would be under 16 bits each
+    static private_key generate(uint_fast16_t bits, unsigned int prime_count = 2);
 
     /// Calculates the RSA key from two factors (and an optional exponent)
+    ///
+    /// Throws std::invalid_argument as from_primes does, including if either factor is composite
     static private_key from_factors(const bigint& p, const bigint& q, bigint e = 65537);
+    /// Calculates the RSA key from any number of distinct primes (and an optional exponent)
+    ///
+    /// Throws std::invalid_argument if there are fewer than two primes, any of them is composite, or e is not
+    /// invertible mod lambda(n)
+    static private_key from_primes(std::vector<bigint> primes, bigint e = 65537);
+
+  private:
+    // x^d (mod n) by Garner's recombination of x^d mod each prime
+    bigint exponentiate_crt(const bigint& x) const;
+    // x^d (mod n) with the CRT, using the context from the shared cache
+    bigint exponentiate_cached(const bigint& x) const;
   };
 }
@@ -0,0 +1,112 @@
+//! A single-file store for many keys, that is memory mapped rather than parsed
+
+#pragma once
+
+#include "rubbishrsa/keys.hpp"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace rubbishrsa {
+  /// A read-only, memory mapped collection of keys, indexed by modulus
+  ///
+  /// The file is laid out as a fixed header, a table of entries sorted by fingerprint,
+  /// and then the raw GMP limbs of each key. Nothing is parsed when opening or looking up,
+  /// so lookups are O(log n) and touch only the pages they need.
+  //
+  // The limbs are written in the native limb size and byte order, so a store is only readable
+  // on the same kind of machine that made it. The header records enough to refuse anything else.
+  class keystore {
+  public:
+    using fingerprint_t = uint64_t;
+
+    /// The on-disk header
+    struct header {
+      char magic[8];
+      uint32_t version;
+      uint32_t limb_bytes;
+      uint64_t count;
+      uint64_t index_offset;
+      uint64_t reserved[4];
+    };
+
+    /// An entry in the offset table
+    struct entry {
+      fingerprint_t fingerprint;
+      uint64_t payload_offset;
+      uint32_t n_limbs, e_limbs, d_limbs;
+      uint32_t reserved;
+    };
+
+    /// A zero copy view of a key stored in the keystore
+    ///
+    /// This is only valid as long as the keystore it came from
+    class key_view {
+    public:
+      fingerprint_t fingerprint() const { return ent->fingerprint; }
+      bool is_private() const { return ent->d_limbs != 0; }
+
+      /// Copies the limbs into a public key, without any parsing
+      public_key to_public_key() const;
+      /// Copies the limbs into a private key, throwing std::invalid_argument if this is only a public key
+      private_key to_private_key() const;
+
+      /// Encrypts directly with the mapped limbs, without copying the key
+      bigint raw_encrypt(const bigint& message) const;
+
+    private:
+      friend keystore;
+
+      const entry* ent;
+      const mp_limb_t* limbs;
+
+      key_view(const entry* ent, const mp_limb_t* limbs) : ent{ent}, limbs{limbs} {}
+    };
+
+    /// Collects keys in memory, and writes them out as a keystore
+    class builder {
+    public:
+      void add(const public_key& key);
+      void add(const private_key& key);
+      /// Reads a key file in any supported format, adding it as a private key if it has a private exponent
+      ///
+      /// @returns the fingerprint of the key
+      fingerprint_t add_serialised(std::istream& in);
+
+      size_t size() const { return keys.size(); }
+
+      /// Writes the keystore, dropping duplicate moduli (preferring private keys)
+      void write(std::ostream& os) const;
+
+    private:
+      // A zero d marks a public key
+      std::vector<private_key> keys;
+    };
+
+    /// The fingerprint is simply the bottom 64 bits of the modulus, which are as good as random for RSA moduli
+    static fingerprint_t fingerprint(const bigint& n);
+
+    /// Maps the keystore at the given path, throwing std::invalid_argument if it is malformed
+    explicit keystore(const std::string& path);
+
+    size_t size() const { return count; }
+
+    /// Returns the i'th key in fingerprint order
+    key_view operator[](size_t i) const;
+
+    /// Finds the key with the given modulus
+    std::optional<key_view> find(const bigint& n) const;
+    /// Finds all keys with the given fingerprint (almost always zero or one)
+    std::vector<key_view> find(fingerprint_t fingerprint) const;
+
+  private:
+    boost::interprocess::file_mapping file;
+    boost::interprocess::mapped_region region;
+    const entry* entries;
+    size_t count;
+  };
+}
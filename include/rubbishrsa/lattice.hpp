@@ -0,0 +1,36 @@
+//! Lattice basis reduction, and the integer polynomials that Coppersmith's method needs alongside it
+//!
+//! Everything here is exact: the reduction never leaves the integers, and polynomials are kept as their
+//! coefficients, lowest power first.
+
+#pragma once
+
+#include "rubbishrsa/maths.hpp"
+
+#include <span>
+#include <vector>
+
+namespace rubbishrsa {
+  /// Reduces a basis of integer vectors in place with the LLL algorithm, so that the first vector is short
+  ///
+  /// This is the integral version (Cohen, Algorithm 2.6.7), which scales the Gram-Schmidt coefficients by the Gram
+  /// determinants so that they stay integers, and so needs no rationals or floating point. The first vector comes
+  /// out no more than (1 / (delta - 1/4))^((d - 1) / 2) times as long as the shortest in the lattice, though in
+  /// practice it is far closer than that.
+  ///
+  /// Throws std::invalid_argument if the vectors are not all the same length, are not linearly independent, or
+  /// delta (given as a fraction) is not in (1/4, 1]
+  void lll_reduce(std::vector<std::vector<bigint>>& basis, unsigned int delta_numerator = 99,
+                  unsigned int delta_denominator = 100);
+
+  /// The value of the polynomial at x
+  bigint evaluate_polynomial(std::span<const bigint> polynomial, const bigint& x);
+
+  /// Every integer root of the polynomial between min and max (inclusive), in order
+  ///
+  /// The polynomial is split into pieces where it is monotonic, by finding where its derivative changes sign (and
+  /// so on down), and each piece is bisected. Only integers are ever looked at, so two turning points that fall
+  /// between the same pair of integers could hide a root, but that needs a root within 1 of a repeated one.
+  /// The zero polynomial has no roots, as far as this is concerned
+  std::vector<bigint> integer_roots(std::span<const bigint> polynomial, const bigint& min, const bigint& max);
+}
@@ -1,20 +1,34 @@
 //! A simple system to toggle logging
+#pragma once
+
+#include <atomic>
 #include <iostream>
 
-// The idea is to have code that is only compiled and executed when logging is enabled
+// The idea is to have code that is only executed when logging is enabled
 //
-// This means that when it is disabled, there is no overhead, but when it is enabled,
-// I can be as verbose and slow as I like.
+// The verbosity is chosen at runtime, so the only overhead when it is off is a single relaxed load.
+// RUBBISHRSA_MAX_VERBOSITY can still be used to compile levels out entirely.
+
+#ifndef RUBBISHRSA_MAX_VERBOSITY
+#define RUBBISHRSA_MAX_VERBOSITY 2
+#endif
+
+namespace rubbishrsa::log {
+  /// 0 is silent, 1 is info, and 2 is trace. Libraries should stay quiet, so this defaults to 0
+  inline std::atomic<int> verbosity = 0;
+
+  inline bool enabled(int level) { return verbosity.load(std::memory_order_relaxed) >= level; }
+}
 
-#if RUBBISHRSA_VERBOSITY >= 2
-#define RUBBISHRSA_LOG_TRACE(...) __VA_ARGS__
+#if RUBBISHRSA_MAX_VERBOSITY >= 2
+#define RUBBISHRSA_LOG_TRACE(...) do { if (::rubbishrsa::log::enabled(2)) { __VA_ARGS__; } } while (false)
 #else
-#define RUBBISHRSA_LOG_TRACE(...)
+#define RUBBISHRSA_LOG_TRACE(...) do {} while (false)
 #endif
 
 
-#if RUBBISHRSA_VERBOSITY >= 1
-#define RUBBISHRSA_LOG_INFO(...) __VA_ARGS__
+#if RUBBISHRSA_MAX_VERBOSITY >= 1
+#define RUBBISHRSA_LOG_INFO(...) do { if (::rubbishrsa::log::enabled(1)) { __VA_ARGS__; } } while (false)
 #else
-#define RUBBISHRSA_LOG_INFO(...)
+#define RUBBISHRSA_LOG_INFO(...) do {} while (false)
 #endif
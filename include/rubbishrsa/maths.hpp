@@ -2,13 +2,28 @@
 
 //! All the number theory goes in here
 
+// So that building with RUBBISHRSA_GMP_ARENA covers everything that uses a bigint
+#include "rubbishrsa/arena.hpp"
+
 #include <boost/multiprecision/gmp.hpp>
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <span>
+#include <string_view>
+#include <vector>
+
 namespace rubbishrsa {
   // Saves me a lot of typing
   namespace bmp = boost::multiprecision;
   using bigint = bmp::mpz_int;
 
+  class checkpoint;
+  class job_control;
+
   // Extended Euclid's algorithm is the name of this algorithm (I think)
   struct egcd_result { bigint gcd; std::pair<bigint, bigint> coefficients; };
   egcd_result egcd(const bigint& a, const bigint& b);
@@ -22,7 +37,84 @@ namespace rubbishrsa {
   // Apparently "strong primes" are better, but computing these is much harder, and RSA say they are unnecceary
   //
   // Because RSA (company) can be trusted. Yes.
-  bigint generate_prime(uint_fast16_t bits);
+  ///
+  /// @param thread_count: The number of threads to search with, or 0 for one per core
+  /// @param job: If given, lets the search be cancelled (throwing job_cancelled) and report the candidates tried
+  bigint generate_prime(uint_fast16_t bits, unsigned int thread_count = 0, job_control* job = nullptr);
+
+  /// The highest number the sieve functions below will go up to
+  constexpr uint64_t sieve_limit = uint64_t{1} << 40;
+
+  /// All the primes up to and including bound, in order
+  ///
+  /// These come from a table shared by the whole process, which is built the first time it is needed and grown
+  /// whenever a bigger bound is asked for. The spans stay valid forever, even after the table grows
+  std::span<const uint32_t> small_primes(uint32_t bound = 1 << 16);
+
+  /// A segmented Sieve of Eratosthenes over [begin, end), read one prime at a time
+  ///
+  /// Only odd numbers are kept, one bit each, and a segment at a time is sieved, sized to fit in the L1 cache.
+  /// This makes it a single pass input range, so each prime can be read only once:
+  ///
+  ///     for (auto p : prime_sieve{1000, 2000}) ...
+  ///
+  /// Throws std::invalid_argument if end is past sieve_limit
+  class prime_sieve {
+  public:
+    class iterator {
+    public:
+      using value_type = uint64_t;
+      using difference_type = std::ptrdiff_t;
+
+      uint64_t operator*() const { return sieve->current; }
+      iterator& operator++() { sieve->advance(); return *this; }
+      void operator++(int) { sieve->advance(); }
+      bool operator==(std::default_sentinel_t) const { return sieve->finished; }
+
+    private:
+      friend prime_sieve;
+
+      prime_sieve* sieve;
+
+      explicit iterator(prime_sieve* sieve) : sieve{sieve} {}
+    };
+
+    prime_sieve(uint64_t begin, uint64_t end);
+
+    iterator begin() { return iterator{this}; }
+    std::default_sentinel_t end() const { return {}; }
+
+    /// Counts the primes that have not been read yet, using up the sieve
+    uint64_t count();
+
+  private:
+    // The segment holds the odd numbers from segment_start, one per bit, with a set bit meaning composite
+    std::vector<uint64_t> segment;
+    uint64_t segment_start, segment_bits = 0, end_;
+    // The odd primes that we sieve with, and the bit (in the next segment) of the next multiple of each
+    std::span<const uint32_t> base_primes;
+    std::vector<uint64_t> next_multiple;
+    // Our place in the segment, as the unread primes in the current word
+    size_t word_i = 0;
+    uint64_t word = 0;
+    uint64_t current = 0;
+    // 2 is the only even prime, so it is handed out specially before the first segment
+    bool two_pending;
+    bool finished = false;
+
+    bool sieve_segment();
+    void advance();
+  };
+
+  /// Calls func with every prime in [begin, end), sieving chunks of the range on separate threads
+  ///
+  /// Each call is given the primes of one chunk in order, but the chunks come in any order, from any thread
+  ///
+  /// @param thread_count: The number of threads to sieve with, or 0 for one per core
+  void for_each_prime(uint64_t begin, uint64_t end, const std::function<void(std::span<const uint64_t>)>& func,
+                      unsigned int thread_count = 0);
+  /// The number of primes in [begin, end), which is quicker than listing them
+  uint64_t count_primes(uint64_t begin, uint64_t end, unsigned int thread_count = 0);
 
   /// Calculate the lowest common multiple of two numbers
   bigint lcm(const bigint& a, const bigint& b);
@@ -38,26 +130,117 @@ namespace rubbishrsa {
   /// Computes a^(-1) mod n
   bigint modinv(const bigint& a, const bigint& n);
 
-  /// An implementation of Pollard's rho algorithm
+  struct batch_modinv_result {
+    /// The inverse of each value (mod n), or 0 for those that have none
+    std::vector<bigint> inverses;
+    /// The indices of the values that share a factor with n, in order
+    std::vector<size_t> non_invertible;
+  };
+  /// Computes a^(-1) mod n for every a in values at once
+  ///
+  /// This is Montgomery's trick: the inverse of the product of all the values is found, and then the inverse of
+  /// each one is peeled off with multiplications, so k values cost a single inversion and 3(k - 1) multiplications.
+  /// Values that cannot be inverted are reported, rather than failing the rest of the batch.
   ///
-  /// @param a: the x^0 term of the polynomial
-  bigint pollard_rho(const bigint& n);
+  /// @param thread_count: Very large batches are split between this many threads (0 for one per core), which
+  ///                      each take the product of their own share
+  batch_modinv_result batch_modinv(std::span<const bigint> values, const bigint& n, unsigned int thread_count = 0);
+
+  /// The integer k'th root of x, rounded down, found with Newton's method
+  ///
+  /// Throws std::invalid_argument if x is negative or k is 0
+  bigint iroot(const bigint& x, unsigned long k);
+
+  /// The Chinese remainder theorem: finds the x below the product of the moduli with x = residues[i] (mod moduli[i])
+  ///
+  /// The pairs are combined up a product tree, so most of the work is done on numbers of about the same size.
+  /// Throws std::invalid_argument if the moduli are not pairwise coprime, or the spans differ in length
+  bigint crt(std::span<const bigint> residues, std::span<const bigint> moduli);
+
+  /// The product of bases[i]^exponents[i] (mod n), for many bases with short exponents
+  ///
+  /// This is Pippenger's bucket method: each window of exponent bits sorts the bases into buckets by their digit,
+  /// and all of the bases share the same squarings, so each base costs a multiplication per window rather than
+  /// one for every bit. Throws std::invalid_argument if the spans differ in length
+  bigint multi_powm(std::span<const bigint> bases, std::span<const uint64_t> exponents, const bigint& n);
+
+  /// Pollard's rho algorithm, as independent walks raced against each other
+  ///
+  /// This is not parallel collision search: the walks cannot share distinguished points the way they do for
+  /// discrete logs, as a walk only collides modulo the unknown p, and so nothing about its values mod n says where
+  /// it has been. Racing t independent walks (each with its own polynomial) at best finds a factor about sqrt(t)
+  /// times sooner than one walk
+  ///
+  /// @param thread_count: The number of walks to run in parallel (each with a different polynomial), or 0 for one per core
+  /// @param ckpt: If given, the x and y of each walk (and how often it has restarted) are saved here, and resumed
+  ///             from if loaded
+  /// @param job: If given, lets the walks be cancelled (throwing job_cancelled) and report the steps taken
+  /// @returns a factor of n other than 1 and n, or n itself if it is prime (or below 4). A walk that cycles
+  ///          without finding one is started again with a polynomial that no other walk has used
+  bigint pollard_rho(const bigint& n, unsigned int thread_count = 0, checkpoint* ckpt = nullptr, job_control* job = nullptr);
+
+  /// The starting point of pollard_rho's i'th walk, which is a different prime for every walk
+  bigint pollard_rho_start(size_t walk);
+  /// The c in the polynomial x^2 + c of pollard_rho's i'th walk
+  ///
+  /// Walks that share a polynomial share its cycles (mod p), so they tend to finish at similar steps, and each
+  /// extra walk helps less than an independent one would
+  inline unsigned long pollard_rho_increment(size_t walk) { return static_cast<unsigned long>(walk) + 1; }
+  /// Takes up to `steps` steps of a single Pollard's rho walk, updating x and y in place
+  ///
+  /// This lets walks be split up into pieces, to be run (and resumed) wherever
+  ///
+  /// @param stop: Checked every few dozen steps, so that the walk can be abandoned early
+  /// @param increment: The c in the walk's polynomial, x^2 + c
+  /// @returns the factor of n that was found (which is n itself if the walk cycled without finding one), or 0 if none was
+  bigint pollard_rho_steps(const bigint& n, bigint& x, bigint& y, uint_fast32_t steps, const std::atomic<bool>& stop,
+                           unsigned long increment = 1);
+
+  /// Recovers the two factors of n from a valid exponent pair
+  //
+  // e*d - 1 is a multiple of lambda(n), which lets us find a nontrivial square root of 1 (mod n)
+  std::pair<bigint, bigint> recover_factors(const bigint& n, const bigint& e, const bigint& d);
 
   /// Selects the fastest implemented factorisation algorithm for the given semiprime, and returns the factors
-  std::pair<bigint, bigint> factorise_semiprime(const bigint& semiprime);
+  ///
+  /// If use_factor_db has been called, the database is checked first, and whatever is found is added to it
+  std::pair<bigint, bigint> factorise_semiprime(const bigint& semiprime, checkpoint* ckpt = nullptr, job_control* job = nullptr);
+
+  // Some functions that convert between bytes, ascii, hex and bigint
+  //
+  // These all go straight to and from the limbs (like mpz_import/mpz_export), so they are linear in the length.
+  // Bytes are always big endian, so the first character of a string is the most significant byte.
+
+  /// The number of bytes needed to hold the number (zero for zero)
+  size_t byte_length(const bigint& i);
+
+  bigint bytes2bigint(std::span<const std::byte> bytes);
+  /// Reuses the limbs already held by out, so does not allocate if it is big enough
+  void bytes2bigint(std::span<const std::byte> bytes, bigint& out);
+  std::vector<std::byte> bigint2bytes(const bigint& i);
+  /// Writes the byte_length(i) bytes of i to the start of out, and returns how many were written
+  ///
+  /// Throws std::length_error if out is too small
+  size_t bigint2bytes(const bigint& i, std::span<std::byte> out);
+  /// Writes i to fill all of out, padding with leading zeros
+  ///
+  /// Throws std::length_error if out is too small
+  void bigint2bytes_padded(const bigint& i, std::span<std::byte> out);
 
-  // Some functions that convert between ascii and bigint
   bigint ascii2bigint(std::string_view str);
+  void ascii2bigint(std::string_view str, bigint& out);
+  /// Reads the rest of the stream
   bigint ascii2bigint(std::istream& str);
-  std::string bigint2ascii(bigint str);
+  std::string bigint2ascii(const bigint& i);
+  /// The same as bigint2bytes, but for chars
+  size_t bigint2ascii(const bigint& i, std::span<char> out);
+
+  /// Parses hexadecimal digits (without any 0x prefix), throwing std::invalid_argument on anything else
   bigint hex2bigint(std::string_view hex);
+  void hex2bigint(std::string_view hex, bigint& out);
 
-  inline size_t floor_log2(bigint i) {
-    size_t bits = 0;
-    while (i) {
-      i >>= 1;
-      ++bits;
-    }
-    return bits;
+  /// Returns the number of bits needed to represent the magnitude of i
+  inline size_t floor_log2(const bigint& i) {
+    return i ? mpz_sizeinbase(i.backend().data(), 2) : 0;
   }
 }
@@ -0,0 +1,97 @@
+//! Runtime counters and phase timers, that can be dumped as JSON or as a Chrome trace
+//!
+//! Everything here is off until enable() is called, and costs a single relaxed load when off.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+
+namespace rubbishrsa::metrics {
+  /// The things we count
+  enum class counter : size_t {
+    prime_candidates, ///< Candidates tried by generate_prime
+    miller_rabin_rounds, ///< Rounds of the Miller-Rabin test
+    rho_iterations, ///< Steps of each Pollard's rho walk
+    brute_candidates, ///< Plaintexts tried by brute_force_ptext
+    sig_candidates, ///< Signatures tried by brute_force_sig
+    gmp_allocations, ///< Allocations (and reallocations) made by GMP, once arena::install has been called
+    heap_allocations, ///< The ones that arena could not serve from a pool, and went to the heap
+    context_cache_hits, ///< Private key operations that found their key's context in the shared context cache
+    context_cache_misses, ///< The ones that had to work it out (and add it)
+    factor_db_hits, ///< Moduli that factorise_semiprime or crack_key found in the factor database
+    factor_db_misses, ///< The ones that had to be cracked (and were then added)
+    count_ ///< Not a counter, just the number of them
+  };
+
+  /// The phases we time
+  enum class phase : size_t {
+    prime_generation,
+    prime_test,
+    sieve,
+    factorisation,
+    brute_force,
+    key_io,
+    crt,
+    lattice,
+    count_
+  };
+
+  const char* name(counter);
+  const char* name(phase);
+
+  namespace detail {
+    inline std::atomic<bool> stats_on = false;
+    inline std::atomic<bool> trace_on = false;
+
+    void add(counter c, uint64_t n);
+    void record(phase p, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+  }
+
+  /// Turns on counting and phase timing, and (optionally) recording every timed phase for a trace
+  void enable(bool stats, bool trace = false);
+  /// Zeroes everything, and restarts the clock used for rates
+  void reset();
+
+  inline bool stats_enabled() { return detail::stats_on.load(std::memory_order_relaxed); }
+  inline bool trace_enabled() { return detail::trace_on.load(std::memory_order_relaxed); }
+
+  /// Adds to a counter for this thread
+  ///
+  /// Hot loops should count locally and call this every so often, rather than every iteration
+  inline void add(counter c, uint64_t n = 1) {
+    if (stats_enabled())
+      detail::add(c, n);
+  }
+
+  /// Times the phase from construction to destruction
+  class scoped_timer {
+  public:
+    explicit scoped_timer(phase p) : p{p} {
+      if (stats_enabled() || trace_enabled())
+        start = std::chrono::steady_clock::now();
+    }
+    ~scoped_timer() {
+      if (start != std::chrono::steady_clock::time_point{})
+        detail::record(p, start, std::chrono::steady_clock::now());
+    }
+
+    scoped_timer(const scoped_timer&) = delete;
+    scoped_timer& operator=(const scoped_timer&) = delete;
+
+  private:
+    phase p;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  /// The sum of a counter over every thread, past and present
+  uint64_t total(counter c);
+
+  /// Writes the counters (with rates) and the phase totals as JSON
+  void write_stats_json(std::ostream& os);
+  /// Writes every recorded phase in the Chrome trace event format, for chrome://tracing or Perfetto
+  void write_chrome_trace(std::ostream& os);
+}
@@ -0,0 +1,141 @@
+//! A small ordered worker pool, for streaming many independent operations through the library
+
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace rubbishrsa {
+  /// Runs `work` over every item returned by `read` on a pool of threads, passing the results to `write` in input order
+  ///
+  /// @param read: Returns the next item, or std::nullopt at the end of the input. Only called from the calling thread
+  /// @param work: Turns an item into a result. Called concurrently
+  /// @param write: Consumes the results in the order the items were read. Only ever called from one thread at a time
+  /// @param max_in_flight: The most items that may be read but not yet written, which bounds the memory used.
+  ///                       Defaults to four per thread
+  ///
+  /// If any callback throws, everything is stopped and the first exception is rethrown
+  //
+  // Results are written as soon as every earlier item is done, so output streams out
+  // while input is still being read, rather than after it is all finished.
+  template<typename Read, typename Work, typename Write>
+  void ordered_parallel_map(Read&& read, Work&& work, Write&& write,
+                            unsigned int thread_count = 0, size_t max_in_flight = 0) {
+    using in_t = typename std::invoke_result_t<Read&>::value_type;
+    using out_t = std::invoke_result_t<Work&, in_t&&>;
+
+    if (!thread_count)
+      thread_count = std::thread::hardware_concurrency();
+    if (!max_in_flight)
+      max_in_flight = 4 * thread_count;
+
+    std::mutex mutex;
+    // Everyone waits on the one condition variable, as there is rarely more than one waiter that could progress
+    std::condition_variable cv;
+    // Items waiting to be worked on, tagged with their position in the input
+    std::queue<std::pair<size_t, in_t>> pending;
+    // The reorder buffer: results that are finished, but are waiting for an earlier one
+    std::map<size_t, out_t> finished;
+    size_t n_read = 0, n_written = 0;
+    bool end_of_input = false;
+    std::exception_ptr error;
+
+    auto fail = [&](std::exception_ptr e) {
+      std::unique_lock lock{mutex};
+      if (!error)
+        error = e;
+      cv.notify_all();
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned int i = 0; i < thread_count; ++i) {
+      pool.emplace_back([&]() {
+        while (true) {
+          std::unique_lock lock{mutex};
+          cv.wait(lock, [&]() { return error || pending.size() || end_of_input; });
+          if (error || pending.empty())
+            return;
+          auto [seq, item] = std::move(pending.front());
+          pending.pop();
+          lock.unlock();
+
+          try {
+            auto result = work(std::move(item));
+            lock.lock();
+            finished.emplace(seq, std::move(result));
+            cv.notify_all();
+          }
+          catch (...) {
+            fail(std::current_exception());
+            return;
+          }
+        }
+      });
+    }
+
+    std::thread writer{[&]() {
+      while (true) {
+        std::unique_lock lock{mutex};
+        cv.wait(lock, [&]() {
+          return error || finished.count(n_written) || (end_of_input && n_written == n_read);
+        });
+        if (error || !finished.count(n_written))
+          return;
+        auto node = finished.extract(n_written);
+        lock.unlock();
+
+        try {
+          write(std::move(node.mapped()));
+        }
+        catch (...) {
+          fail(std::current_exception());
+          return;
+        }
+
+        lock.lock();
+        ++n_written;
+        cv.notify_all();
+      }
+    }};
+
+    try {
+      while (true) {
+        {
+          // Wait for there to be room, so a slow writer cannot make us buffer the whole input
+          std::unique_lock lock{mutex};
+          cv.wait(lock, [&]() { return error || n_read - n_written < max_in_flight; });
+          if (error)
+            break;
+        }
+
+        auto item = read();
+
+        std::unique_lock lock{mutex};
+        if (!item) {
+          end_of_input = true;
+          cv.notify_all();
+          break;
+        }
+        pending.emplace(n_read++, std::move(*item));
+        cv.notify_all();
+      }
+    }
+    catch (...) {
+      fail(std::current_exception());
+    }
+
+    for (auto& thread : pool)
+      thread.join();
+    writer.join();
+
+    if (error)
+      std::rethrow_exception(error);
+  }
+}
@@ -0,0 +1,56 @@
+//! A long running server that keeps keys loaded, and answers requests to use them over a Unix socket
+//!
+//! Every message, both ways, is a 4 byte big endian length followed by that many bytes. A request that starts
+//! with '{' is JSON, and is answered in JSON:
+//!
+//!     {"id": 1, "op": "enc", "key": "alice", "data": "<hex>"}
+//!     {"id": 1, "result": "<hex>"}, or {"id": 1, "error": "<message>"}
+//!
+//! Anything else is binary: the op (1 byte, numbered as in `operation`), the id (8 bytes, big endian), the length
+//! of the key name (1 byte), the key name, and then the data as a big endian number. It is answered with the id,
+//! a status byte (0 for success), and then either the result as a big endian number or the error message.
+//!
+//! Requests on a connection are worked on in parallel, so the answers can come back in any order, and are matched
+//! up by their ids.
+
+#pragma once
+
+#include "rubbishrsa/keys.hpp"
+
+#include <cstdint>
+#include <map>
+#include <stop_token>
+#include <string>
+
+namespace rubbishrsa::server {
+  enum class operation : uint8_t {
+    enc = 1, ///< Encrypts the data with the key
+    dec, ///< Decrypts the data with the key, which must be private
+    sign, ///< Signs the data with the key, which must be private
+    verify, ///< Recovers the message from the signature in the data
+    crack, ///< Finds d for the key, or for the modulus in the data if no key is named
+    stats ///< The latency percentiles of each operation so far, as JSON (in bytes, for a binary request)
+  };
+
+  struct options {
+    /// The keys that requests can use, by name
+    std::map<std::string, private_key> private_keys;
+    /// Keys that can only be used to encrypt, verify and crack. Private keys can be used for these too
+    std::map<std::string, public_key> public_keys;
+    /// The number of threads that work on the requests, or 0 for one per core
+    unsigned int thread_count = 0;
+    /// How many requests a connection can have in progress before we stop reading more from it
+    size_t max_in_flight = 64;
+    /// How many cracks can run at once, as each one uses every core. Any more are refused, and 0 refuses them all
+    unsigned int max_cracks = 1;
+    /// Stops (cleanly) on SIGINT and SIGTERM, as well as on the stop token
+    bool stop_on_signals = true;
+  };
+
+  /// Serves requests on the Unix socket at the given path until stopped
+  ///
+  /// A socket already at the path is replaced, and the socket is removed again afterwards. Throws
+  /// std::invalid_argument if there is anything else at the path. Any crack still running when we are stopped is
+  /// cancelled
+  void serve(const std::string& socket_path, const options& opts, std::stop_token stop = {});
+}
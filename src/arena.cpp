@@ -0,0 +1,182 @@
+#include <rubbishrsa/arena.hpp>
+#include <rubbishrsa/metrics.hpp>
+
+#include <gmp.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+namespace rubbishrsa::arena {
+  namespace {
+    // Blocks of 16 bytes up to 8 KiB are pooled, which covers the products of two 4096 bit numbers
+    constexpr size_t min_class_log2 = 4;
+    constexpr size_t n_classes = 10;
+    // Caps what each thread can sit on at a few MiB
+    constexpr unsigned int max_cached = 64;
+    // Marks a block that came straight from the heap, and goes straight back to it
+    constexpr size_t unpooled = n_classes;
+
+    // Every block starts with one of these, which keeps what GMP gets as aligned as malloc would have
+    struct alignas(std::max_align_t) header {
+      size_t size_class;
+    };
+
+    // Freed blocks hold the free list in the space GMP was using
+    struct free_block {
+      free_block* next;
+    };
+
+    // Trivially destructible, so that it can still be used by the destructors of other thread_locals
+    struct thread_pool {
+      std::array<free_block*, n_classes> heads;
+      std::array<unsigned int, n_classes> counts;
+      bool reaper_armed;
+      // Set once the thread has exited, after which nothing more is pooled
+      bool retired;
+    };
+    constinit thread_local thread_pool pool{};
+
+    std::atomic<bool> hooks_installed = false;
+    std::atomic<unsigned int> live_scopes = 0;
+
+    constexpr size_t class_size(size_t size_class) {
+      return size_t{1} << (size_class + min_class_log2);
+    }
+
+    // The smallest class that fits the given size
+    size_t class_of(size_t size) {
+      return std::bit_width((std::max(size, size_t{1}) - 1) >> min_class_log2);
+    }
+
+    bool pooling() {
+      return live_scopes.load(std::memory_order_relaxed) && !pool.retired;
+    }
+
+    void drain() {
+      for (size_t i = 0; i < n_classes; ++i) {
+        while (auto* block = pool.heads[i]) {
+          pool.heads[i] = block->next;
+          std::free(reinterpret_cast<header*>(block) - 1);
+        }
+        pool.counts[i] = 0;
+      }
+    }
+
+    // Empties the pool when the thread exits. Only made once the thread has pooled something
+    struct pool_reaper {
+      ~pool_reaper() {
+        drain();
+        pool.retired = true;
+      }
+    };
+
+    [[noreturn]] void out_of_memory() {
+      // GMP has no way to report this, and its own allocator gives up in the same way
+      std::fputs("GNU MP: Cannot allocate memory\n", stderr);
+      std::abort();
+    }
+
+    void* heap_alloc(size_t bytes, size_t size_class) {
+      metrics::add(metrics::counter::heap_allocations);
+      auto* block = static_cast<header*>(std::malloc(sizeof(header) + bytes));
+      if (!block)
+        out_of_memory();
+      block->size_class = size_class;
+      return block + 1;
+    }
+
+    void* allocate(size_t size) {
+      metrics::add(metrics::counter::gmp_allocations);
+      const auto size_class = class_of(size);
+      if (size_class >= n_classes || !pooling())
+        return heap_alloc(size, unpooled);
+      if (auto* block = pool.heads[size_class]) {
+        pool.heads[size_class] = block->next;
+        --pool.counts[size_class];
+        return block;
+      }
+      return heap_alloc(class_size(size_class), size_class);
+    }
+
+    void deallocate(void* ptr, size_t) {
+      auto* block = static_cast<header*>(ptr) - 1;
+      const auto size_class = block->size_class;
+      if (size_class == unpooled || !pooling() || pool.counts[size_class] == max_cached) {
+        std::free(block);
+        return;
+      }
+      if (!pool.reaper_armed) {
+        thread_local pool_reaper reaper;
+        pool.reaper_armed = true;
+      }
+      auto* freed = static_cast<free_block*>(ptr);
+      freed->next = pool.heads[size_class];
+      pool.heads[size_class] = freed;
+      ++pool.counts[size_class];
+    }
+
+    void* reallocate(void* ptr, size_t old_size, size_t new_size) {
+      auto* block = static_cast<header*>(ptr) - 1;
+      if (block->size_class == unpooled) {
+        if (!pooling() || class_of(new_size) >= n_classes) {
+          // Pooling would not help, so let the heap grow it in place if it can
+          metrics::add(metrics::counter::gmp_allocations);
+          metrics::add(metrics::counter::heap_allocations);
+          auto* grown = static_cast<header*>(std::realloc(block, sizeof(header) + new_size));
+          if (!grown)
+            out_of_memory();
+          return grown + 1;
+        }
+      }
+      // Class sizes are powers of two, so there is often room to grow in place
+      else if (new_size <= class_size(block->size_class))
+        return ptr;
+
+      auto* moved = allocate(new_size);
+      std::memcpy(moved, ptr, std::min(old_size, new_size));
+      deallocate(ptr, old_size);
+      return moved;
+    }
+  }
+
+  void install() {
+    static std::once_flag once;
+    std::call_once(once, []() {
+      mp_set_memory_functions(&allocate, &reallocate, &deallocate);
+      hooks_installed = true;
+    });
+  }
+
+  bool installed() {
+    return hooks_installed;
+  }
+
+  scope::scope() {
+    live_scopes.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  scope::~scope() {
+    if (live_scopes.fetch_sub(1, std::memory_order_relaxed) == 1)
+      trim();
+  }
+
+  void trim() {
+    drain();
+  }
+
+#ifdef RUBBISHRSA_GMP_ARENA
+  namespace detail {
+    whole_program_arena::whole_program_arena() {
+      install();
+      live_scopes.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+#endif
+}
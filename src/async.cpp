@@ -0,0 +1,69 @@
+#include <rubbishrsa/async.hpp>
+
+#include <rubbishrsa/attack.hpp>
+
+namespace rubbishrsa::async {
+  namespace {
+    // Runs func on a new thread with a job made from the options, keeping everything it needs alive until it is done
+    template<typename Func>
+    auto launch(job_options options, Func func) {
+      return std::async(std::launch::async, [options = std::move(options), func = std::move(func)]() mutable {
+        job_control job{std::move(options)};
+        return func(job);
+      });
+    }
+  }
+
+  std::future<bigint> generate_prime(uint_fast16_t bits, job_options options, unsigned int thread_count) {
+    return launch(std::move(options), [=](job_control& job) {
+      return rubbishrsa::generate_prime(bits, thread_count, &job);
+    });
+  }
+
+  std::future<std::pair<bigint, bigint>> factorise_semiprime(bigint semiprime, job_options options) {
+    return launch(std::move(options), [semiprime = std::move(semiprime)](job_control& job) {
+      return rubbishrsa::factorise_semiprime(semiprime, nullptr, &job);
+    });
+  }
+
+  std::future<private_key> crack_key(public_key pubkey, job_options options) {
+    return launch(std::move(options), [pubkey = std::move(pubkey)](job_control& job) {
+      return attack::crack_key(pubkey, nullptr, &job);
+    });
+  }
+
+  std::future<std::optional<bigint>> brute_force_ptext(public_key pubkey, bigint encrypted_message, bigint min, bigint max,
+                                                       job_options options, unsigned int thread_count) {
+    return launch(std::move(options), [=](job_control& job) {
+      return attack::brute_force_ptext(pubkey, encrypted_message, min, max, thread_count, nullptr, &job);
+    });
+  }
+
+  std::future<std::optional<bigint>> brute_force_ptext(public_key pubkey, bigint encrypted_message, attack::mask_generator mask,
+                                                       job_options options, unsigned int thread_count) {
+    return launch(std::move(options), [=, mask = std::move(mask)](job_control& job) {
+      return attack::brute_force_ptext(pubkey, encrypted_message, mask, thread_count, &job);
+    });
+  }
+
+  std::future<std::optional<bigint>> brute_force_ptext(public_key pubkey, bigint encrypted_message,
+                                                       std::vector<std::string> words, std::vector<attack::mangle_rule> rules,
+                                                       job_options options, unsigned int thread_count) {
+    return launch(std::move(options), [=, words = std::move(words), rules = std::move(rules)](job_control& job) {
+      return attack::brute_force_ptext(pubkey, encrypted_message, words, rules, thread_count, &job);
+    });
+  }
+
+  std::future<std::optional<bigint>> brute_force_sig(public_key pubkey, std::function<bool(const bigint&)> check_result,
+                                                     job_options options) {
+    return launch(std::move(options), [pubkey = std::move(pubkey), check_result = std::move(check_result)](job_control& job) {
+      return attack::brute_force_sig(pubkey, check_result, nullptr, &job);
+    });
+  }
+
+  std::future<std::optional<bigint>> brute_force_sig_invis(public_key pubkey, bigint msg, job_options options) {
+    return launch(std::move(options), [pubkey = std::move(pubkey), msg = std::move(msg)](job_control& job) {
+      return attack::brute_force_sig_invis(pubkey, msg, nullptr, &job);
+    });
+  }
+}
@@ -1,7 +1,13 @@
 #include <rubbishrsa/attack.hpp>
+#include <rubbishrsa/factordb.hpp>
+#include <rubbishrsa/lattice.hpp>
 #include <rubbishrsa/log.hpp>
+#include <rubbishrsa/metrics.hpp>
 
+#include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <limits>
 #include <mutex>
 #include <numeric>
 #include <thread>
@@ -9,10 +15,13 @@
 namespace rubbishrsa::attack {
   std::optional<bigint> brute_force_ptext(const public_key& pubkey, const bigint& encrypted_message,
                                           const std::function<std::optional<bigint>(unsigned int)> get_next_candidate,
-                                          unsigned int thread_count) {
+                                          unsigned int thread_count, job_control* job) {
+    metrics::scoped_timer timer{metrics::phase::brute_force};
     std::vector<std::thread> pool;
     // Whilst this is technically covered by the optional, it would be faster to just access this
     std::atomic<bool> found = false;
+    // Stopping the job just looks like someone else finished
+    auto link = job ? job->link(found) : job_control::link_guard{};
     std::optional<bigint> result;
 
     auto count = thread_count ? thread_count : std::thread::hardware_concurrency();
@@ -20,54 +29,102 @@ namespace rubbishrsa::attack {
     for (unsigned int i = 0; i < count; ++i) {
       pool.emplace_back([&, i]() {
         decltype(result) res;
-        while (!found && (res = get_next_candidate(i)))
-          if (pubkey.raw_encrypt(*res) == encrypted_message && !found.exchange(true))
+        // Reused for every candidate, so that only the first one allocates
+        bigint encrypted;
+        // Only report every so often, so the counter stays out of the hot loop
+        uint_fast32_t unreported = 0;
+        while (!found && (res = get_next_candidate(i))) {
+          pubkey.raw_encrypt(*res, encrypted);
+          if (encrypted == encrypted_message && !found.exchange(true))
             result = res;
+          if (++unreported == 1024) {
+            metrics::add(metrics::counter::brute_candidates, unreported);
+            if (job)
+              job->add_progress(unreported);
+            unreported = 0;
+          }
+        }
+        metrics::add(metrics::counter::brute_candidates, unreported);
+        if (job)
+          job->add_progress(unreported);
       });
     }
 
     for (auto& thread : pool)
       thread.join();
 
+    if (!result && job)
+      job->throw_if_stopped();
+
     return result;
   }
 
   std::optional<bigint> brute_force_ptext(const public_key& pubkey, const bigint& encrypted_message,
-                                          std::istream& in, char delim, bool convert_hex_to_num) {
+                                          std::istream& in, char delim, bool convert_hex_to_num, checkpoint* ckpt,
+                                          job_control* job) {
+    const auto count = std::thread::hardware_concurrency();
     // Unfortunately, this is inherently sequential, so we have to mutex the whole thing
     std::mutex mutex;
-    if (convert_hex_to_num) {
-      return brute_force_ptext(pubkey, encrypted_message, [&](auto) -> std::optional<bigint> {
-        std::string line;
-        bool is_end;
-        // Wait our turn
-        {
-          std::unique_lock lock{mutex};
-          is_end = std::getline(in, line, delim).eof();
-        }
-        return is_end ? std::nullopt : std::optional<bigint>{hex2bigint(line)};
-      });
+
+    // Lines are handed out in order, so everything before the line that the slowest thread is on has been checked
+    constexpr auto idle = std::numeric_limits<std::streamoff>::max();
+    std::vector<std::streamoff> current(count, idle);
+    uint_fast32_t since_checkpoint = 0;
+    if (ckpt) {
+      if (auto offset = ckpt->get_uint("list.offset"))
+        in.seekg(static_cast<std::streamoff>(*offset));
     }
-    else {
-      return brute_force_ptext(pubkey, encrypted_message, [&](auto) -> std::optional<bigint> {
-        std::string line;
-        bool is_end;
-        // Wait our turn
-        {
-          std::unique_lock lock{mutex};
-          is_end = std::getline(in, line, delim).eof();
+
+    return brute_force_ptext(pubkey, encrypted_message, [&](unsigned int i) -> std::optional<bigint> {
+      std::string line;
+      bool is_end;
+      // Wait our turn
+      {
+        std::unique_lock lock{mutex};
+        if (ckpt) {
+          auto pos = in.tellg();
+          current[i] = pos == -1 ? idle : static_cast<std::streamoff>(pos);
+          if (++since_checkpoint == 1024) {
+            since_checkpoint = 0;
+            if (auto earliest = *std::min_element(current.begin(), current.end()); earliest != idle) {
+              ckpt->set("list.offset", static_cast<unsigned long long>(earliest));
+              ckpt->maybe_save();
+            }
+          }
         }
-        return is_end ? std::nullopt : std::optional<bigint>{ascii2bigint(line)};
-      });
-    }
+        is_end = std::getline(in, line, delim).eof();
+      }
+      if (is_end)
+        return std::nullopt;
+      return convert_hex_to_num ? hex2bigint(line) : ascii2bigint(line);
+    }, count, job);
   }
 
   std::optional<bigint> brute_force_ptext(const public_key& pubkey, const bigint& encrypted_message,
-                                          const bigint& min, const bigint& max) {
-    const auto count = std::thread::hardware_concurrency();
+                                          const bigint& min, const bigint& max, unsigned int thread_count,
+                                          checkpoint* ckpt, job_control* job) {
+    auto count = thread_count ? thread_count : std::thread::hardware_concurrency();
+    if (ckpt) {
+      // The threads interleave, so the cursors only make sense with the same number of them
+      if (auto saved = ckpt->get_uint("range.threads"))
+        count = static_cast<unsigned int>(*saved);
+      else
+        ckpt->set("range.threads", count);
+    }
+
     std::vector<bigint> results(count);
     // Fill the vector with min, min + 1, min + 2, ..., count - 1, count
     std::iota(results.begin(), results.end(), min);
+    std::vector<std::string> keys;
+    std::vector<uint_fast32_t> since_checkpoint(count);
+    if (ckpt) {
+      for (unsigned int i = 0; i < count; ++i) {
+        keys.push_back("range.cursor." + std::to_string(i));
+        if (auto saved = ckpt->get_bigint(keys.back()))
+          results[i] = std::move(*saved);
+      }
+    }
+
     return brute_force_ptext(pubkey, encrypted_message, [&](unsigned int i) -> std::optional<bigint> {
       auto candidate = results[i];
       results[i] += count;
@@ -75,19 +132,337 @@ namespace rubbishrsa::attack {
       RUBBISHRSA_LOG_INFO(auto x = floor_log2(candidate); if (x && x % 8 == 0 && (bigint{1} << (x - 1)) == candidate)
                                std::cerr << "Brute forcing with length " << x/8 << " byte(s)" << std::endl);
 
+      // The candidate has not been checked yet, so it is where we resume from
+      if (ckpt && ++since_checkpoint[i] == 1024) {
+        since_checkpoint[i] = 0;
+        ckpt->set(keys[i], candidate);
+        ckpt->maybe_save();
+      }
+
       if (candidate > max)
         return std::nullopt;
       else
         return candidate;
-    }, count);
+    }, count, job);
+  }
+
+  std::optional<private_key> wiener(const public_key& pubkey) {
+    metrics::scoped_timer timer{metrics::phase::factorisation};
+    const auto& n = pubkey.n;
+    const auto& e = pubkey.e;
+    if (e <= 0 || n <= e)
+      return std::nullopt;
+
+    // If d is small enough, then K/d (where ed = 1 + K*lambda(n)) is one of the convergents h/k of e/n.
+    //
+    // Our d is only defined mod lambda(n), which is phi(n)/g for g = gcd(p - 1, q - 1), so k may be d times
+    // some factor of g. Either way, floor(e*k/h) works out as exactly phi(n), which is n - (p + q) + 1, and
+    // p and q are then the roots of x^2 - (p + q)x + n. This means each convergent only costs a few products
+    //
+    // Wiener's bound is d < n^(1/4) / 3, and the slack covers the factor of g
+    const auto max_bits = floor_log2(n) / 4 + 32;
+
+    // The terms of the continued fraction come from Euclid's algorithm on e and n, and the convergents from those
+    bigint num = e, den = n, term, rem;
+    bigint h, h_1 = 1, h_2 = 0;
+    bigint k, k_1 = 0, k_2 = 1;
+    bigint sum, discriminant, root;
+    while (den != 0) {
+      term = num / den;
+      rem = num % den;
+      num.swap(den);
+      den.swap(rem);
+
+      h = term * h_1 + h_2;
+      k = term * k_1 + k_2;
+      h_2.swap(h_1); h_1 = h;
+      k_2.swap(k_1); k_1 = k;
+
+      if (floor_log2(k) > max_bits)
+        break;
+      if (h == 0)
+        continue;
+
+      // p + q = n - phi(n) + 1
+      sum = n + 1;
+      sum -= e * k / h;
+      discriminant = sum * sum;
+      discriminant -= 4 * n;
+      if (discriminant < 0 || !mpz_perfect_square_p(discriminant.backend().data()))
+        continue;
+      root = bmp::sqrt(discriminant);
+      bigint p = (sum + root) / 2, q = (sum - root) / 2;
+      if (q > 1 && p * q == n)
+        return private_key::from_factors(p, q, e);
+    }
+    return std::nullopt;
   }
 
 //   A bad quadratic sieve implementation
-  private_key crack_key(const public_key& pubkey) {
-    auto factors = factorise_semiprime(pubkey.n);
+  namespace {
+    // Everything crack_key tries before it has to factorise
+    std::optional<private_key> crack_shortcuts(const public_key& pubkey, factor_db* db, crack_method method) {
+      if (db) {
+        if (auto known = db->find(pubkey.n)) {
+          RUBBISHRSA_LOG_INFO(std::cerr << "Found the modulus in the factor database" << std::endl);
+          metrics::add(metrics::counter::factor_db_hits);
+          return private_key::from_factors(known->first, known->second, pubkey.e);
+        }
+      }
+
+      if (method == crack_method::factor)
+        return std::nullopt;
+
+      // A small d gives the game away straight away, however big the key is
+      if (auto key = wiener(pubkey)) {
+        // wiener builds the key from the factors, so they are already to hand
+        if (db)
+          remember_factors(*db, pubkey.n, key->primes[0].prime, key->primes[1].prime);
+        return key;
+      }
+      if (method == crack_method::wiener)
+        throw std::invalid_argument("d is too big for Wiener's attack!");
+      RUBBISHRSA_LOG_INFO(std::cerr << "d is too big for Wiener's attack, so factorising instead" << std::endl);
+      return std::nullopt;
+    }
+  }
+
+  private_key crack_key(const public_key& pubkey, checkpoint* ckpt, job_control* job, crack_method method) {
+    if (auto key = crack_shortcuts(pubkey, active_factor_db().get(), method))
+      return std::move(*key);
+
+    // This looks in the database again, but that costs nothing next to factorising, and it counts the miss
+    auto factors = factorise_semiprime(pubkey.n, ckpt, job);
     return private_key::from_factors(factors.first, factors.second, pubkey.e);
   }
 
+  private_key crack_key(const public_key& pubkey, crack_method method,
+                        const std::function<bigint(const bigint&)>& find_factor) {
+    auto db = active_factor_db();
+    if (auto key = crack_shortcuts(pubkey, db.get(), method))
+      return std::move(*key);
+
+    if (db)
+      metrics::add(metrics::counter::factor_db_misses);
+    auto p = find_factor(pubkey.n);
+    auto q = pubkey.n / p;
+    if (db)
+      remember_factors(*db, pubkey.n, p, q);
+    return private_key::from_factors(p, q, pubkey.e);
+  }
+
+  std::optional<bigint> small_message_root(const public_key& pubkey, const bigint& encrypted_message) {
+    if (pubkey.e <= 0 || pubkey.e > std::numeric_limits<unsigned long>::max() || encrypted_message < 0)
+      return std::nullopt;
+    const auto e = pubkey.e.convert_to<unsigned long>();
+    auto root = iroot(encrypted_message, e);
+    if (bmp::pow(root, e) != encrypted_message)
+      return std::nullopt;
+    return root;
+  }
+
+  std::optional<bigint> common_modulus(const public_key& key_1, const bigint& encrypted_1,
+                                       const public_key& key_2, const bigint& encrypted_2) {
+    if (key_1.n != key_2.n || key_1.e <= 0 || key_2.e <= 0)
+      return std::nullopt;
+    auto [gcd, coefficients] = egcd(key_1.e, key_2.e);
+    if (gcd != 1)
+      return std::nullopt;
+
+    const auto& n = key_1.n;
+    // One of the coefficients is negative, which means using the inverse of that cyphertext
+    auto raise = [&](const bigint& c, const bigint& a) -> bigint {
+      if (a >= 0)
+        return bmp::powm(c, a, n);
+      return bmp::powm(modinv(c, n), -a, n);
+    };
+    bigint m;
+    try {
+      m = raise(encrypted_1, coefficients.first) * raise(encrypted_2, coefficients.second) % n;
+    }
+    catch (const std::invalid_argument&) {
+      // A cyphertext that shares a factor with n has no inverse
+      return std::nullopt;
+    }
+    // Only right if the two were encryptions of the same message
+    if (key_1.raw_encrypt(m) != encrypted_1)
+      return std::nullopt;
+    return m;
+  }
+
+  std::optional<bigint> hastad_broadcast(std::span<const public_key> keys, std::span<const bigint> encrypted_messages) {
+    if (keys.size() != encrypted_messages.size())
+      throw std::invalid_argument("Each key needs a cyphertext!");
+    if (keys.empty() || keys[0].e <= 0 || keys.size() < keys[0].e)
+      throw std::invalid_argument("Hastad's broadcast attack needs at least e keys!");
+    const auto e = keys[0].e.convert_to<unsigned long>();
+    std::vector<bigint> moduli;
+    for (size_t i = 0; i < e; ++i) {
+      if (keys[i].e != keys[0].e)
+        throw std::invalid_argument("Hastad's broadcast attack needs every key to have the same e!");
+      moduli.push_back(keys[i].n);
+    }
+
+    bigint combined;
+    try {
+      combined = crt(encrypted_messages.first(e), moduli);
+    }
+    catch (const std::invalid_argument&) {
+      // The moduli share a factor, so this will not work (but that is a far bigger problem for whoever made them)
+      return std::nullopt;
+    }
+    auto root = iroot(combined, e);
+    if (bmp::pow(root, e) != combined)
+      return std::nullopt;
+    return root;
+  }
+
+  std::optional<bigint> shortcut_ptext(std::span<const public_key> keys, std::span<const bigint> encrypted_messages) {
+    metrics::scoped_timer timer{metrics::phase::brute_force};
+    if (keys.size() != encrypted_messages.size())
+      throw std::invalid_argument("Each key needs a cyphertext!");
+
+    for (size_t i = 0; i < keys.size(); ++i)
+      if (auto m = small_message_root(keys[i], encrypted_messages[i]))
+        return m;
+
+    for (size_t i = 0; i < keys.size(); ++i)
+      for (size_t j = i + 1; j < keys.size(); ++j)
+        if (auto m = common_modulus(keys[i], encrypted_messages[i], keys[j], encrypted_messages[j]))
+          return m;
+
+    // Gather up the keys with each e, leaving out repeated moduli, and try any group that is big enough
+    std::vector<bool> used(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (used[i])
+        continue;
+      std::vector<public_key> group;
+      std::vector<bigint> group_messages;
+      for (size_t j = i; j < keys.size(); ++j) {
+        if (keys[j].e != keys[i].e)
+          continue;
+        used[j] = true;
+        if (std::none_of(group.begin(), group.end(), [&](const auto& key) { return key.n == keys[j].n; })) {
+          group.push_back(keys[j]);
+          group_messages.push_back(encrypted_messages[j]);
+        }
+      }
+      if (keys[i].e > 0 && group.size() >= keys[i].e)
+        if (auto m = hastad_broadcast(group, group_messages))
+          return m;
+    }
+
+    return std::nullopt;
+  }
+
+  namespace {
+    using polynomial = std::vector<bigint>;
+
+    polynomial multiply(const polynomial& a, const polynomial& b) {
+      polynomial ret(a.size() + b.size() - 1);
+      for (size_t i = 0; i < a.size(); ++i)
+        for (size_t j = 0; j < b.size(); ++j)
+          ret[i + j] += a[i] * b[j];
+      return ret;
+    }
+
+    // LLL's time grows so quickly with the dimension that it takes minutes past this, even on small keys
+    constexpr size_t max_lattice_dimension = 12;
+  }
+
+  std::optional<bigint> stereotyped_ptext(const public_key& pubkey, const bigint& encrypted_message,
+                                          const bigint& known_prefix, unsigned int unknown_bits) {
+    metrics::scoped_timer timer{metrics::phase::lattice};
+    const auto& n = pubkey.n;
+    const auto n_bits = floor_log2(n);
+    // Anything but a small e puts the root out of reach long before the lattice gets too big to reduce
+    if (pubkey.e <= 1 || pubkey.e >= max_lattice_dimension || known_prefix < 0 || n <= 1) {
+      RUBBISHRSA_LOG_INFO(std::cerr << "e is too big for Coppersmith's attack" << std::endl);
+      return std::nullopt;
+    }
+    const auto e = pubkey.e.convert_to<unsigned long>();
+    // The root has to be below n^(1/e)
+    if (static_cast<uint64_t>(unknown_bits) * e >= n_bits) {
+      RUBBISHRSA_LOG_INFO(std::cerr << "Coppersmith's attack cannot reach " << unknown_bits << " unknown bits with this e" << std::endl);
+      return std::nullopt;
+    }
+
+    const bigint base = known_prefix << unknown_bits;
+    const bigint bound = bigint{1} << unknown_bits;
+    auto is_message = [&](const bigint& m) { return bmp::powm(m, pubkey.e, n) == encrypted_message % n; };
+    if (unknown_bits == 0)
+      return is_message(base) ? std::optional{base} : std::nullopt;
+
+    // f(x) = (base + x)^e - c (mod n), which is monic, and has the unknown bits as a root
+    polynomial f(e + 1);
+    {
+      bigint binomial = 1;
+      for (unsigned long i = 0; i <= e; ++i) {
+        f[i] = binomial * bmp::pow(base, e - i) % n;
+        binomial = binomial * (e - i) / (i + 1);
+      }
+      f[0] = (f[0] - encrypted_message) % n;
+    }
+
+    // The lattice is spanned by x^j n^(h - i) f^i for i < h and j < e, and by x^j f^h for j < t, where the
+    // dimension is e h + t. Each of these is a multiple of n^h at the root, and so is anything made from them, so if
+    // LLL finds one with |g(xX)| < n^h / sqrt(dimension), g(x) is 0 at the root over the integers too.
+    // The lattice is triangular, so its determinant is n^(e h (h + 1) / 2) X^(dimension (dimension - 1) / 2), and
+    // LLL's first vector is (in practice) about 1.02^dimension times its dimension'th root
+    auto big_enough = [&](size_t dimension, size_t h) {
+      const double log_n = static_cast<double>(n_bits), log_x = unknown_bits;
+      const double log_shortest = dimension * std::log2(1.02)
+                                  + (e * h * (h + 1) / 2.0 * log_n + dimension * (dimension - 1) / 2.0 * log_x) / dimension;
+      return log_shortest + std::log2(static_cast<double>(dimension)) / 2 < h * log_n;
+    };
+
+    // The smallest lattice that should work usually does, but that is only an estimate, so the next one up is
+    // tried before giving up
+    unsigned int attempts = 0;
+    for (size_t dimension = e + 1; dimension <= max_lattice_dimension && attempts < 2; ++dimension) {
+      const size_t h = (dimension - 1) / e, t = dimension - e * h;
+      if (!big_enough(dimension, h))
+        continue;
+      ++attempts;
+
+      std::vector<polynomial> rows;
+      polynomial f_power{1};
+      for (size_t i = 0; i <= h; ++i) {
+        const auto n_power = bmp::pow(n, static_cast<unsigned int>(h - i));
+        for (size_t j = 0; j < (i < h ? e : t); ++j) {
+          polynomial row(dimension);
+          for (size_t k = 0; k < f_power.size(); ++k)
+            row[j + k] = f_power[k] * n_power;
+          rows.push_back(std::move(row));
+        }
+        f_power = multiply(f_power, f);
+      }
+      // Substitute xX for x, so that the length of each row bounds its polynomial over the whole range
+      for (auto& row : rows)
+        for (size_t k = 0; k < dimension; ++k)
+          row[k] <<= k * unknown_bits;
+
+      RUBBISHRSA_LOG_TRACE(std::cerr << "Reducing a " << dimension << " dimensional lattice" << std::endl);
+      lll_reduce(rows);
+
+      // The first vector is the one the bound promises, but the second is often short enough too
+      for (size_t r = 0; r < 2; ++r) {
+        auto& g = rows[r];
+        for (size_t k = 0; k < dimension; ++k)
+          g[k] >>= k * unknown_bits;
+        for (auto& root : integer_roots(g, 0, bound - 1))
+          if (is_message(base + root))
+            return base + root;
+      }
+    }
+
+    if (attempts)
+      RUBBISHRSA_LOG_INFO(std::cerr << "Coppersmith's attack found no small root, so the prefix or the number of unknown bits may be wrong" << std::endl);
+    else
+      RUBBISHRSA_LOG_INFO(std::cerr << "Coppersmith's attack would need too big a lattice for " << unknown_bits << " unknown bits with this e" << std::endl);
+    return std::nullopt;
+  }
+
   bool is_invisible(char c) {
     // Uninitialised values in a initialised array are set to zero (false)
     static bool arr[256] = {
@@ -99,56 +474,106 @@ namespace rubbishrsa::attack {
     return arr[static_cast<unsigned char>(c)];
   }
 
-  std::optional<bigint> brute_force_sig(const public_key& pubkey, std::function<bool(const bigint&)> check_result) {
+  std::optional<bigint> brute_force_sig(const public_key& pubkey, std::function<bool(const bigint&)> check_result,
+                                        checkpoint* ckpt, job_control* job) {
+    metrics::scoped_timer timer{metrics::phase::brute_force};
     std::vector<std::thread> pool;
     // Whilst this is technically covered by the optional, it would be faster to just access this
     std::atomic<bool> found = false;
+    auto link = job ? job->link(found) : job_control::link_guard{};
     std::optional<bigint> result;
 
     auto count = std::thread::hardware_concurrency();
+    if (ckpt) {
+      if (auto saved = ckpt->get_uint("sig.threads"))
+        count = static_cast<unsigned int>(*saved);
+      else
+        ckpt->set("sig.threads", count);
+    }
+
+    // Read here rather than on the threads, where a malformed value would throw
+    std::vector<bigint> guesses(count);
+    std::iota(guesses.begin(), guesses.end(), 0);
+    if (ckpt) {
+      for (unsigned int i = 0; i < count; ++i)
+        if (auto saved = ckpt->get_bigint("sig.guess." + std::to_string(i)))
+          guesses[i] = std::move(*saved);
+    }
 
     for (unsigned int i = 0; i < count; ++i) {
       pool.emplace_back([&, i]() {
-        bigint guess = i;
-        for (bigint guess = i; !found && i < pubkey.n; guess += count)
-          if (check_result(pubkey.raw_verify(guess)) && !found.exchange(true))
+        uint_fast32_t unreported = 0;
+        bigint guess = std::move(guesses[i]), verified;
+        const auto key = "sig.guess." + std::to_string(i);
+        // Signatures are only unique below the modulus, so there is no point looking further
+        for (; !found && guess < pubkey.n; guess += count) {
+          pubkey.raw_verify(guess, verified);
+          if (check_result(verified) && !found.exchange(true))
             result = guess;
+          if (++unreported == 1024) {
+            metrics::add(metrics::counter::sig_candidates, unreported);
+            if (job)
+              job->add_progress(unreported);
+            unreported = 0;
+            if (ckpt) {
+              // This guess has been checked, so resume from the one after
+              ckpt->set(key, guess + count);
+              ckpt->maybe_save();
+            }
+          }
+        }
+        metrics::add(metrics::counter::sig_candidates, unreported);
+        if (job)
+          job->add_progress(unreported);
       });
     }
 
     for (auto& thread : pool)
       thread.join();
 
+    if (!result && job)
+      job->throw_if_stopped();
+
     return result;
   }
 
-  std::optional<bigint> brute_force_sig_invis(const public_key& pubkey, bigint msg) {
+  namespace {
+    // The i'th least significant byte, read straight from the limbs so that nothing is copied
+    char byte_at(const bigint& x, size_t i) {
+      const auto limb = mpz_getlimbn(x.backend().data(), static_cast<mp_size_t>(i / sizeof(mp_limb_t)));
+      return static_cast<char>(limb >> (8 * (i % sizeof(mp_limb_t))));
+    }
+  }
+
+  bool equal_up_to_invisible(const bigint& candidate, const bigint& msg) {
+    // This is called for every signature tried, so it walks the bytes in place rather than shifting copies
+    const auto candidate_len = byte_length(candidate), msg_len = byte_length(msg);
+    size_t candidate_i = 0, msg_i = 0;
+    while (true) {
+      char i_c;
+      // We should skip all invisible candidates
+      while (is_invisible(i_c = byte_at(candidate, candidate_i))) {
+        // If we have run out of chars in our candidate, check the data to see if that is empty too
+        if (candidate_i >= candidate_len)
+          return msg_i >= msg_len;
+        ++candidate_i;
+      }
+      // If we have run out of data chars, but not out of test chars, then we failed
+      if (msg_i >= msg_len)
+        return false;
+
+      // If the char differs, then it is not equal up to visibility
+      if (i_c != byte_at(msg, msg_i))
+        return false;
+      ++candidate_i;
+      ++msg_i;
+    }
+  }
+
+  std::optional<bigint> brute_force_sig_invis(const public_key& pubkey, bigint msg, checkpoint* ckpt, job_control* job) {
     // Speed up by making sure all the constant input is visible
     return rubbishrsa::attack::brute_force_sig(pubkey, [&](const auto& i) -> bool {
-      auto i_cpy = i;
-      auto data_cpy = msg;
-      while (true) {
-        char i_c;
-        // We should skip all invisible candidates
-        while (is_invisible(i_c = static_cast<char>(i_cpy & 0xFF))) {
-          // If we have run out of chars in our candidate, check the data to see if that is empty too
-          if (!i_cpy)
-            return data_cpy == 0;
-          i_cpy >>= 8;
-        }
-        // If we have run out of data chars, but not out of test chars, then we failed
-        if (!data_cpy)
-          return false;
-        char data_c = static_cast<char>(data_cpy & 0xFF);
-
-        // If the char differs, then it is not equal up to visibility
-        if (i_c != data_c)
-          return false;
-        else {
-          data_cpy >>= 8;
-          i_cpy >>= 8;
-        }
-      }
-    });
+      return equal_up_to_invisible(i, msg);
+    }, ckpt, job);
   }
 }
@@ -0,0 +1,112 @@
+#include <rubbishrsa/blocks.hpp>
+#include <rubbishrsa/pipeline.hpp>
+
+#include <functional>
+#include <istream>
+#include <ostream>
+
+namespace rubbishrsa {
+  namespace {
+    using block_op = std::function<bigint(const bigint&)>;
+
+    // Frames the message into blocks, and applies op to each
+    void encode_blocks(const bigint& n, const block_op& op, std::istream& in, std::ostream& out, unsigned int thread_count) {
+      const size_t payload = block_payload_size(n);
+      const size_t out_len = byte_length(n);
+      bool done = false;
+
+      ordered_parallel_map(
+        [&]() -> std::optional<std::string> {
+          if (done)
+            return std::nullopt;
+          // The two length bytes go at the front
+          std::string block(payload + 2, '\0');
+          in.read(block.data() + 2, payload);
+          const auto len = static_cast<size_t>(in.gcount());
+          // A short block marks the end, so a message that fills its last block needs an empty one after it
+          done = len < payload;
+          block[0] = static_cast<char>(len >> 8);
+          block[1] = static_cast<char>(len & 0xFF);
+          return block;
+        },
+        [&](std::string block) {
+          std::string ret(out_len, '\0');
+          bigint2bytes_padded(op(ascii2bigint(block)), std::as_writable_bytes(std::span{ret}));
+          return ret;
+        },
+        [&](std::string block) {
+          out.write(block.data(), block.size());
+        },
+        thread_count);
+    }
+
+    // Applies op to each block, and strips the framing
+    void decode_blocks(const bigint& n, const block_op& op, std::istream& in, std::ostream& out, unsigned int thread_count) {
+      const size_t payload = block_payload_size(n);
+      const size_t in_len = byte_length(n);
+      bool seen_last = false;
+
+      ordered_parallel_map(
+        [&]() -> std::optional<std::string> {
+          std::string block(in_len, '\0');
+          in.read(block.data(), in_len);
+          if (in.gcount() == 0)
+            return std::nullopt;
+          if (static_cast<size_t>(in.gcount()) != in_len)
+            throw std::invalid_argument("The block stream is truncated");
+          return block;
+        },
+        [&](std::string block) {
+          auto value = ascii2bigint(block);
+          if (value >= n)
+            throw std::invalid_argument("Block too large! Maybe you used the wrong key?");
+          value = op(value);
+          // Anything that does not fit the framing must have come from the wrong key
+          if (value >> ((payload + 2) * 8))
+            throw std::invalid_argument("Block has invalid framing! Maybe you used the wrong key?");
+
+          std::string ret(payload + 2, '\0');
+          bigint2bytes_padded(value, std::as_writable_bytes(std::span{ret}));
+          const size_t len = (static_cast<unsigned char>(ret[0]) << 8) | static_cast<unsigned char>(ret[1]);
+          if (len > payload)
+            throw std::invalid_argument("Block has invalid framing! Maybe you used the wrong key?");
+          return ret.substr(2, len);
+        },
+        [&](std::string data) {
+          if (seen_last)
+            throw std::invalid_argument("Found blocks after the end of the message");
+          seen_last = data.size() < payload;
+          out.write(data.data(), data.size());
+        },
+        thread_count);
+
+      if (!seen_last)
+        throw std::invalid_argument("The block stream is truncated");
+    }
+  }
+
+  size_t block_payload_size(const bigint& n) {
+    const size_t len = byte_length(n);
+    // We need the two length bytes, a byte of headroom to stay below n, and at least one byte of message
+    if (len < 4)
+      throw std::invalid_argument("The modulus is too small to hold any blocks");
+    // The length must also fit in two bytes
+    return std::min<size_t>(len - 3, 0xFFFF);
+  }
+
+  void encrypt_blocks(const public_key& key, std::istream& in, std::ostream& out, unsigned int thread_count) {
+    encode_blocks(key.n, [&](const bigint& m) { return key.raw_encrypt(m); }, in, out, thread_count);
+  }
+
+  void decrypt_blocks(const private_key& key, std::istream& in, std::ostream& out, unsigned int thread_count) {
+    decode_blocks(key.n, [&](const bigint& c) { return key.raw_decrypt(c); }, in, out, thread_count);
+  }
+
+  void sign_blocks(const private_key& key, std::istream& in, std::ostream& out, unsigned int thread_count) {
+    encode_blocks(key.n, [&](const bigint& m) { return key.raw_sign(m); }, in, out, thread_count);
+  }
+
+  void verify_blocks(const public_key& key, std::istream& in, std::ostream& out, unsigned int thread_count) {
+    decode_blocks(key.n, [&](const bigint& s) { return key.raw_verify(s); }, in, out, thread_count);
+  }
+}
@@ -0,0 +1,260 @@
+#include <rubbishrsa/attack.hpp>
+#include <rubbishrsa/candidates.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <istream>
+#include <stdexcept>
+#include <thread>
+
+namespace rubbishrsa::attack {
+  namespace {
+    std::string charset_range(char first, char last) {
+      std::string ret;
+      for (int c = static_cast<unsigned char>(first); c <= static_cast<unsigned char>(last); ++c)
+        ret.push_back(static_cast<char>(c));
+      return ret;
+    }
+
+    std::string expand_placeholder(char c) {
+      static const std::string symbols = " !\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~";
+      switch (c) {
+        case 'l': return charset_range('a', 'z');
+        case 'u': return charset_range('A', 'Z');
+        case 'd': return charset_range('0', '9');
+        case 'h': return charset_range('0', '9') + charset_range('a', 'f');
+        case 'H': return charset_range('0', '9') + charset_range('A', 'F');
+        case 's': return symbols;
+        case 'a': return charset_range('a', 'z') + charset_range('A', 'Z') + charset_range('0', '9') + symbols;
+        case 'b': return charset_range('\x00', '\xff');
+        case '?': return "?";
+        default: throw std::invalid_argument(std::string{"Unknown mask placeholder ?"} + c);
+      }
+    }
+
+    // Converts a hashcat position character to a number
+    size_t rule_pos(char c) {
+      if (c >= '0' && c <= '9')
+        return c - '0';
+      if (c >= 'A' && c <= 'Z')
+        return c - 'A' + 10;
+      throw std::invalid_argument(std::string{"Invalid rule position "} + c);
+    }
+
+    // Splits [0, total) into count contiguous slices, returning the start and length of the i'th
+    std::pair<bigint, bigint> split_range(const bigint& total, unsigned int count, unsigned int i) {
+      bigint chunk = total / count;
+      bigint rem = total % count;
+      bigint start = chunk * i + (rem < i ? rem : bigint{i});
+      return {std::move(start), chunk + (rem > i ? 1 : 0)};
+    }
+  }
+
+  mask_generator::mask_generator(std::string_view mask) {
+    for (size_t i = 0; i < mask.size(); ++i) {
+      if (mask[i] != '?')
+        charsets.emplace_back(1, mask[i]);
+      else if (++i == mask.size())
+        throw std::invalid_argument("Mask ends with an unfinished placeholder");
+      else
+        charsets.push_back(expand_placeholder(mask[i]));
+    }
+
+    // Precompute how the bigint changes when each position moves on by one
+    //
+    // Position p holds the byte that is (len - 1 - p) bytes from the bottom
+    step.resize(charsets.size());
+    wrap.resize(charsets.size());
+    for (size_t p = 0; p < charsets.size(); ++p) {
+      const auto& cs = charsets[p];
+      const size_t shift = (charsets.size() - 1 - p) * 8;
+      for (size_t j = 0; j + 1 < cs.size(); ++j) {
+        bigint delta = static_cast<int>(static_cast<unsigned char>(cs[j + 1])) - static_cast<unsigned char>(cs[j]);
+        step[p].push_back(delta << shift);
+      }
+      bigint delta = static_cast<int>(static_cast<unsigned char>(cs.front())) - static_cast<unsigned char>(cs.back());
+      wrap[p] = delta << shift;
+      total *= cs.size();
+    }
+  }
+
+  std::vector<uint_fast16_t> mask_generator::decompose(bigint index) const {
+    if (index >= total)
+      throw std::out_of_range("Mask index is out of range");
+
+    std::vector<uint_fast16_t> digits(charsets.size());
+    for (size_t p = charsets.size(); p--;) {
+      digits[p] = static_cast<uint_fast16_t>(index % charsets[p].size());
+      index /= charsets[p].size();
+    }
+    return digits;
+  }
+
+  std::string mask_generator::at(bigint index) const {
+    auto digits = decompose(std::move(index));
+    std::string ret;
+    ret.reserve(charsets.size());
+    for (size_t p = 0; p < charsets.size(); ++p)
+      ret.push_back(charsets[p][digits[p]]);
+    return ret;
+  }
+
+  mask_generator::cursor mask_generator::slice(bigint index, bigint count) const {
+    cursor ret;
+    ret.mask = this;
+    ret.remaining = std::move(count);
+    // An empty slice may start at the very end
+    if (!ret.remaining)
+      return ret;
+    // This is the only time we build the whole number
+    ret.value = ascii2bigint(at(index));
+    ret.digits = decompose(std::move(index));
+    return ret;
+  }
+
+  bool mask_generator::cursor::next(bigint& out) {
+    if (!remaining)
+      return false;
+
+    if (started) {
+      // Increment the digits like an odometer, only touching the bytes that change
+      for (size_t p = digits.size(); p--;) {
+        if (digits[p] + 1u < mask->charsets[p].size()) {
+          value += mask->step[p][digits[p]];
+          ++digits[p];
+          break;
+        }
+        value += mask->wrap[p];
+        digits[p] = 0;
+      }
+    }
+    else
+      started = true;
+
+    out = value;
+    --remaining;
+    return true;
+  }
+
+  mangle_rule mangle_rule::parse(std::string_view rule) {
+    mangle_rule ret;
+    for (size_t i = 0; i < rule.size(); ++i) {
+      op o{rule[i], 0, 0};
+      // Works out how many argument chars the function takes
+      size_t n_args;
+      switch (o.func) {
+        case ' ': case '\t': continue;
+        case ':': case 'l': case 'u': case 'c': case 'C': case 't': case 'r':
+        case 'd': case 'f': case '{': case '}': case '[': case ']':
+          n_args = 0; break;
+        case 'T': case 'D': case '\'': case '$': case '^': case '@':
+          n_args = 1; break;
+        case 's':
+          n_args = 2; break;
+        default:
+          throw std::invalid_argument(std::string{"Unknown rule function "} + o.func);
+      }
+      if (n_args && i + n_args >= rule.size())
+        throw std::invalid_argument(std::string{"Missing argument for rule function "} + o.func);
+      if (n_args >= 1) o.arg_1 = rule[++i];
+      if (n_args >= 2) o.arg_2 = rule[++i];
+      // Catch bad positions now, rather than in the hot loop
+      if (o.func == 'T' || o.func == 'D' || o.func == '\'')
+        rule_pos(o.arg_1);
+      ret.ops.push_back(o);
+    }
+    return ret;
+  }
+
+  std::vector<mangle_rule> mangle_rule::parse_all(std::istream& in) {
+    std::vector<mangle_rule> ret;
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.size() && line.back() == '\r')
+        line.pop_back();
+      if (line.empty() || line.front() == '#')
+        continue;
+      ret.push_back(parse(line));
+    }
+    return ret;
+  }
+
+  std::string mangle_rule::apply(std::string word) const {
+    auto lower = [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); };
+    auto upper = [](char c) { return static_cast<char>(std::toupper(static_cast<unsigned char>(c))); };
+    auto toggle = [&](char c) { return std::islower(static_cast<unsigned char>(c)) ? upper(c) : lower(c); };
+
+    for (const auto& o : ops) {
+      switch (o.func) {
+        case ':': break;
+        case 'l': std::transform(word.begin(), word.end(), word.begin(), lower); break;
+        case 'u': std::transform(word.begin(), word.end(), word.begin(), upper); break;
+        case 'c':
+          std::transform(word.begin(), word.end(), word.begin(), lower);
+          if (word.size()) word[0] = upper(word[0]);
+          break;
+        case 'C':
+          std::transform(word.begin(), word.end(), word.begin(), upper);
+          if (word.size()) word[0] = lower(word[0]);
+          break;
+        case 't': std::transform(word.begin(), word.end(), word.begin(), toggle); break;
+        case 'T': if (auto n = rule_pos(o.arg_1); n < word.size()) word[n] = toggle(word[n]); break;
+        case 'r': std::reverse(word.begin(), word.end()); break;
+        case 'd': word += word; break;
+        case 'f': word += std::string{word.rbegin(), word.rend()}; break;
+        case '{': if (word.size()) std::rotate(word.begin(), word.begin() + 1, word.end()); break;
+        case '}': if (word.size()) std::rotate(word.rbegin(), word.rbegin() + 1, word.rend()); break;
+        case '[': if (word.size()) word.erase(0, 1); break;
+        case ']': if (word.size()) word.pop_back(); break;
+        case 'D': if (auto n = rule_pos(o.arg_1); n < word.size()) word.erase(n, 1); break;
+        case '\'': if (auto n = rule_pos(o.arg_1); n < word.size()) word.resize(n); break;
+        case '$': word.push_back(o.arg_1); break;
+        case '^': word.insert(word.begin(), o.arg_1); break;
+        case 's': std::replace(word.begin(), word.end(), o.arg_1, o.arg_2); break;
+        case '@': word.erase(std::remove(word.begin(), word.end(), o.arg_1), word.end()); break;
+      }
+    }
+    return word;
+  }
+
+  std::optional<bigint> brute_force_ptext(const public_key& pubkey, const bigint& encrypted_message,
+                                          const mask_generator& mask, unsigned int thread_count, job_control* job) {
+    const auto count = thread_count ? thread_count : std::thread::hardware_concurrency();
+    // Each thread gets its own contiguous slice of the mask
+    std::vector<mask_generator::cursor> cursors;
+    for (unsigned int i = 0; i < count; ++i) {
+      auto [start, length] = split_range(mask.size(), count, i);
+      cursors.push_back(mask.slice(std::move(start), std::move(length)));
+    }
+
+    return brute_force_ptext(pubkey, encrypted_message, [&](unsigned int i) -> std::optional<bigint> {
+      bigint candidate;
+      if (cursors[i].next(candidate))
+        return candidate;
+      else
+        return std::nullopt;
+    }, count, job);
+  }
+
+  std::optional<bigint> brute_force_ptext(const public_key& pubkey, const bigint& encrypted_message,
+                                          const std::vector<std::string>& words, const std::vector<mangle_rule>& rules,
+                                          unsigned int thread_count, job_control* job) {
+    const auto count = thread_count ? thread_count : std::thread::hardware_concurrency();
+    const size_t total = words.size() * rules.size();
+    // Each thread walks its own index range, word-major so that each word stays hot in cache
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (unsigned int i = 0; i < count; ++i) {
+      size_t chunk = total / count, rem = total % count;
+      size_t start = chunk * i + std::min<size_t>(i, rem);
+      ranges.emplace_back(start, start + chunk + (i < rem ? 1 : 0));
+    }
+
+    return brute_force_ptext(pubkey, encrypted_message, [&](unsigned int i) -> std::optional<bigint> {
+      auto& [pos, end] = ranges[i];
+      if (pos == end)
+        return std::nullopt;
+      auto idx = pos++;
+      return ascii2bigint(rules[idx % rules.size()].apply(words[idx / rules.size()]));
+    }, count, job);
+  }
+}
@@ -0,0 +1,127 @@
+#include <rubbishrsa/checkpoint.hpp>
+#include <rubbishrsa/log.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+
+namespace rubbishrsa {
+  namespace {
+    constexpr std::string_view job_key = "job";
+  }
+
+  checkpoint::checkpoint(std::string path, std::string job, clock::duration interval) :
+    path{std::move(path)}, job{std::move(job)}, interval{interval}, last_save{clock::now()} {}
+
+  bool checkpoint::load() {
+    std::unique_lock lock{mutex};
+    std::ifstream in{path};
+    if (!in)
+      return false;
+
+    std::map<std::string, std::string> loaded;
+    for (std::string line; std::getline(in, line);) {
+      if (line.empty())
+        continue;
+      auto eq = line.find('=');
+      if (eq == std::string::npos)
+        throw std::invalid_argument("Malformed checkpoint line '" + line + "'");
+      loaded[line.substr(0, eq)] = line.substr(eq + 1);
+    }
+
+    if (loaded[std::string{job_key}] != job)
+      throw std::invalid_argument("The checkpoint at '" + path + "' is for a different job");
+    // Everything else is a number, in hex or decimal, which is checked here so that reading it later (perhaps on a
+    // search's own thread) can only fail if it is read as the wrong type
+    for (const auto& [key, value] : loaded) {
+      if (key != job_key && (value.empty() || !std::all_of(value.begin(), value.end(), [](char c) { return std::isxdigit(static_cast<unsigned char>(c)); })))
+        throw std::invalid_argument("Malformed checkpoint value for '" + key + "'");
+    }
+
+    values = std::move(loaded);
+    return true;
+  }
+
+  std::optional<std::string> checkpoint::get(const std::string& key) const {
+    std::unique_lock lock{mutex};
+    auto iter = values.find(key);
+    if (iter == values.end())
+      return std::nullopt;
+    return iter->second;
+  }
+
+  std::optional<bigint> checkpoint::get_bigint(const std::string& key) const {
+    auto value = get(key);
+    if (!value)
+      return std::nullopt;
+    return hex2bigint(*value);
+  }
+
+  std::optional<unsigned long long> checkpoint::get_uint(const std::string& key) const {
+    auto value = get(key);
+    if (!value)
+      return std::nullopt;
+    unsigned long long ret;
+    const auto [end, ec] = std::from_chars(value->data(), value->data() + value->size(), ret);
+    if (ec != std::errc{} || end != value->data() + value->size())
+      throw std::invalid_argument("Malformed checkpoint value for '" + key + "'");
+    return ret;
+  }
+
+  void checkpoint::set(const std::string& key, std::string value) {
+    std::unique_lock lock{mutex};
+    values[key] = std::move(value);
+  }
+
+  void checkpoint::set(const std::string& key, const bigint& value) {
+    set(key, value.str(0, std::ios::hex));
+  }
+
+  void checkpoint::set(const std::string& key, unsigned long long value) {
+    set(key, std::to_string(value));
+  }
+
+  void checkpoint::maybe_save() {
+    std::unique_lock lock{mutex};
+    if (clock::now() - last_save < interval)
+      return;
+    // This is called from the threads doing the search, where an exception would take the whole process down,
+    // and a search that cannot be saved is still worth finishing. The next try is an interval later
+    try {
+      save_locked();
+    }
+    catch (const std::exception& e) {
+      last_save = clock::now();
+      RUBBISHRSA_LOG_INFO(std::cerr << "Could not save the checkpoint, carrying on without it: " << e.what() << std::endl);
+    }
+  }
+
+  void checkpoint::save() {
+    std::unique_lock lock{mutex};
+    save_locked();
+  }
+
+  void checkpoint::save_locked() {
+    values[std::string{job_key}] = job;
+    // Write to the side and rename, so a crash mid-write never loses the previous checkpoint
+    const auto tmp_path = path + ".tmp";
+    {
+      std::ofstream out{tmp_path, std::ios::trunc};
+      for (const auto& [key, value] : values)
+        out << key << '=' << value << '\n';
+      if (!out)
+        throw std::runtime_error("Could not write checkpoint to '" + tmp_path + "'");
+    }
+    std::filesystem::rename(tmp_path, path);
+    last_save = clock::now();
+  }
+
+  void checkpoint::remove() {
+    std::unique_lock lock{mutex};
+    // The search has already finished, so a checkpoint that will not go away is not worth failing over
+    std::error_code ignored;
+    std::filesystem::remove(path, ignored);
+  }
+}
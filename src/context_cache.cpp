@@ -0,0 +1,153 @@
+#include <rubbishrsa/context_cache.hpp>
+
+#include <rubbishrsa/keystore.hpp>
+#include <rubbishrsa/metrics.hpp>
+
+namespace rubbishrsa {
+  namespace {
+    // What each context costs beyond its limbs: the context itself, its list node, and its index node
+    constexpr size_t context_overhead = sizeof(key_context) + 8 * sizeof(void*);
+
+    size_t limb_bytes(const bigint& i) {
+      return mpz_size(i.backend().data()) * sizeof(mp_limb_t);
+    }
+  }
+
+  key_context key_context::from_private_key(const private_key& key) {
+    key_context ret;
+    ret.n = key.n;
+    ret.e = key.e;
+    ret.d = key.d;
+    try {
+      std::tie(ret.p, ret.q) = recover_factors(key.n, key.e, key.d);
+    }
+    catch (const std::invalid_argument&) {
+      // The key is broken, but powm will still do exactly what it did before
+      ret.p = ret.q = 0;
+      return ret;
+    }
+    // A key with more than two primes only splits in two, and d mod (p - 1) is no use if p is not prime. A few
+    // rounds are plenty, as nobody is choosing these to fool us
+    if (!is_prime(ret.p, 4) || !is_prime(ret.q, 4)) {
+      ret.p = ret.q = 0;
+      return ret;
+    }
+    ret.d_p = key.d % (ret.p - 1);
+    ret.d_q = key.d % (ret.q - 1);
+    ret.q_inv = modinv(ret.q, ret.p);
+    return ret;
+  }
+
+  bigint key_context::exponentiate_private(const bigint& x) const {
+    if (p == 0)
+      return bmp::powm(x, d, n);
+    metrics::scoped_timer timer{metrics::phase::crt};
+    // Garner's recombination: m = m_q + q * (q^-1 * (m_p - m_q) mod p)
+    bigint m_p = bmp::powm(x, d_p, p);
+    bigint m_q = bmp::powm(x, d_q, q);
+    bigint h = m_p - m_q;
+    h *= q_inv;
+    h %= p;
+    if (h < 0)
+      h += p;
+    h *= q;
+    h += m_q;
+    return h;
+  }
+
+  size_t key_context::memory_used() const {
+    return context_overhead + limb_bytes(n) + limb_bytes(e) + limb_bytes(d) + limb_bytes(p) + limb_bytes(q)
+           + limb_bytes(d_p) + limb_bytes(d_q) + limb_bytes(q_inv);
+  }
+
+  context_cache::context_cache(size_t max_bytes) : max_bytes{max_bytes} {}
+
+  std::shared_ptr<const key_context> context_cache::get(const private_key& key) {
+    const auto fingerprint = keystore::fingerprint(key.n);
+    {
+      std::unique_lock lock{mutex};
+      auto [begin, end] = index.equal_range(fingerprint);
+      for (auto iter = begin; iter != end; ++iter) {
+        const auto& context = *iter->second->context;
+        if (context.n == key.n && context.d == key.d && context.e == key.e) {
+          lru.splice(lru.begin(), lru, iter->second);
+          ++counts.hits;
+          metrics::add(metrics::counter::context_cache_hits);
+          return iter->second->context;
+        }
+      }
+      ++counts.misses;
+    }
+    metrics::add(metrics::counter::context_cache_misses);
+
+    // Worked out without the lock, so that everyone else can carry on meanwhile
+    auto context = std::make_shared<const key_context>(key_context::from_private_key(key));
+    const auto bytes = context->memory_used();
+
+    std::unique_lock lock{mutex};
+    // Too big to ever fit, so it is only used this once
+    if (bytes > max_bytes)
+      return context;
+    // Another thread may have beaten us to it, in which case we both carry on with our own copy
+    auto [begin, end] = index.equal_range(fingerprint);
+    for (auto iter = begin; iter != end; ++iter) {
+      const auto& cached = *iter->second->context;
+      if (cached.n == key.n && cached.d == key.d && cached.e == key.e)
+        return context;
+    }
+    evict_to(max_bytes - bytes);
+    lru.push_front({fingerprint, context});
+    index.emplace(fingerprint, lru.begin());
+    counts.bytes += bytes;
+    ++counts.entries;
+    return context;
+  }
+
+  void context_cache::evict_to(size_t target) {
+    while (counts.bytes > target && lru.size()) {
+      auto& victim = lru.back();
+      auto [begin, end] = index.equal_range(victim.fingerprint);
+      for (auto iter = begin; iter != end; ++iter) {
+        if (iter->second == std::prev(lru.end())) {
+          index.erase(iter);
+          break;
+        }
+      }
+      counts.bytes -= victim.context->memory_used();
+      --counts.entries;
+      ++counts.evictions;
+      lru.pop_back();
+    }
+  }
+
+  void context_cache::set_max_bytes(size_t new_max_bytes) {
+    std::unique_lock lock{mutex};
+    max_bytes = new_max_bytes;
+    evict_to(max_bytes);
+  }
+
+  void context_cache::clear() {
+    std::unique_lock lock{mutex};
+    evict_to(0);
+  }
+
+  context_cache::statistics context_cache::stats() const {
+    std::unique_lock lock{mutex};
+    return counts;
+  }
+
+  context_cache& shared_context_cache() {
+    static context_cache cache{0};
+    return cache;
+  }
+
+  void enable_context_cache(size_t max_bytes) {
+    auto& cache = shared_context_cache();
+    cache.set_max_bytes(max_bytes);
+    detail::context_cache_on.store(max_bytes != 0, std::memory_order_relaxed);
+  }
+
+  bigint private_key::exponentiate_cached(const bigint& x) const {
+    return shared_context_cache().get(*this)->exponentiate_private(x);
+  }
+}
@@ -0,0 +1,726 @@
+#include <rubbishrsa/distributed.hpp>
+
+#include <rubbishrsa/attack.hpp>
+#include <rubbishrsa/log.hpp>
+#include <rubbishrsa/metrics.hpp>
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <thread>
+
+namespace rubbishrsa::distributed {
+  namespace {
+    namespace asio = boost::asio;
+    // Both TCP and Unix sockets, so the rest of the code does not care which it has
+    using protocol = asio::generic::stream_protocol;
+    using clock = std::chrono::steady_clock;
+
+    constexpr std::string_view unix_prefix = "unix:";
+    // More threads than any one machine has, so that a worker cannot have us start an arbitrary number of rho walks
+    constexpr unsigned int max_worker_threads = 1024;
+
+    protocol::endpoint resolve(asio::io_context& io, const std::string& address) {
+      if (address.starts_with(unix_prefix)) {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+        return asio::local::stream_protocol::endpoint{address.substr(unix_prefix.size())};
+#else
+        throw std::invalid_argument("Unix sockets are not supported on this platform");
+#endif
+      }
+      const auto bad_address = std::invalid_argument("Addresses must be host:port, [ipv6]:port or unix:path, not '" + address + "'");
+      std::string host, port;
+      // IPv6 addresses are full of colons, so they have to be bracketed to tell where the port starts
+      if (address.starts_with('[')) {
+        auto close = address.find("]:");
+        if (close == std::string::npos)
+          throw bad_address;
+        host = address.substr(1, close - 1);
+        port = address.substr(close + 2);
+      }
+      else {
+        auto colon = address.find(':');
+        if (colon == std::string::npos || address.find(':', colon + 1) != std::string::npos)
+          throw bad_address;
+        host = address.substr(0, colon);
+        port = address.substr(colon + 1);
+      }
+      asio::ip::tcp::resolver resolver{io};
+      return resolver.resolve(host, port).begin()->endpoint();
+    }
+
+    std::string hex(const bigint& i) {
+      return i.str(0, std::ios::hex);
+    }
+
+    // Something the other end said that made no sense
+    struct protocol_error : std::runtime_error {
+      using std::runtime_error::runtime_error;
+    };
+
+    bigint read_hex(std::istream& is) {
+      std::string token;
+      if (!(is >> token))
+        throw protocol_error("Truncated message");
+      try {
+        return hex2bigint(token);
+      }
+      catch (const std::invalid_argument&) {
+        throw protocol_error("Bad number '" + token + "'");
+      }
+    }
+
+    uint64_t read_id(std::istream& is) {
+      uint64_t ret;
+      if (!(is >> ret))
+        throw protocol_error("Missing unit id");
+      return ret;
+    }
+
+    public_key read_pubkey(std::istream& is) {
+      public_key ret;
+      ret.n = read_hex(is);
+      ret.e = read_hex(is);
+      return ret;
+    }
+
+    std::string describe_pubkey(const public_key& key) {
+      return hex(key.n) + ' ' + hex(key.e);
+    }
+
+    // Every source that splits up a plain range of numbers into units of "<first> <last>"
+    class range_units : public work_source {
+    public:
+      range_units(bigint min, bigint max, uint64_t unit_size) : cursor{std::move(min)}, max{std::move(max)}, unit_size{unit_size} {
+        if (!unit_size)
+          throw std::invalid_argument("The unit size must be positive");
+      }
+
+      std::optional<std::string> next_unit(unsigned int) override {
+        if (cursor > max)
+          return std::nullopt;
+        bigint last = cursor + (unit_size - 1);
+        if (last > max)
+          last = max;
+        auto ret = hex(cursor) + ' ' + hex(last);
+        cursor = last + 1;
+        return ret;
+      }
+
+    private:
+      bigint cursor, max;
+      uint64_t unit_size;
+    };
+
+    class ptext_range_source : public range_units {
+    public:
+      ptext_range_source(const public_key& pubkey, const bigint& c, bigint min, bigint max, uint64_t unit_size) :
+        range_units{std::move(min), std::move(max), unit_size}, pubkey{pubkey}, c{c} {}
+
+      std::string describe() const override { return "range " + describe_pubkey(pubkey) + ' ' + hex(c); }
+      bool check(const bigint& result) const override { return pubkey.raw_encrypt(result) == c; }
+
+    private:
+      public_key pubkey;
+      bigint c;
+    };
+
+    class ptext_list_source : public work_source {
+    public:
+      ptext_list_source(const public_key& pubkey, const bigint& c, std::istream& in, bool convert_hex_to_num, uint64_t unit_size) :
+        pubkey{pubkey}, c{c}, in{in}, convert_hex_to_num{convert_hex_to_num}, unit_size{unit_size} {
+        if (!unit_size)
+          throw std::invalid_argument("The unit size must be positive");
+      }
+
+      // The candidates are converted here, so the workers only ever see numbers
+      std::string describe() const override { return "list " + describe_pubkey(pubkey) + ' ' + hex(c); }
+
+      std::optional<std::string> next_unit(unsigned int) override {
+        std::string ret, line;
+        for (uint64_t i = 0; i < unit_size && std::getline(in, line); ++i) {
+          if (ret.size())
+            ret.push_back(' ');
+          ret += hex(convert_hex_to_num ? hex2bigint(line) : ascii2bigint(line));
+        }
+        if (ret.empty())
+          return std::nullopt;
+        return ret;
+      }
+
+      bool check(const bigint& result) const override { return pubkey.raw_encrypt(result) == c; }
+
+    private:
+      public_key pubkey;
+      bigint c;
+      std::istream& in;
+      bool convert_hex_to_num;
+      uint64_t unit_size;
+    };
+
+    class sig_range_source : public range_units {
+    public:
+      sig_range_source(const public_key& pubkey, bigint msg, bool allow_invisible, uint64_t unit_size) :
+        range_units{0, pubkey.n - 1, unit_size}, pubkey{pubkey}, msg{std::move(msg)}, allow_invisible{allow_invisible} {}
+
+      std::string describe() const override {
+        return "sig " + describe_pubkey(pubkey) + ' ' + hex(msg) + (allow_invisible ? " 1" : " 0");
+      }
+
+      bool check(const bigint& result) const override {
+        auto verified = pubkey.raw_verify(result);
+        return allow_invisible ? attack::equal_up_to_invisible(verified, msg) : verified == msg;
+      }
+
+    private:
+      public_key pubkey;
+      bigint msg;
+      bool allow_invisible;
+    };
+
+    // Units are "<steps> <walk> <x> <y> <walk> <x> <y> ...", and the reports are the updated walks, less any that
+    // cycled without finding a factor, as those can only go round again
+    class rho_walk_source : public work_source {
+    public:
+      rho_walk_source(bigint n, uint64_t unit_size) : n{std::move(n)}, unit_size{unit_size} {
+        if (!unit_size)
+          throw std::invalid_argument("The unit size must be positive");
+      }
+
+      std::string describe() const override { return "rho " + hex(n); }
+
+      // Walks never run out: a walk that comes back is simply handed out again to carry on, and one that does not is
+      // replaced by a new walk, with a polynomial of its own
+      std::optional<std::string> next_unit(unsigned int worker_threads) override {
+        auto ret = std::to_string(unit_size);
+        for (unsigned int i = 0; i < std::max(worker_threads, 1u); ++i) {
+          if (idle.size()) {
+            ret += ' ' + idle.front();
+            idle.pop_front();
+          }
+          else {
+            auto start = hex(pollard_rho_start(next_walk));
+            ret += ' ' + std::to_string(next_walk++) + ' ' + start + ' ' + start;
+          }
+        }
+        return ret;
+      }
+
+      void unit_done(const std::string&, const std::string& report) override {
+        std::istringstream ss{report};
+        std::string walk, x, y;
+        while (ss >> walk >> x >> y)
+          idle.push_back(walk + ' ' + x + ' ' + y);
+      }
+
+      bool check(const bigint& result) const override { return result > 1 && result < n && n % result == 0; }
+
+    private:
+      bigint n;
+      uint64_t unit_size;
+      std::deque<std::string> idle;
+      uint64_t next_walk = 0;
+    };
+
+    struct lease {
+      std::string unit;
+      uint64_t session;
+      clock::time_point deadline;
+    };
+
+    // Runs entirely on one thread, inside the io_context, so none of this needs locking
+    class coordinator {
+    public:
+      std::optional<bigint> result;
+
+      coordinator(asio::io_context& io, const protocol::endpoint& endpoint, work_source& source, clock::duration lease_timeout) :
+        acceptor{io, endpoint}, timer{io}, source{source}, lease_timeout{lease_timeout} {
+        accept();
+        expire_leases();
+      }
+
+    private:
+      struct session {
+        uint64_t id;
+        protocol::socket socket;
+        asio::streambuf in;
+        std::deque<std::string> outbox;
+        unsigned int threads = 1;
+
+        session(uint64_t id, protocol::socket socket) : id{id}, socket{std::move(socket)} {}
+      };
+      using session_ptr = std::shared_ptr<session>;
+
+      asio::basic_socket_acceptor<protocol> acceptor;
+      asio::steady_timer timer;
+      work_source& source;
+      clock::duration lease_timeout;
+      std::map<uint64_t, session_ptr> sessions;
+      std::map<uint64_t, lease> leases;
+      // Units whose leases ran out, which go out before any new ones
+      std::deque<std::string> reissue;
+      uint64_t next_session = 0, next_lease = 0;
+      bool exhausted = false, finished = false;
+
+      void accept() {
+        acceptor.async_accept([this](boost::system::error_code ec, protocol::socket socket) {
+          if (ec)
+            return;
+          auto s = std::make_shared<session>(next_session++, std::move(socket));
+          sessions.emplace(s->id, s);
+          RUBBISHRSA_LOG_INFO(std::cerr << "Worker " << s->id << " connected" << std::endl);
+          read(s);
+          accept();
+        });
+      }
+
+      void read(session_ptr s) {
+        asio::async_read_until(s->socket, s->in, '\n', [this, s](boost::system::error_code ec, size_t) {
+          if (ec) {
+            disconnect(s);
+            return;
+          }
+          std::string line;
+          std::istream is{&s->in};
+          std::getline(is, line);
+          // Only the worker's mistakes are caught, as anything else (such as a bad wordlist) is fatal
+          try {
+            handle(s, line);
+          }
+          catch (const protocol_error& e) {
+            RUBBISHRSA_LOG_INFO(std::cerr << "Dropping worker " << s->id << ": " << e.what() << std::endl);
+            boost::system::error_code ignored;
+            s->socket.close(ignored);
+          }
+          read(s);
+        });
+      }
+
+      void send(const session_ptr& s, std::string line) {
+        line.push_back('\n');
+        s->outbox.push_back(std::move(line));
+        if (s->outbox.size() == 1)
+          write(s);
+      }
+
+      void write(session_ptr s) {
+        asio::async_write(s->socket, asio::buffer(s->outbox.front()), [this, s](boost::system::error_code ec, size_t) {
+          // Errors are left to the reader to notice
+          if (ec)
+            return;
+          s->outbox.pop_front();
+          if (s->outbox.size())
+            write(s);
+          // Once the final word is out, there is nothing more to say
+          else if (finished) {
+            boost::system::error_code ignored;
+            s->socket.close(ignored);
+          }
+        });
+      }
+
+      std::optional<std::string> take_unit(unsigned int threads) {
+        if (reissue.size()) {
+          auto ret = std::move(reissue.front());
+          reissue.pop_front();
+          return ret;
+        }
+        if (exhausted)
+          return std::nullopt;
+        auto ret = source.next_unit(threads);
+        exhausted = !ret;
+        return ret;
+      }
+
+      void handle(const session_ptr& s, const std::string& line) {
+        std::istringstream ss{line};
+        std::string command;
+        ss >> command;
+
+        if (command == "hello") {
+          unsigned int threads;
+          if (!(ss >> threads))
+            throw protocol_error("Malformed hello");
+          s->threads = std::clamp(threads, 1u, max_worker_threads);
+          send(s, source.describe());
+        }
+        else if (command == "next") {
+          if (finished)
+            return;
+          if (auto unit = take_unit(s->threads)) {
+            auto id = next_lease++;
+            RUBBISHRSA_LOG_TRACE(std::cerr << "Leasing unit " << id << " to worker " << s->id << std::endl);
+            send(s, "unit " + std::to_string(id) + ' ' + *unit);
+            leases.emplace(id, lease{std::move(*unit), s->id, clock::now() + lease_timeout});
+          }
+          else if (leases.empty())
+            finish(std::nullopt);
+          else
+            send(s, "wait");
+        }
+        else if (command == "found") {
+          auto id = read_id(ss);
+          auto value = read_hex(ss);
+          if (source.check(value)) {
+            RUBBISHRSA_LOG_INFO(std::cerr << "Worker " << s->id << " succeeded" << std::endl);
+            finish(std::move(value));
+            return;
+          }
+          RUBBISHRSA_LOG_INFO(std::cerr << "Worker " << s->id << " reported a bad result, so its unit will be redone" << std::endl);
+          // Only its own unit, so that one worker cannot take another's away
+          if (auto iter = leases.find(id); iter != leases.end() && iter->second.session == s->id) {
+            reissue.push_back(std::move(iter->second.unit));
+            leases.erase(iter);
+          }
+        }
+        else if (command == "none") {
+          auto id = read_id(ss);
+          // A late report on a unit that has been reissued is ignored, as someone else is redoing it
+          if (auto iter = leases.find(id); iter != leases.end() && iter->second.session == s->id) {
+            std::string report;
+            std::getline(ss >> std::ws, report);
+            source.unit_done(iter->second.unit, report);
+            leases.erase(iter);
+          }
+          if (exhausted && reissue.empty() && leases.empty())
+            finish(std::nullopt);
+        }
+        else
+          throw protocol_error("Unknown command '" + command + "'");
+      }
+
+      void disconnect(const session_ptr& s) {
+        if (!sessions.erase(s->id))
+          return;
+        for (auto iter = leases.begin(); iter != leases.end();) {
+          if (iter->second.session == s->id) {
+            reissue.push_back(std::move(iter->second.unit));
+            iter = leases.erase(iter);
+          }
+          else
+            ++iter;
+        }
+        if (!finished)
+          RUBBISHRSA_LOG_INFO(std::cerr << "Worker " << s->id << " disconnected" << std::endl);
+      }
+
+      void expire_leases() {
+        timer.expires_after(std::chrono::seconds{1});
+        timer.async_wait([this](boost::system::error_code ec) {
+          if (ec)
+            return;
+          const auto now = clock::now();
+          for (auto iter = leases.begin(); iter != leases.end();) {
+            if (iter->second.deadline < now) {
+              RUBBISHRSA_LOG_INFO(std::cerr << "Worker " << iter->second.session << " ran out of time, so its unit will be reissued" << std::endl);
+              reissue.push_back(std::move(iter->second.unit));
+              iter = leases.erase(iter);
+            }
+            else
+              ++iter;
+          }
+          expire_leases();
+        });
+      }
+
+      void finish(std::optional<bigint> res) {
+        if (finished)
+          return;
+        finished = true;
+        result = std::move(res);
+        boost::system::error_code ignored;
+        acceptor.close(ignored);
+        timer.cancel();
+        // Everyone is told at once, so nobody keeps working on a solved problem
+        for (auto& [id, s] : sessions)
+          send(s, result ? "cancel" : "done");
+      }
+    };
+
+    struct unit_result {
+      std::optional<bigint> found;
+      std::string report;
+    };
+    using unit_processor = std::function<unit_result(std::istream&)>;
+
+    // Tries every candidate in a unit on a pool of threads, until one passes or we are cancelled
+    std::optional<bigint> parallel_find(unsigned int thread_count, const std::function<std::optional<bigint>(unsigned int)>& next,
+                                        const std::function<bool(const bigint&)>& test) {
+      std::vector<std::thread> pool;
+      std::atomic<bool> found = false;
+      std::optional<bigint> result;
+      for (unsigned int i = 0; i < thread_count; ++i) {
+        pool.emplace_back([&, i]() {
+          std::optional<bigint> candidate;
+          while (!found && (candidate = next(i))) {
+            if (test(*candidate) && !found.exchange(true))
+              result = candidate;
+          }
+        });
+      }
+      for (auto& thread : pool)
+        thread.join();
+      return result;
+    }
+
+    // Hands out first, first + threads, ... to thread 0, and so on, up to last
+    std::function<std::optional<bigint>(unsigned int)> strided_range(const bigint& first, const bigint& last, unsigned int thread_count,
+                                                                     const std::atomic<bool>& cancelled) {
+      auto cursors = std::make_shared<std::vector<bigint>>(thread_count);
+      std::iota(cursors->begin(), cursors->end(), first);
+      return [cursors, last, thread_count, &cancelled](unsigned int i) -> std::optional<bigint> {
+        auto& cursor = (*cursors)[i];
+        if (cancelled || cursor > last)
+          return std::nullopt;
+        auto ret = cursor;
+        cursor += thread_count;
+        return ret;
+      };
+    }
+
+    unit_processor make_processor(const std::string& job, unsigned int thread_count, const std::atomic<bool>& cancelled) {
+      std::istringstream ss{job};
+      std::string type;
+      ss >> type;
+
+      if (type == "range" || type == "list") {
+        auto pubkey = read_pubkey(ss);
+        auto c = read_hex(ss);
+        if (type == "range") {
+          return [=, &cancelled](std::istream& unit) -> unit_result {
+            auto first = read_hex(unit);
+            auto last = read_hex(unit);
+            return {attack::brute_force_ptext(pubkey, c, strided_range(first, last, thread_count, cancelled), thread_count), {}};
+          };
+        }
+        return [=, &cancelled](std::istream& unit) -> unit_result {
+          std::vector<bigint> candidates;
+          for (std::string token; unit >> token;)
+            candidates.push_back(hex2bigint(token));
+          std::vector<size_t> cursors(thread_count);
+          std::iota(cursors.begin(), cursors.end(), size_t{0});
+          return {attack::brute_force_ptext(pubkey, c, [&](unsigned int i) -> std::optional<bigint> {
+            if (cancelled || cursors[i] >= candidates.size())
+              return std::nullopt;
+            auto idx = cursors[i];
+            cursors[i] += thread_count;
+            return candidates[idx];
+          }, thread_count), {}};
+        };
+      }
+      if (type == "sig") {
+        auto pubkey = read_pubkey(ss);
+        auto msg = read_hex(ss);
+        bool allow_invisible;
+        ss >> allow_invisible;
+        return [=, &cancelled](std::istream& unit) -> unit_result {
+          auto first = read_hex(unit);
+          auto last = read_hex(unit);
+          return {parallel_find(thread_count, strided_range(first, last, thread_count, cancelled), [&](const bigint& guess) {
+            metrics::add(metrics::counter::sig_candidates);
+            auto verified = pubkey.raw_verify(guess);
+            return allow_invisible ? attack::equal_up_to_invisible(verified, msg) : verified == msg;
+          }), {}};
+        };
+      }
+      if (type == "rho") {
+        auto n = read_hex(ss);
+        return [=, &cancelled](std::istream& unit) -> unit_result {
+          uint64_t steps;
+          unit >> steps;
+          struct walk { std::string id; bigint x, y; unsigned long increment; bool cycled = false; };
+          std::vector<walk> walks;
+          for (std::string id; unit >> id;) {
+            // Each walk has its own polynomial, which its number tells us
+            size_t number;
+            const auto [end, ec] = std::from_chars(id.data(), id.data() + id.size(), number);
+            if (ec != std::errc{} || end != id.data() + id.size())
+              throw protocol_error("Bad walk '" + id + "'");
+            auto x = read_hex(unit);
+            auto y = read_hex(unit);
+            walks.push_back({std::move(id), std::move(x), std::move(y), pollard_rho_increment(number), false});
+          }
+
+          std::atomic<bool> found = false;
+          std::optional<bigint> result;
+          std::atomic<size_t> next_walk = 0;
+          std::vector<std::thread> pool;
+          for (unsigned int i = 0; i < std::min<size_t>(thread_count, walks.size()); ++i) {
+            pool.emplace_back([&]() {
+              for (size_t w; !found && (w = next_walk++) < walks.size();) {
+                // In chunks, so that a cancellation is noticed quickly
+                for (uint64_t done = 0; done < steps && !found && !cancelled; done += 4096) {
+                  auto factor = pollard_rho_steps(n, walks[w].x, walks[w].y, static_cast<uint_fast32_t>(std::min<uint64_t>(steps - done, 4096)), found, walks[w].increment);
+                  if (factor == n) {
+                    walks[w].cycled = true;
+                    break;
+                  }
+                  if (factor != 0 && !found.exchange(true))
+                    result = std::move(factor);
+                }
+              }
+            });
+          }
+          for (auto& thread : pool)
+            thread.join();
+
+          std::string report;
+          for (auto& w : walks)
+            if (!w.cycled)
+              report += w.id + ' ' + hex(w.x) + ' ' + hex(w.y) + ' ';
+          return {std::move(result), std::move(report)};
+        };
+      }
+      throw protocol_error("Unknown job type '" + type + "'");
+    }
+  }
+
+  std::unique_ptr<work_source> range_source(const public_key& pubkey, const bigint& encrypted_message,
+                                            bigint min, bigint max, uint64_t unit_size) {
+    return std::make_unique<ptext_range_source>(pubkey, encrypted_message, std::move(min), std::move(max), unit_size);
+  }
+
+  std::unique_ptr<work_source> list_source(const public_key& pubkey, const bigint& encrypted_message,
+                                           std::istream& in, bool convert_hex_to_num, uint64_t unit_size) {
+    return std::make_unique<ptext_list_source>(pubkey, encrypted_message, in, convert_hex_to_num, unit_size);
+  }
+
+  std::unique_ptr<work_source> sig_source(const public_key& pubkey, bigint msg, bool allow_invisible, uint64_t unit_size) {
+    return std::make_unique<sig_range_source>(pubkey, std::move(msg), allow_invisible, unit_size);
+  }
+
+  std::unique_ptr<work_source> rho_source(const bigint& n, uint64_t unit_size) {
+    return std::make_unique<rho_walk_source>(n, unit_size);
+  }
+
+  std::optional<bigint> coordinate(const std::string& address, work_source& source, std::chrono::seconds lease_timeout) {
+    asio::io_context io;
+    auto endpoint = resolve(io, address);
+    const bool is_unix = address.starts_with(unix_prefix);
+    // Clear away the socket from any previous run, or else we cannot bind
+    if (is_unix)
+      std::filesystem::remove(address.substr(unix_prefix.size()));
+
+    coordinator c{io, endpoint, source, lease_timeout};
+    RUBBISHRSA_LOG_INFO(std::cerr << "Waiting for workers on " << address << std::endl);
+    io.run();
+
+    if (is_unix)
+      std::filesystem::remove(address.substr(unix_prefix.size()));
+    return c.result;
+  }
+
+  void work(const std::string& address, unsigned int thread_count) {
+    if (!thread_count)
+      thread_count = std::thread::hardware_concurrency();
+
+    asio::io_context io;
+    protocol::socket socket{io};
+    socket.connect(resolve(io, address));
+
+    // Messages are read on the io thread, so that a cancellation gets through even while we are busy
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::string> inbox;
+    bool closed = false;
+    std::atomic<bool> cancelled = false;
+    asio::streambuf buf;
+
+    std::function<void()> read = [&]() {
+      asio::async_read_until(socket, buf, '\n', [&](boost::system::error_code ec, size_t) {
+        std::unique_lock lock{mutex};
+        if (ec) {
+          closed = true;
+          cancelled = true;
+          cv.notify_all();
+          return;
+        }
+        std::string line;
+        std::istream is{&buf};
+        std::getline(is, line);
+        if (line == "cancel" || line == "done")
+          cancelled = true;
+        inbox.push_back(std::move(line));
+        cv.notify_all();
+        lock.unlock();
+        read();
+      });
+    };
+    read();
+    std::thread io_thread{[&]() { io.run(); }};
+
+    auto send = [&](std::string line) {
+      line.push_back('\n');
+      asio::post(io, [&socket, line = std::move(line)]() {
+        boost::system::error_code ignored;
+        asio::write(socket, asio::buffer(line), ignored);
+      });
+    };
+    auto receive = [&]() -> std::optional<std::string> {
+      std::unique_lock lock{mutex};
+      cv.wait(lock, [&]() { return inbox.size() || closed; });
+      if (inbox.empty())
+        return std::nullopt;
+      auto ret = std::move(inbox.front());
+      inbox.pop_front();
+      return ret;
+    };
+    auto hang_up = [&]() {
+      asio::post(io, [&]() {
+        boost::system::error_code ignored;
+        socket.close(ignored);
+      });
+      io_thread.join();
+    };
+
+    try {
+      send("hello " + std::to_string(thread_count));
+      auto job = receive();
+      if (!job || cancelled)
+        throw protocol_error("The coordinator hung up before giving us a job");
+      RUBBISHRSA_LOG_TRACE(std::cerr << "Got job " << job->substr(0, job->find(' ')) << std::endl);
+      auto process = make_processor(*job, thread_count, cancelled);
+
+      while (true) {
+        send("next");
+        auto message = receive();
+        if (!message || cancelled)
+          break;
+
+        std::istringstream ss{*message};
+        std::string command;
+        ss >> command;
+        if (command == "wait") {
+          // Everything is leased out, but a lease might yet come back
+          std::unique_lock lock{mutex};
+          cv.wait_for(lock, std::chrono::milliseconds{250}, [&]() { return cancelled.load(); });
+          continue;
+        }
+        if (command != "unit")
+          throw protocol_error("Unexpected message '" + command + "' from the coordinator");
+
+        std::string id;
+        ss >> id;
+        auto result = process(ss);
+        if (result.found)
+          send("found " + id + ' ' + hex(*result.found));
+        else if (!cancelled)
+          send("none " + id + ' ' + result.report);
+      }
+    }
+    catch (...) {
+      hang_up();
+      throw;
+    }
+    hang_up();
+  }
+}
@@ -0,0 +1,354 @@
+#include <rubbishrsa/factordb.hpp>
+
+#include <rubbishrsa/keystore.hpp>
+#include <rubbishrsa/log.hpp>
+#include <rubbishrsa/maths.hpp>
+#include <rubbishrsa/metrics.hpp>
+
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/interprocess/sync/sharable_lock.hpp>
+
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+namespace bip = boost::interprocess;
+
+namespace rubbishrsa {
+  namespace {
+    constexpr char factor_db_magic[8] = {'R', 'B', 'R', 'S', 'A', 'F', 'D', '\0'};
+    constexpr uint32_t factor_db_version = 1;
+    constexpr uint64_t initial_capacity = 1024;
+
+    // Fingerprints of real moduli are as good as random, but those of toy ones are not, and all sit in the same
+    // corner of the table. splitmix64's finaliser spreads them out
+    uint64_t slot_hash(uint64_t fingerprint) {
+      fingerprint ^= fingerprint >> 30;
+      fingerprint *= 0xbf58476d1ce4e5b9;
+      fingerprint ^= fingerprint >> 27;
+      fingerprint *= 0x94d049bb133111eb;
+      fingerprint ^= fingerprint >> 31;
+      return fingerprint;
+    }
+
+    bool valid_factors(const bigint& n, const bigint& p, const bigint& q) {
+      return p > 1 && q > 1 && p * q == n;
+    }
+
+    // Splits a line into exactly three hex numbers, which are checked to be a modulus and its factors
+    template<typename Record>
+    std::optional<Record> parse_line(std::string_view line) {
+      std::string_view fields[3];
+      for (auto& field : fields) {
+        const auto start = line.find_first_not_of(' ');
+        if (start == line.npos)
+          return std::nullopt;
+        line.remove_prefix(start);
+        const auto end = std::min(line.find(' '), line.size());
+        field = line.substr(0, end);
+        line.remove_prefix(end);
+      }
+      if (line.find_first_not_of(' ') != line.npos)
+        return std::nullopt;
+
+      Record ret;
+      try {
+        hex2bigint(fields[0], ret.n);
+        hex2bigint(fields[1], ret.p);
+        hex2bigint(fields[2], ret.q);
+      }
+      catch (const std::invalid_argument&) {
+        return std::nullopt;
+      }
+      if (!valid_factors(ret.n, ret.p, ret.q))
+        return std::nullopt;
+      return ret;
+    }
+
+    std::string format_line(const bigint& n, const bigint& p, const bigint& q) {
+      return n.str(0, std::ios::hex) + ' ' + p.str(0, std::ios::hex) + ' ' + q.str(0, std::ios::hex) + '\n';
+    }
+
+    // Creates the file if it is not there, without touching it if it is
+    void touch(const std::string& path) {
+      if (!std::ofstream{path, std::ios::app | std::ios::binary})
+        throw std::runtime_error("Could not create '" + path + "'");
+    }
+  }
+
+  factor_db::factor_db(const std::string& path) : log_path{path}, index_path{path + ".idx"} {
+    const auto lock_path = path + ".lock";
+    touch(lock_path);
+    touch(log_path);
+    touch(index_path);
+    lock = bip::file_lock{lock_path.c_str()};
+
+    log_in.open(log_path, std::ios::binary);
+    log_out.open(log_path, std::ios::app | std::ios::binary);
+    if (!log_in || !log_out)
+      throw std::runtime_error("Could not open '" + log_path + "'");
+
+    std::unique_lock guard{mutex};
+    bip::scoped_lock<bip::file_lock> file_guard{lock};
+    index_file = bip::file_mapping{index_path.c_str(), bip::read_write};
+    if (!index_valid()) {
+      if (std::filesystem::file_size(index_path))
+        RUBBISHRSA_LOG_INFO(std::cerr << "Rebuilding the malformed factor database index at '" << index_path << '\'' << std::endl);
+      reset(initial_capacity);
+    }
+    catch_up();
+  }
+
+  factor_db::header& factor_db::index_header() {
+    return *static_cast<header*>(index_region.get_address());
+  }
+
+  factor_db::slot* factor_db::slots() {
+    return reinterpret_cast<slot*>(static_cast<char*>(index_region.get_address()) + sizeof(header));
+  }
+
+  bool factor_db::index_valid() {
+    const auto size = std::filesystem::file_size(index_path);
+    if (size < sizeof(header))
+      return false;
+    index_region = bip::mapped_region{index_file, bip::read_write};
+    const auto& head = index_header();
+    return !std::memcmp(head.magic, factor_db_magic, sizeof(factor_db_magic))
+           && head.version == factor_db_version
+           && std::has_single_bit(head.capacity)
+           && head.count < head.capacity
+           && size >= sizeof(header) + head.capacity * sizeof(slot);
+  }
+
+  void factor_db::remap_if_grown() {
+    // Someone else grew the index since we mapped it. The header is always in our mapping, so we can tell
+    if (index_region.get_size() < sizeof(header) + index_header().capacity * sizeof(slot))
+      index_region = bip::mapped_region{index_file, bip::read_write};
+  }
+
+  uint64_t factor_db::log_size() {
+    return std::filesystem::file_size(log_path);
+  }
+
+  std::optional<factor_db::record> factor_db::read_record(uint64_t offset) {
+    log_in.clear();
+    log_in.seekg(static_cast<std::streamoff>(offset));
+    std::string line;
+    if (!std::getline(log_in, line))
+      return std::nullopt;
+    return parse_line<record>(line);
+  }
+
+  template<typename Func>
+  uint64_t factor_db::for_each_record(uint64_t from, Func&& func) {
+    log_in.clear();
+    log_in.seekg(static_cast<std::streamoff>(from));
+    uint64_t pos = from;
+    for (std::string line; std::getline(log_in, line);) {
+      // The last line has no newline if its writer died halfway through writing it, and it is ignored until the
+      // next addition terminates it (making it a malformed line, which are always skipped)
+      if (log_in.eof())
+        break;
+      if (auto rec = parse_line<record>(line))
+        func(pos, std::move(*rec));
+      else if (line.size())
+        RUBBISHRSA_LOG_TRACE(std::cerr << "Skipping malformed factor database line at offset " << pos << std::endl);
+      pos += line.size() + 1;
+    }
+    return pos;
+  }
+
+  std::optional<factor_db::record> factor_db::find_indexed(const bigint& n) {
+    const auto fingerprint = keystore::fingerprint(n);
+    const auto& head = index_header();
+    const auto mask = head.capacity - 1;
+    const auto* table = slots();
+    for (auto i = slot_hash(fingerprint) & mask; table[i].offset_plus_one; i = (i + 1) & mask) {
+      if (table[i].fingerprint != fingerprint)
+        continue;
+      if (auto rec = read_record(table[i].offset_plus_one - 1); rec && rec->n == n)
+        return rec;
+    }
+    return std::nullopt;
+  }
+
+  std::optional<factor_db::record> factor_db::find_locked(const bigint& n) {
+    remap_if_grown();
+    if (auto rec = find_indexed(n))
+      return rec;
+
+    // Anything a crashed writer left unindexed is still in the log, and is found (slowly) until it is indexed
+    std::optional<record> ret;
+    if (const auto indexed_bytes = index_header().indexed_bytes; indexed_bytes < log_size()) {
+      for_each_record(indexed_bytes, [&](uint64_t, record&& rec) {
+        if (!ret && rec.n == n)
+          ret = std::move(rec);
+      });
+    }
+    return ret;
+  }
+
+  void factor_db::catch_up() {
+    remap_if_grown();
+    if (index_header().indexed_bytes > log_size()) {
+      // The log has been replaced from under the index
+      RUBBISHRSA_LOG_INFO(std::cerr << "The factor database log has shrunk, so rebuilding its index" << std::endl);
+      reset(initial_capacity);
+    }
+    // Only the first line for each modulus is indexed, so that a modulus merged in twice is not counted twice
+    std::vector<std::pair<uint64_t, record>> fresh;
+    const auto end = for_each_record(index_header().indexed_bytes, [&](uint64_t offset, record&& rec) {
+      fresh.emplace_back(offset, std::move(rec));
+    });
+    for (auto& [offset, rec] : fresh)
+      if (!find_indexed(rec.n))
+        insert(keystore::fingerprint(rec.n), offset);
+    index_header().indexed_bytes = end;
+  }
+
+  void factor_db::reset(uint64_t capacity) {
+    std::filesystem::resize_file(index_path, sizeof(header) + capacity * sizeof(slot));
+    index_region = bip::mapped_region{index_file, bip::read_write};
+    std::memset(index_region.get_address(), 0, index_region.get_size());
+    auto& head = index_header();
+    std::memcpy(head.magic, factor_db_magic, sizeof(factor_db_magic));
+    head.version = factor_db_version;
+    head.capacity = capacity;
+  }
+
+  void factor_db::grow() {
+    const auto old_capacity = index_header().capacity;
+    const auto indexed_bytes = index_header().indexed_bytes;
+    std::vector<slot> old;
+    old.reserve(index_header().count);
+    for (uint64_t i = 0; i < old_capacity; ++i)
+      if (slots()[i].offset_plus_one)
+        old.push_back(slots()[i]);
+
+    reset(old_capacity * 2);
+    for (const auto& s : old)
+      insert(s.fingerprint, s.offset_plus_one - 1);
+    index_header().indexed_bytes = indexed_bytes;
+  }
+
+  void factor_db::insert(uint64_t fingerprint, uint64_t offset) {
+    // Linear probing stays quick up to about half full
+    if ((index_header().count + 1) * 2 > index_header().capacity)
+      grow();
+    auto& head = index_header();
+    const auto mask = head.capacity - 1;
+    auto* table = slots();
+    auto i = slot_hash(fingerprint) & mask;
+    while (table[i].offset_plus_one)
+      i = (i + 1) & mask;
+    table[i] = {fingerprint, offset + 1};
+    ++head.count;
+  }
+
+  bool factor_db::add_locked(const bigint& n, const bigint& p, const bigint& q) {
+    if (!valid_factors(n, p, q))
+      throw std::invalid_argument("These are not the factors of the modulus!");
+
+    catch_up();
+    if (find_indexed(n))
+      return false;
+
+    auto offset = log_size();
+    std::string line = format_line(n, p, q);
+    // Terminating a half written line keeps it from swallowing ours
+    if (offset != index_header().indexed_bytes) {
+      log_in.clear();
+      log_in.seekg(static_cast<std::streamoff>(offset - 1));
+      if (log_in.get() != '\n') {
+        line.insert(line.begin(), '\n');
+        ++offset;
+      }
+    }
+    log_out << line << std::flush;
+    if (!log_out)
+      throw std::runtime_error("Could not write to '" + log_path + "'");
+
+    if (line.front() == '\n')
+      line.erase(line.begin());
+    insert(keystore::fingerprint(n), offset);
+    index_header().indexed_bytes = offset + line.size();
+    return true;
+  }
+
+  std::optional<std::pair<bigint, bigint>> factor_db::find(const bigint& n) {
+    std::unique_lock guard{mutex};
+    bip::sharable_lock<bip::file_lock> file_guard{lock};
+    auto rec = find_locked(n);
+    if (!rec)
+      return std::nullopt;
+    return std::pair{std::move(rec->p), std::move(rec->q)};
+  }
+
+  bool factor_db::add(const bigint& n, const bigint& p, const bigint& q) {
+    std::unique_lock guard{mutex};
+    bip::scoped_lock<bip::file_lock> file_guard{lock};
+    return add_locked(n, p, q);
+  }
+
+  void factor_db::export_to(std::ostream& os) {
+    std::unique_lock guard{mutex};
+    bip::sharable_lock<bip::file_lock> file_guard{lock};
+    for_each_record(0, [&](uint64_t, record&& rec) {
+      os << format_line(rec.n, rec.p, rec.q);
+    });
+  }
+
+  size_t factor_db::import_from(std::istream& is) {
+    // One lock for the lot, rather than one for each line
+    std::unique_lock guard{mutex};
+    bip::scoped_lock<bip::file_lock> file_guard{lock};
+    size_t added = 0;
+    size_t line_no = 0;
+    for (std::string line; std::getline(is, line);) {
+      ++line_no;
+      if (line.find_first_not_of(" \r") == line.npos)
+        continue;
+      if (line.back() == '\r')
+        line.pop_back();
+      auto rec = parse_line<record>(line);
+      if (!rec)
+        throw std::invalid_argument("Line " + std::to_string(line_no) + " is not a modulus and its factors");
+      added += add_locked(rec->n, rec->p, rec->q);
+    }
+    return added;
+  }
+
+  size_t factor_db::size() {
+    std::unique_lock guard{mutex};
+    bip::sharable_lock<bip::file_lock> file_guard{lock};
+    remap_if_grown();
+    return index_header().count;
+  }
+
+  namespace {
+    std::mutex active_mutex;
+    std::shared_ptr<factor_db> active;
+  }
+
+  void use_factor_db(std::shared_ptr<factor_db> db) {
+    std::unique_lock guard{active_mutex};
+    active = std::move(db);
+  }
+
+  std::shared_ptr<factor_db> active_factor_db() {
+    std::unique_lock guard{active_mutex};
+    return active;
+  }
+
+  void remember_factors(factor_db& db, const bigint& n, const bigint& p, const bigint& q) {
+    try {
+      db.add(n, p, q);
+    }
+    catch (const std::exception& e) {
+      RUBBISHRSA_LOG_INFO(std::cerr << "Could not add the factors to the factor database: " << e.what() << std::endl);
+    }
+  }
+}
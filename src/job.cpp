@@ -0,0 +1,79 @@
+#include <rubbishrsa/job.hpp>
+
+#include <algorithm>
+
+namespace rubbishrsa {
+  job_control::link_guard::~link_guard() {
+    if (!job)
+      return;
+    std::unique_lock lock{job->link_mutex};
+    job->links.erase(std::find(job->links.begin(), job->links.end(), flag));
+  }
+
+  job_control::job_control(job_options opts) : options{std::move(opts)} {
+    if (options.deadline) {
+      watchdog = std::thread{[this]() {
+        std::unique_lock lock{watchdog_mutex};
+        if (!watchdog_cv.wait_until(lock, *options.deadline, [this]() { return finishing; })) {
+          timed_out = true;
+          lock.unlock();
+          request_stop();
+        }
+      }};
+    }
+    if (options.stop.stop_possible())
+      on_stop.emplace(options.stop, stopper{this});
+  }
+
+  job_control::~job_control() {
+    // Unregister first, so that the callback cannot run whilst we are being torn down
+    on_stop.reset();
+    if (watchdog.joinable()) {
+      {
+        std::unique_lock lock{watchdog_mutex};
+        finishing = true;
+      }
+      watchdog_cv.notify_all();
+      watchdog.join();
+    }
+  }
+
+  void job_control::request_stop() {
+    std::unique_lock lock{link_mutex};
+    stop_flag = true;
+    for (auto* flag : links)
+      flag->store(true);
+  }
+
+  void job_control::throw_if_stopped() const {
+    if (!stopped())
+      return;
+    if (timed_out)
+      throw deadline_exceeded("The job ran past its deadline");
+    throw job_cancelled("The job was cancelled");
+  }
+
+  job_control::link_guard job_control::link(std::atomic<bool>& flag) {
+    std::unique_lock lock{link_mutex};
+    links.push_back(&flag);
+    if (stop_flag)
+      flag = true;
+    return {this, &flag};
+  }
+
+  void job_control::add_progress(uint64_t n) {
+    const auto total = done.fetch_add(n, std::memory_order_relaxed) + n;
+    if (!options.on_progress)
+      return;
+
+    // Only one thread reports at a time, and nobody waits for it
+    std::unique_lock lock{progress_mutex, std::try_to_lock};
+    if (!lock)
+      return;
+    const auto now = clock::now();
+    if (now < next_report)
+      return;
+    next_report = now + options.progress_interval;
+    options.on_progress({total, now - start});
+  }
+}
@@ -1,73 +1,719 @@
 #include <rubbishrsa/keys.hpp>
 
 #include <rubbishrsa/log.hpp>
+#include <rubbishrsa/metrics.hpp>
 
 #include <boost/property_tree/json_parser.hpp>
 
 #include <boost/multiprecision/miller_rabin.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/random_device.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cmath>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <thread>
 
 namespace rubbishrsa {
+  namespace {
+    // A tiny subset of DER, which is all PKCS#1 needs: positive INTEGERs inside a SEQUENCE
+
+    constexpr unsigned char der_integer_tag = 0x02;
+    constexpr unsigned char der_sequence_tag = 0x30;
+
+    void der_put_header(std::string& out, unsigned char tag, size_t len) {
+      out.push_back(static_cast<char>(tag));
+      if (len < 0x80) {
+        out.push_back(static_cast<char>(len));
+        return;
+      }
+      // Long form: the number of length bytes, then the length in big endian
+      unsigned char buf[sizeof(size_t)];
+      size_t n_bytes = 0;
+      for (; len; len >>= 8)
+        buf[n_bytes++] = static_cast<unsigned char>(len & 0xFF);
+      out.push_back(static_cast<char>(0x80 | n_bytes));
+      while (n_bytes)
+        out.push_back(static_cast<char>(buf[--n_bytes]));
+    }
+
+    void der_put_integer(std::string& out, const bigint& i) {
+      if (i < 0)
+        throw std::invalid_argument("Cannot encode a negative key component!");
+
+      // Export the limbs straight to big endian bytes, rather than going through a decimal string
+      const size_t n_bytes = byte_length(i);
+      // A leading zero is needed if the top bit is set, or else it would be read as negative
+      std::string body(n_bytes + 1, '\0');
+      bigint2ascii(i, std::span{body}.subspan(1));
+      std::string_view content = body;
+      if (n_bytes && !(static_cast<unsigned char>(body[1]) & 0x80))
+        content.remove_prefix(1);
+
+      der_put_header(out, der_integer_tag, content.size());
+      out += content;
+    }
+
+    std::string der_sequence(std::initializer_list<const bigint*> items) {
+      std::string body;
+      for (auto* i : items)
+        der_put_integer(body, *i);
+      std::string out;
+      der_put_header(out, der_sequence_tag, body.size());
+      return out + body;
+    }
+
+    struct der_reader {
+      std::string_view data;
+
+      bool empty() const { return data.empty(); }
+
+      // Reads a tag and length, and returns the contents
+      std::string_view read(unsigned char expected_tag) {
+        if (data.size() < 2 || static_cast<unsigned char>(data[0]) != expected_tag)
+          throw std::invalid_argument("Malformed DER key: unexpected tag");
+        size_t len = static_cast<unsigned char>(data[1]);
+        size_t pos = 2;
+        if (len & 0x80) {
+          size_t n_bytes = len & 0x7F;
+          if (n_bytes == 0 || n_bytes > sizeof(size_t) || data.size() < pos + n_bytes)
+            throw std::invalid_argument("Malformed DER key: bad length");
+          len = 0;
+          for (size_t i = 0; i < n_bytes; ++i)
+            len = (len << 8) | static_cast<unsigned char>(data[pos++]);
+        }
+        if (data.size() - pos < len)
+          throw std::invalid_argument("Malformed DER key: truncated");
+        auto ret = data.substr(pos, len);
+        data.remove_prefix(pos + len);
+        return ret;
+      }
+
+      der_reader read_sequence() {
+        return {read(der_sequence_tag)};
+      }
+
+      bigint read_integer() {
+        auto content = read(der_integer_tag);
+        if (content.empty() || (static_cast<unsigned char>(content[0]) & 0x80))
+          throw std::invalid_argument("Malformed DER key: key components must be positive");
+        // Import the big endian bytes directly into the limbs
+        return ascii2bigint(content);
+      }
+    };
+
+    constexpr std::string_view base64_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    std::string base64_encode(std::string_view in) {
+      std::string out;
+      out.reserve((in.size() + 2) / 3 * 4);
+      for (size_t i = 0; i < in.size(); i += 3) {
+        uint_fast32_t chunk = static_cast<unsigned char>(in[i]) << 16;
+        if (i + 1 < in.size()) chunk |= static_cast<unsigned char>(in[i + 1]) << 8;
+        if (i + 2 < in.size()) chunk |= static_cast<unsigned char>(in[i + 2]);
+        out.push_back(base64_chars[(chunk >> 18) & 0x3F]);
+        out.push_back(base64_chars[(chunk >> 12) & 0x3F]);
+        out.push_back(i + 1 < in.size() ? base64_chars[(chunk >> 6) & 0x3F] : '=');
+        out.push_back(i + 2 < in.size() ? base64_chars[chunk & 0x3F] : '=');
+      }
+      return out;
+    }
+
+    std::string base64_decode(std::string_view in) {
+      std::string out;
+      out.reserve(in.size() / 4 * 3);
+      uint_fast32_t chunk = 0;
+      size_t n_bits = 0;
+      for (char c : in) {
+        if (c == '=')
+          break;
+        auto pos = base64_chars.find(c);
+        // Line breaks and other whitespace are allowed anywhere
+        if (pos == std::string_view::npos) {
+          if (std::isspace(static_cast<unsigned char>(c)))
+            continue;
+          throw std::invalid_argument("Malformed PEM key: invalid base64");
+        }
+        chunk = (chunk << 6) | pos;
+        n_bits += 6;
+        if (n_bits >= 8) {
+          n_bits -= 8;
+          out.push_back(static_cast<char>((chunk >> n_bits) & 0xFF));
+        }
+      }
+      return out;
+    }
+
+    constexpr std::string_view pubkey_pem_label = "RSA PUBLIC KEY";
+    constexpr std::string_view privkey_pem_label = "RSA PRIVATE KEY";
+
+    std::string pem_wrap(std::string_view label, std::string_view der) {
+      auto b64 = base64_encode(der);
+      std::string out = "-----BEGIN ";
+      out += label;
+      out += "-----\n";
+      // PEM lines are 64 chars long
+      for (size_t i = 0; i < b64.size(); i += 64) {
+        out += std::string_view{b64}.substr(i, 64);
+        out.push_back('\n');
+      }
+      out += "-----END ";
+      out += label;
+      out += "-----\n";
+      return out;
+    }
+
+    // Returns the DER inside the PEM block, and which label it had
+    std::pair<std::string, std::string> pem_unwrap(std::string_view pem) {
+      constexpr std::string_view begin = "-----BEGIN ";
+      auto start = pem.find(begin);
+      if (start == std::string_view::npos)
+        throw std::invalid_argument("Malformed PEM key: missing header");
+      auto label_end = pem.find("-----", start + begin.size());
+      if (label_end == std::string_view::npos)
+        throw std::invalid_argument("Malformed PEM key: missing header");
+      std::string label{pem.substr(start + begin.size(), label_end - start - begin.size())};
+      auto body_start = label_end + 5;
+      auto body_end = pem.find("-----END " + label + "-----", body_start);
+      if (body_end == std::string_view::npos)
+        throw std::invalid_argument("Malformed PEM key: missing footer");
+      return {base64_decode(pem.substr(body_start, body_end - body_start)), std::move(label)};
+    }
+
+    key_format detect_format(std::string_view data) {
+      auto first = data.find_first_not_of(" \t\r\n");
+      if (first == std::string_view::npos)
+        throw std::invalid_argument("Empty key file");
+      if (data[first] == '{')
+        return key_format::json;
+      if (data.substr(first, 5) == "-----")
+        return key_format::pem;
+      return key_format::der;
+    }
+
+    // Returns the PKCS#1 DER from either a DER or PEM file
+    std::string read_der(std::string data, key_format format) {
+      if (format == key_format::der)
+        return data;
+      auto [der, label] = pem_unwrap(data);
+      if (label != pubkey_pem_label && label != privkey_pem_label)
+        throw std::invalid_argument("Unsupported PEM key type '" + label + "'");
+      return der;
+    }
+
+    std::string read_all(std::istream& is) {
+      return {std::istreambuf_iterator<char>{is}, std::istreambuf_iterator<char>{}};
+    }
+  }
+
+  namespace {
+    // Works out the CRT parameters of the primes, which are in PKCS#1 order
+    std::vector<crt_prime> crt_primes(std::vector<bigint> primes, const bigint& d) {
+      std::vector<crt_prime> ret;
+      ret.reserve(primes.size());
+      for (auto& prime : primes) {
+        bigint exponent = d % (prime - 1);
+        ret.push_back({std::move(prime), std::move(exponent), 0});
+      }
+      // The second prime is where the CRT starts, so it needs no coefficient
+      ret[0].coefficient = modinv(ret[1].prime % ret[0].prime, ret[0].prime);
+      bigint product = ret[0].prime * ret[1].prime;
+      for (size_t i = 2; i < ret.size(); ++i) {
+        ret[i].coefficient = modinv(product % ret[i].prime, ret[i].prime);
+        product *= ret[i].prime;
+      }
+      return ret;
+    }
+
+    // Checks that the primes multiply up to n, and that each exponent and coefficient is what crt_primes would give
+    bool crt_consistent(std::span<const crt_prime> primes, const bigint& n, const bigint& d) {
+      if (primes.size() < 2 || primes[1].coefficient != 0)
+        return false;
+      bigint product = primes[1].prime;
+      for (size_t i = 0; i < primes.size(); ++i) {
+        const auto& r = primes[i];
+        if (r.prime < 2 || r.exponent != d % (r.prime - 1))
+          return false;
+        if (i == 1)
+          continue;
+        if ((r.coefficient * product) % r.prime != 1)
+          return false;
+        product *= r.prime;
+      }
+      return product == n;
+    }
+  }
+
   private_key private_key::from_factors(const bigint& p, const bigint& q, bigint e) {
+    return from_primes({p, q}, std::move(e));
+  }
+
+  private_key private_key::from_primes(std::vector<bigint> primes, bigint e) {
+    if (primes.size() < 2)
+      throw std::invalid_argument("A key needs at least two primes!");
+    auto sorted = primes;
+    std::sort(sorted.begin(), sorted.end());
+    if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end())
+      throw std::invalid_argument("The primes of a key must all be different!");
+    // A composite would still multiply up to n, but the CRT would then give the wrong answers. A few rounds are
+    // plenty, as the usual culprit is a cofactor left over from splitting a modulus with more than two primes
+    for (const auto& prime : primes)
+      if (!is_prime(prime, 4))
+        throw std::invalid_argument("The primes of a key must all be prime!");
+    // By convention, p is the larger factor
+    if (primes[0] < primes[1])
+      std::swap(primes[0], primes[1]);
+
     // We can now start filling in our result
     private_key ret;
-    ret.n = p * q;
+    ret.n = 1;
+    bigint lambda_n = 1;
+    for (const auto& prime : primes) {
+      ret.n *= prime;
+      lambda_n = lcm(lambda_n, prime - 1);
+    }
     // This is automatically done
     ret.e = e;
-
-    auto lambda_n = carmichael_semiprime(p, q);
     ret.d = modinv(ret.e, lambda_n); // $d \equiv e^{-1} \pmod{\lambda(n)}$
-
+    ret.primes = crt_primes(std::move(primes), ret.d);
 
     return ret;
   }
 
-  private_key private_key::generate(uint_fast16_t bits) {
-    // Apparently we should differ in lengths by a few digits
-    // this will differ in length by log10(2^8) = ~3 digits
-    auto p = generate_prime(bits / 2 + 4);
-    auto q = generate_prime(bits / 2 - 3);
+  private_key private_key::generate(uint_fast16_t bits, unsigned int prime_count) {
+    if (prime_count < 2)
+      throw std::invalid_argument("A key needs at least two primes!");
+    if (prime_count > 2 && bits / prime_count < 16)
+      throw std::invalid_argument("There are too many primes for a key that small!");
+
+    std::vector<uint_fast16_t> sizes;
+    if (prime_count == 2) {
+      // Apparently we should differ in lengths by a few digits
+      // this will differ in length by log10(2^8) = ~3 digits
+      sizes = {static_cast<uint_fast16_t>(bits / 2 + 4), static_cast<uint_fast16_t>(bits / 2 - 3)};
+    }
+    else {
+      // Spreading out the spare bits is enough to keep them apart
+      for (unsigned int i = 0; i < prime_count; ++i)
+        sizes.push_back(bits / prime_count + (i < bits % prime_count));
+    }
+
+    // e has to be invertible mod each prime - 1, which rules out about 1 in e primes
+    const bigint e = public_key{}.e;
+    auto find_prime = [&](uint_fast16_t size, unsigned int thread_count) {
+      bigint ret;
+      do
+        ret = generate_prime(size, thread_count);
+      while (egcd(e, ret - 1).gcd != 1);
+      return ret;
+    };
+
+    // Each prime gets its share of the cores, which finishes sooner than searching for them one at a time on
+    // every core, as each search only checks for a winner once per candidate
+    std::vector<bigint> primes(prime_count);
+    const auto threads_per_prime = std::max(1u, std::thread::hardware_concurrency() / prime_count);
+    std::vector<std::thread> pool;
+    for (unsigned int i = 0; i < prime_count; ++i)
+      pool.emplace_back([&, i]() { primes[i] = find_prime(sizes[i], threads_per_prime); });
+    for (auto& thread : pool)
+      thread.join();
+    // Only small primes stand any chance of coming up twice
+    for (size_t i = 1; i < primes.size(); ++i)
+      while (std::find(primes.begin(), primes.begin() + i, primes[i]) != primes.begin() + i)
+        primes[i] = find_prime(sizes[i], 0);
+
+    RUBBISHRSA_LOG_INFO(
+      std::cerr << "primes = (";
+      for (size_t i = 0; i < primes.size(); ++i)
+        std::cerr << (i ? ", " : "") << primes[i].str();
+      std::cerr << ')' << std::endl
+    );
+
+    // Now we have good primes, we can pass them along
+    return private_key::from_primes(std::move(primes), e);
+  }
+
+  bigint private_key::exponentiate_crt(const bigint& x) const {
+    metrics::scoped_timer timer{metrics::phase::crt};
+    // Garner's recombination: with m correct mod R (the product of the primes so far), adding in the next prime
+    // r gives m + R * (coefficient * (m_r - m) mod r), which is correct mod R * r
+    const auto& base = primes[1];
+    bigint m = bmp::powm(x, base.exponent, base.prime);
+    bigint product = base.prime;
+    bigint h;
+    for (size_t i = 0; i < primes.size(); ++i) {
+      if (i == 1)
+        continue;
+      const auto& r = primes[i];
+      h = bmp::powm(x, r.exponent, r.prime);
+      h -= m;
+      h *= r.coefficient;
+      h %= r.prime;
+      if (h < 0)
+        h += r.prime;
+      h *= product;
+      m += h;
+      if (i + 1 < primes.size())
+        product *= r.prime;
+    }
+    return m;
+  }
+
+  namespace {
+    // Roughly how many multiplications (mod n) it takes to raise to an exponent: a squaring for each bit,
+    // and a multiplication for each set bit
+    double powm_cost(size_t exponent_bits, size_t exponent_weight) {
+      return static_cast<double>(exponent_bits + exponent_weight);
+    }
+    double powm_cost(const bigint& exponent) {
+      return powm_cost(floor_log2(exponent) + 1, mpz_popcount(exponent.backend().data()));
+    }
+
+    // Roughly how many multiplications (mod n) per signature it takes to screen a batch of this size
+    //
+    // This follows what multi_powm does for each side of the check. GMP's powm reduces more cheaply than
+    // multi_powm's multiply-then-divide, so the multiplications of the screen are counted as a third dearer.
+    // Each sign round multiplies up about half of each side, and raises one of them to e
+    double screen_cost(size_t batch_size, unsigned int security_bits, const bigint& e, unsigned int sign_rounds) {
+      if (!batch_size)
+        return 0;
+      const auto size = static_cast<double>(batch_size);
+      double per_side;
+      if (batch_size < 8)
+        per_side = powm_cost(security_bits, security_bits / 2);
+      else {
+        const auto window = std::clamp<unsigned int>(std::bit_width(batch_size) - 3, 1, 16);
+        const auto windows = static_cast<double>((security_bits + window - 1) / window);
+        per_side = windows * (1 + std::ldexp(2, window) / size) + security_bits / size;
+      }
+      return (2 * per_side * 4 / 3) + powm_cost(e) / size + sign_rounds * (4.0 / 3 + powm_cost(e) / size);
+    }
+
+    struct batch_screen {
+      const public_key& key;
+      std::span<const bigint> messages;
+      std::span<const bigint> signatures;
+      std::vector<uint64_t> exponents;
+      // Bit j of each says whether the signature is in the j'th sign round
+      std::vector<uint64_t> sign_round_members;
+      std::vector<bool>& valid;
+      unsigned int security_bits;
+      unsigned int sign_rounds;
+      // Checking each signature by itself costs this much (per signature)
+      double verify_cost;
 
-    RUBBISHRSA_LOG_INFO(std::cerr << "(p, q) = (" << p.str() << ", " << q.str() << ')' << std::endl);
+      // Scratch space for the members of the batch being screened, reused by every level of the split
+      std::vector<bigint> gathered = {};
+      std::vector<uint64_t> gathered_exponents = {};
 
-    // Now we have a good p and q, we can pass it along
-    return private_key::from_factors(p, q);
+      bool screen(std::span<const size_t> batch) {
+        gathered.resize(batch.size());
+        gathered_exponents.resize(batch.size());
+        for (size_t i = 0; i < batch.size(); ++i) {
+          gathered[i] = signatures[batch[i]];
+          gathered_exponents[i] = exponents[batch[i]];
+        }
+        auto lhs = key.raw_verify(multi_powm(gathered, gathered_exponents, key.n));
+        for (size_t i = 0; i < batch.size(); ++i)
+          gathered[i] = messages[batch[i]];
+        if (lhs != multi_powm(gathered, gathered_exponents, key.n))
+          return false;
+
+        // Each round checks the product of a random half of the batch, which an odd number of negated signatures
+        // fails, and so a batch with any in it gets through every round with probability 2^-sign_rounds
+        bigint signature_product, message_product;
+        for (unsigned int round = 0; round < sign_rounds; ++round) {
+          signature_product = message_product = 1;
+          for (auto i : batch) {
+            if (!(sign_round_members[i] >> round & 1))
+              continue;
+            signature_product *= signatures[i];
+            signature_product %= key.n;
+            message_product *= messages[i];
+            message_product %= key.n;
+          }
+          if (key.raw_verify(signature_product) != message_product)
+            return false;
+        }
+        return true;
+      }
+
+      bool worth_screening(size_t batch_size) const {
+        return screen_cost(batch_size, security_bits, key.e, sign_rounds) < verify_cost;
+      }
+
+      void verify_each(std::span<const size_t> batch) {
+        bigint recovered;
+        for (auto i : batch) {
+          key.raw_verify(signatures[i], recovered);
+          valid[i] = recovered == messages[i];
+        }
+      }
+
+      // Marks the bad signatures in a batch that is known to have at least one
+      void split(std::span<const size_t> batch) {
+        // A single bad signature has been found, so there is nothing left to check
+        if (batch.size() == 1) {
+          valid[batch[0]] = false;
+          return;
+        }
+        const auto halves = {batch.first(batch.size() / 2), batch.subspan(batch.size() / 2)};
+        for (auto half : halves) {
+          if (!worth_screening(half.size()))
+            verify_each(half);
+          else if (!screen(half))
+            split(half);
+        }
+      }
+    };
   }
 
-  void public_key::serialise(std::ostream& os) const {
-    boost::property_tree::ptree data;
-    data.put("e", e);
-    data.put("n", n);
-    boost::property_tree::write_json(os, data, false);
+  std::vector<bool> public_key::verify_batch(std::span<const bigint> messages, std::span<const bigint> signatures,
+                                             unsigned int security_bits) const {
+    if (messages.size() != signatures.size())
+      throw std::invalid_argument("Each message needs a signature!");
+    if (security_bits == 0 || security_bits > 64)
+      throw std::invalid_argument("The security level must be between 1 and 64 bits!");
+
+    std::vector<bool> valid(messages.size(), true);
+    std::vector<size_t> candidates;
+    candidates.reserve(messages.size());
+    for (size_t i = 0; i < messages.size(); ++i) {
+      // These could never be the result of a verification, and would break the maths of the screen
+      if (messages[i] < 0 || messages[i] >= n || signatures[i] < 0 || signatures[i] >= n)
+        valid[i] = false;
+      // A 0 would zero both sides of the screen, and let everything else through with it
+      else if (signatures[i] == 0 || messages[i] == 0)
+        valid[i] = signatures[i] == messages[i];
+      else
+        candidates.push_back(i);
+    }
+
+    // The exponents must not be guessable by whoever made the signatures, or they could build a set of
+    // bad ones whose errors cancel out. Seeding from the system rng keeps them secret without a syscall each
+    boost::random::random_device seed_source;
+    std::array<uint32_t, 8> seed;
+    for (auto& i : seed)
+      i = seed_source();
+    std::seed_seq seq(seed.begin(), seed.end());
+    boost::random::mt19937_64 rng{seq};
+
+    // The screen only shows that each s^e is m times an element of small order, and the only one of those that
+    // can be found without the factors of n is -1, which n - s verifies to. When n = 3 (mod 4), the Jacobi symbol
+    // of -1 is -1, so comparing the symbols of each s^e and m rules it out for almost nothing. Otherwise the sign
+    // needs rounds of its own
+    const bool jacobi_decides_sign = n % 4 == 3;
+    if (jacobi_decides_sign) {
+      std::erase_if(candidates, [&](size_t i) {
+        // (s^e / n) = (s / n)^e
+        auto symbol = mpz_jacobi(signatures[i].backend().data(), n.backend().data());
+        if (e % 2 == 0)
+          symbol *= symbol;
+        if (symbol == mpz_jacobi(messages[i].backend().data(), n.backend().data()))
+          return false;
+        valid[i] = false;
+        return true;
+      });
+    }
+
+    batch_screen screen{*this, messages, signatures, std::vector<uint64_t>(messages.size()),
+                        std::vector<uint64_t>(messages.size()), valid, security_bits,
+                        jacobi_decides_sign ? 0 : security_bits, powm_cost(e)};
+    // With a small e, one at a time can be quicker, in which case this is no worse than raw_verify in a loop
+    if (!screen.worth_screening(candidates.size())) {
+      screen.verify_each(candidates);
+      return valid;
+    }
+
+    for (auto& i : screen.exponents) {
+      // Uniform, as forcing any bit of them would let errors that cancel in that bit through every time. Only a
+      // 0 is redrawn, which would leave its signature out of the screen altogether
+      do
+        i = rng() >> (64 - security_bits);
+      while (i == 0);
+    }
+    for (auto& i : screen.sign_round_members)
+      i = rng();
+    if (!screen.screen(candidates))
+      screen.split(candidates);
+    return valid;
+  }
+
+  void public_key::serialise(std::ostream& os, key_format format) const {
+    metrics::scoped_timer timer{metrics::phase::key_io};
+
+    if (format == key_format::json) {
+      boost::property_tree::ptree data;
+      data.put("e", e);
+      data.put("n", n);
+      boost::property_tree::write_json(os, data, false);
+      return;
+    }
+
+    // RSAPublicKey ::= SEQUENCE { modulus INTEGER, publicExponent INTEGER }
+    auto der = der_sequence({&n, &e});
+    if (format == key_format::der)
+      os.write(der.data(), der.size());
+    else
+      os << pem_wrap(pubkey_pem_label, der);
   }
 
-  void private_key::serialise(std::ostream& os) const {
-    boost::property_tree::ptree data;
-    data.put("e", e);
-    data.put("d", d);
-    data.put("n", n);
-    boost::property_tree::write_json(os, data, false);
+  void private_key::serialise(std::ostream& os, key_format format) const {
+    metrics::scoped_timer timer{metrics::phase::key_io};
+
+    if (format == key_format::json) {
+      boost::property_tree::ptree data;
+      data.put("e", e);
+      data.put("d", d);
+      data.put("n", n);
+      if (!primes.empty()) {
+        boost::property_tree::ptree list;
+        for (const auto& i : primes) {
+          boost::property_tree::ptree item;
+          item.put("prime", i.prime);
+          item.put("exponent", i.exponent);
+          item.put("coefficient", i.coefficient);
+          list.push_back({"", std::move(item)});
+        }
+        data.add_child("primes", list);
+      }
+      boost::property_tree::write_json(os, data, false);
+      return;
+    }
+
+    // PKCS#1 insists on the factors, so we recover them from d if we don't have them
+    auto factors = primes;
+    if (factors.empty()) {
+      auto [p, q] = recover_factors(n, e, d);
+      // recover_factors only splits n in two, which leaves a composite if the key had more primes, and a
+      // multi-prime key needs every one of them
+      if (!is_prime(p, 4) || !is_prime(q, 4))
+        throw std::invalid_argument("The primes of this key are not known, and it has more than two, so it cannot be written as PKCS#1");
+      // By convention, p is the larger factor
+      if (p < q)
+        std::swap(p, q);
+      factors = crt_primes({std::move(p), std::move(q)}, d);
+    }
+    const bigint version = factors.size() > 2 ? 1 : 0;
+    const auto& p = factors[0];
+    const auto& q = factors[1];
+
+    // RSAPrivateKey ::= SEQUENCE { version, modulus, publicExponent, privateExponent,
+    //                              prime1, prime2, exponent1, exponent2, coefficient, otherPrimeInfos OPTIONAL }
+    std::string body;
+    for (const auto* i : {&version, &n, &e, &d, &p.prime, &q.prime, &p.exponent, &q.exponent, &p.coefficient})
+      der_put_integer(body, *i);
+    if (factors.size() > 2) {
+      // OtherPrimeInfo ::= SEQUENCE { prime, exponent, coefficient }
+      std::string others;
+      for (size_t i = 2; i < factors.size(); ++i)
+        others += der_sequence({&factors[i].prime, &factors[i].exponent, &factors[i].coefficient});
+      der_put_header(body, der_sequence_tag, others.size());
+      body += others;
+    }
+    std::string der;
+    der_put_header(der, der_sequence_tag, body.size());
+    der += body;
+    if (format == key_format::der)
+      os.write(der.data(), der.size());
+    else
+      os << pem_wrap(privkey_pem_label, der);
   }
 
   public_key public_key::deserialise(std::istream& is) {
-    boost::property_tree::ptree data;
-    boost::property_tree::read_json(is, data);
+    metrics::scoped_timer timer{metrics::phase::key_io};
+
+    auto raw = read_all(is);
+    auto format = detect_format(raw);
     public_key ret;
 
-    ret.e = data.get<bigint>("e");
-    ret.n = data.get<bigint>("n");
+    if (format == key_format::json) {
+      std::istringstream ss{std::move(raw)};
+      boost::property_tree::ptree data;
+      boost::property_tree::read_json(ss, data);
+
+      ret.e = data.get<bigint>("e");
+      ret.n = data.get<bigint>("n");
+
+      return ret;
+    }
+
+    auto der = read_der(std::move(raw), format);
+    auto seq = der_reader{der}.read_sequence();
+    auto first = seq.read_integer();
+    auto second = seq.read_integer();
+    // If there are more fields, this is a private key, and the first field was the version
+    if (seq.empty()) {
+      ret.n = std::move(first);
+      ret.e = std::move(second);
+    }
+    else {
+      ret.n = std::move(second);
+      ret.e = seq.read_integer();
+    }
 
     return ret;
   }
 
   private_key private_key::deserialise(std::istream& is) {
-    boost::property_tree::ptree data;
-    boost::property_tree::read_json(is, data);
+    metrics::scoped_timer timer{metrics::phase::key_io};
+
+    auto raw = read_all(is);
+    auto format = detect_format(raw);
     private_key ret;
 
-    ret.e = data.get<bigint>("e");
-    ret.d = data.get<bigint>("d");
-    ret.n = data.get<bigint>("n");
+    if (format == key_format::json) {
+      std::istringstream ss{std::move(raw)};
+      boost::property_tree::ptree data;
+      boost::property_tree::read_json(ss, data);
+
+      ret.e = data.get<bigint>("e");
+      ret.d = data.get<bigint>("d");
+      ret.n = data.get<bigint>("n");
+
+      if (auto list = data.get_child_optional("primes")) {
+        for (const auto& [_, item] : *list)
+          ret.primes.push_back({item.get<bigint>("prime"), item.get<bigint>("exponent"), item.get<bigint>("coefficient")});
+      }
+    }
+    else {
+      auto der = read_der(std::move(raw), format);
+      auto seq = der_reader{der}.read_sequence();
+      const auto version = seq.read_integer();
+      if (version != 0 && version != 1)
+        throw std::invalid_argument("Unsupported PKCS#1 private key version");
+      ret.n = seq.read_integer();
+      ret.e = seq.read_integer();
+      ret.d = seq.read_integer();
+
+      ret.primes.resize(2);
+      auto& p = ret.primes[0];
+      auto& q = ret.primes[1];
+      p.prime = seq.read_integer();
+      q.prime = seq.read_integer();
+      p.exponent = seq.read_integer();
+      q.exponent = seq.read_integer();
+      p.coefficient = seq.read_integer();
+      if (version == 1) {
+        auto others = seq.read_sequence();
+        while (!others.empty()) {
+          auto info = others.read_sequence();
+          auto prime = info.read_integer();
+          auto exponent = info.read_integer();
+          ret.primes.push_back({std::move(prime), std::move(exponent), info.read_integer()});
+        }
+      }
+    }
 
+    // Working these out again would take a few modinvs, which is more than the rest of loading put together. Nor
+    // are the primes tested for primality, which would cost far more again: that is left to from_primes
+    if (!ret.primes.empty() && !crt_consistent(ret.primes, ret.n, ret.d))
+      throw std::invalid_argument("Malformed key: the primes and CRT parameters do not match the modulus");
     return ret;
   }
 }
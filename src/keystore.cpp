@@ -0,0 +1,188 @@
+#include <rubbishrsa/keystore.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <sstream>
+
+namespace rubbishrsa {
+  namespace {
+    constexpr char keystore_magic[8] = {'R', 'B', 'R', 'S', 'A', 'K', 'S', '\0'};
+    constexpr uint32_t keystore_version = 1;
+
+    // Builds a read-only mpz around limbs that we do not own
+    mpz_srcptr view_limbs(mpz_t storage, const mp_limb_t* limbs, uint32_t size) {
+      return mpz_roinit_n(storage, limbs, size);
+    }
+
+    void write_limbs(std::ostream& os, const bigint& i) {
+      const auto* z = i.backend().data();
+      os.write(reinterpret_cast<const char*>(mpz_limbs_read(z)), mpz_size(z) * sizeof(mp_limb_t));
+    }
+
+    uint32_t limb_count(const bigint& i) {
+      return static_cast<uint32_t>(mpz_size(i.backend().data()));
+    }
+  }
+
+  keystore::fingerprint_t keystore::fingerprint(const bigint& n) {
+    const auto* z = n.backend().data();
+    fingerprint_t ret = 0;
+    constexpr size_t limbs_per_fingerprint = (sizeof(fingerprint_t) + sizeof(mp_limb_t) - 1) / sizeof(mp_limb_t);
+    for (size_t i = 0; i < limbs_per_fingerprint && i < mpz_size(z); ++i)
+      ret |= static_cast<fingerprint_t>(mpz_getlimbn(z, i)) << (i * GMP_NUMB_BITS);
+    return ret;
+  }
+
+  public_key keystore::key_view::to_public_key() const {
+    mpz_t n_storage, e_storage;
+    public_key ret;
+    mpz_set(ret.n.backend().data(), view_limbs(n_storage, limbs, ent->n_limbs));
+    mpz_set(ret.e.backend().data(), view_limbs(e_storage, limbs + ent->n_limbs, ent->e_limbs));
+    return ret;
+  }
+
+  private_key keystore::key_view::to_private_key() const {
+    if (!is_private())
+      throw std::invalid_argument("The keystore only holds the public key for this modulus");
+
+    mpz_t n_storage, e_storage, d_storage;
+    private_key ret;
+    mpz_set(ret.n.backend().data(), view_limbs(n_storage, limbs, ent->n_limbs));
+    mpz_set(ret.e.backend().data(), view_limbs(e_storage, limbs + ent->n_limbs, ent->e_limbs));
+    mpz_set(ret.d.backend().data(), view_limbs(d_storage, limbs + ent->n_limbs + ent->e_limbs, ent->d_limbs));
+    return ret;
+  }
+
+  bigint keystore::key_view::raw_encrypt(const bigint& message) const {
+    mpz_t n_storage, e_storage;
+    bigint ret;
+    mpz_powm(ret.backend().data(), message.backend().data(),
+             view_limbs(e_storage, limbs + ent->n_limbs, ent->e_limbs),
+             view_limbs(n_storage, limbs, ent->n_limbs));
+    return ret;
+  }
+
+  void keystore::builder::add(const public_key& key) {
+    private_key as_private;
+    as_private.n = key.n;
+    as_private.e = key.e;
+    as_private.d = 0;
+    keys.push_back(std::move(as_private));
+  }
+
+  void keystore::builder::add(const private_key& key) {
+    keys.push_back(key);
+  }
+
+  keystore::fingerprint_t keystore::builder::add_serialised(std::istream& in) {
+    // We need to try twice, so we read it all up front
+    std::string raw{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+    try {
+      std::istringstream ss{raw};
+      add(private_key::deserialise(ss));
+    }
+    catch (const std::exception&) {
+      std::istringstream ss{raw};
+      add(public_key::deserialise(ss));
+    }
+    return fingerprint(keys.back().n);
+  }
+
+  void keystore::builder::write(std::ostream& os) const {
+    // Sort pointers rather than copying the keys about
+    std::vector<const private_key*> sorted;
+    sorted.reserve(keys.size());
+    for (const auto& key : keys)
+      sorted.push_back(&key);
+    std::sort(sorted.begin(), sorted.end(), [](auto* a, auto* b) {
+      auto fp_a = fingerprint(a->n), fp_b = fingerprint(b->n);
+      if (fp_a != fp_b)
+        return fp_a < fp_b;
+      if (a->n != b->n)
+        return a->n < b->n;
+      // Private keys go first, so they are the ones kept when deduplicating
+      return a->d > b->d;
+    });
+    sorted.erase(std::unique(sorted.begin(), sorted.end(), [](auto* a, auto* b) { return a->n == b->n; }), sorted.end());
+
+    header head{};
+    std::memcpy(head.magic, keystore_magic, sizeof(keystore_magic));
+    head.version = keystore_version;
+    head.limb_bytes = sizeof(mp_limb_t);
+    head.count = sorted.size();
+    head.index_offset = sizeof(header);
+    os.write(reinterpret_cast<const char*>(&head), sizeof(head));
+
+    // The payloads go straight after the index
+    uint64_t payload_offset = sizeof(header) + sorted.size() * sizeof(entry);
+    for (auto* key : sorted) {
+      entry ent{};
+      ent.fingerprint = fingerprint(key->n);
+      ent.payload_offset = payload_offset;
+      ent.n_limbs = limb_count(key->n);
+      ent.e_limbs = limb_count(key->e);
+      ent.d_limbs = limb_count(key->d);
+      os.write(reinterpret_cast<const char*>(&ent), sizeof(ent));
+      payload_offset += (ent.n_limbs + ent.e_limbs + ent.d_limbs) * sizeof(mp_limb_t);
+    }
+
+    for (auto* key : sorted) {
+      write_limbs(os, key->n);
+      write_limbs(os, key->e);
+      write_limbs(os, key->d);
+    }
+  }
+
+  keystore::keystore(const std::string& path) :
+    file{path.c_str(), boost::interprocess::read_only},
+    region{file, boost::interprocess::read_only} {
+    const auto* base = static_cast<const char*>(region.get_address());
+    const size_t size = region.get_size();
+
+    if (size < sizeof(header))
+      throw std::invalid_argument("Malformed keystore: too small");
+    const auto* head = reinterpret_cast<const header*>(base);
+    if (std::memcmp(head->magic, keystore_magic, sizeof(keystore_magic)) != 0)
+      throw std::invalid_argument("Not a keystore");
+    if (head->version != keystore_version)
+      throw std::invalid_argument("Unsupported keystore version");
+    if (head->limb_bytes != sizeof(mp_limb_t))
+      throw std::invalid_argument("Keystore was written on a machine with a different limb size");
+    if (head->index_offset % alignof(entry) != 0 || head->index_offset > size ||
+        (size - head->index_offset) / sizeof(entry) < head->count)
+      throw std::invalid_argument("Malformed keystore: truncated index");
+
+    entries = reinterpret_cast<const entry*>(base + head->index_offset);
+    count = head->count;
+  }
+
+  keystore::key_view keystore::operator[](size_t i) const {
+    const auto& ent = entries[i];
+    // Check the payload lies within the file, as we have not looked at it before now
+    const uint64_t n_limbs = uint64_t{ent.n_limbs} + ent.e_limbs + ent.d_limbs;
+    if (ent.payload_offset % alignof(mp_limb_t) != 0 || ent.payload_offset > region.get_size() ||
+        (region.get_size() - ent.payload_offset) / sizeof(mp_limb_t) < n_limbs)
+      throw std::invalid_argument("Malformed keystore: truncated payload");
+    return {&ent, reinterpret_cast<const mp_limb_t*>(static_cast<const char*>(region.get_address()) + ent.payload_offset)};
+  }
+
+  std::vector<keystore::key_view> keystore::find(fingerprint_t fingerprint) const {
+    auto iter = std::lower_bound(entries, entries + count, fingerprint, [](const entry& ent, fingerprint_t fp) {
+      return ent.fingerprint < fp;
+    });
+
+    std::vector<key_view> ret;
+    for (; iter != entries + count && iter->fingerprint == fingerprint; ++iter)
+      ret.push_back((*this)[iter - entries]);
+    return ret;
+  }
+
+  std::optional<keystore::key_view> keystore::find(const bigint& n) const {
+    mpz_t storage;
+    for (auto& view : find(fingerprint(n)))
+      if (mpz_cmp(view_limbs(storage, view.limbs, view.ent->n_limbs), n.backend().data()) == 0)
+        return view;
+    return std::nullopt;
+  }
+}
@@ -0,0 +1,176 @@
+#include "rubbishrsa/lattice.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace rubbishrsa {
+  namespace {
+    bigint dot(const std::vector<bigint>& a, const std::vector<bigint>& b) {
+      bigint ret = 0;
+      for (size_t i = 0; i < a.size(); ++i)
+        ret += a[i] * b[i];
+      return ret;
+    }
+
+    // a / b, rounded to the nearest integer, for positive b
+    bigint round_div(const bigint& a, const bigint& b) {
+      bigint numerator = 2 * a + b;
+      bigint denominator = 2 * b;
+      bigint ret = numerator / denominator;
+      // Division truncates towards zero, and we want the floor
+      if (numerator < 0 && ret * denominator != numerator)
+        --ret;
+      return ret;
+    }
+
+    std::vector<bigint> derivative(std::span<const bigint> polynomial) {
+      std::vector<bigint> ret;
+      for (size_t i = 1; i < polynomial.size(); ++i)
+        ret.push_back(polynomial[i] * i);
+      return ret;
+    }
+
+    // Every t in [min, max] where the polynomial is 0, or changes sign between t and t + 1, in order
+    std::vector<bigint> sign_changes(std::span<const bigint> polynomial, const bigint& min, const bigint& max) {
+      while (polynomial.size() && polynomial.back() == 0)
+        polynomial = polynomial.first(polynomial.size() - 1);
+      // Constants (including 0) have nothing worth finding
+      if (polynomial.size() <= 1)
+        return {};
+
+      // Between the points where the derivative changes sign, the polynomial only goes one way
+      std::vector<bigint> breaks{min};
+      for (auto& turn : sign_changes(derivative(polynomial), min, max)) {
+        breaks.push_back(turn);
+        if (turn < max)
+          breaks.push_back(turn + 1);
+      }
+      breaks.push_back(max);
+      breaks.erase(std::unique(breaks.begin(), breaks.end()), breaks.end());
+
+      std::vector<bigint> ret;
+      auto value = evaluate_polynomial(polynomial, breaks[0]);
+      for (size_t i = 0; i + 1 < breaks.size(); ++i) {
+        auto next_value = evaluate_polynomial(polynomial, breaks[i + 1]);
+        if (value == 0)
+          ret.push_back(breaks[i]);
+        else if (next_value != 0 && value.sign() != next_value.sign()) {
+          // The polynomial keeps the sign of value at low, and loses it by high
+          bigint low = breaks[i], high = breaks[i + 1];
+          while (high - low > 1) {
+            bigint mid = (low + high) / 2;
+            auto mid_value = evaluate_polynomial(polynomial, mid);
+            if (mid_value == 0) {
+              low = std::move(mid);
+              break;
+            }
+            (mid_value.sign() == value.sign() ? low : high) = std::move(mid);
+          }
+          ret.push_back(std::move(low));
+        }
+        value = std::move(next_value);
+      }
+      if (value == 0)
+        ret.push_back(breaks.back());
+      return ret;
+    }
+  }
+
+  void lll_reduce(std::vector<std::vector<bigint>>& basis, unsigned int delta_numerator, unsigned int delta_denominator) {
+    if (delta_denominator == 0 || 4 * static_cast<uint64_t>(delta_numerator) <= delta_denominator || delta_numerator > delta_denominator)
+      throw std::invalid_argument("LLL needs 1/4 < delta <= 1!");
+    for (auto& vector : basis)
+      if (vector.size() != basis[0].size())
+        throw std::invalid_argument("The basis vectors must all be the same length!");
+    const size_t dimension = basis.size();
+    if (dimension == 0)
+      return;
+
+    // The indices below are Cohen's, which count from 1: b(k) is basis[k - 1], and lambda(k, j) is lambda[k - 1][j - 1].
+    // d[k] is the Gram determinant of the first k vectors, which is the product of their Gram-Schmidt lengths
+    // squared, and lambda(k, j) is the Gram-Schmidt coefficient mu(k, j) times d[j], which is always an integer
+    std::vector<bigint> d(dimension + 1);
+    std::vector<std::vector<bigint>> lambda(dimension, std::vector<bigint>(dimension));
+    auto b = [&](size_t k) -> std::vector<bigint>& { return basis[k - 1]; };
+    auto l = [&](size_t k, size_t j) -> bigint& { return lambda[k - 1][j - 1]; };
+
+    // Makes |mu(k, j)| <= 1/2, by taking the nearest multiple of b(j) away from b(k)
+    auto size_reduce = [&](size_t k, size_t j) {
+      if (2 * bmp::abs(l(k, j)) <= d[j])
+        return;
+      const auto q = round_div(l(k, j), d[j]);
+      for (size_t i = 0; i < b(k).size(); ++i)
+        b(k)[i] -= q * b(j)[i];
+      l(k, j) -= q * d[j];
+      for (size_t i = 1; i < j; ++i)
+        l(k, i) -= q * l(j, i);
+    };
+
+    d[0] = 1;
+    d[1] = dot(b(1), b(1));
+    if (d[1] == 0)
+      throw std::invalid_argument("The basis vectors are not linearly independent!");
+    size_t k = 2, k_max = 1;
+    while (k <= dimension) {
+      // The Gram-Schmidt of each new vector, the first time we get to it
+      if (k > k_max) {
+        k_max = k;
+        for (size_t j = 1; j <= k; ++j) {
+          auto u = dot(b(k), b(j));
+          for (size_t i = 1; i < j; ++i)
+            u = (d[i] * u - l(k, i) * l(j, i)) / d[i - 1];
+          if (j < k)
+            l(k, j) = std::move(u);
+          else if (u == 0)
+            throw std::invalid_argument("The basis vectors are not linearly independent!");
+          else
+            d[k] = std::move(u);
+        }
+      }
+
+      // Swap b(k) back until the Lovasz condition holds
+      for (;;) {
+        size_reduce(k, k - 1);
+        // delta * |b*(k - 1)|^2 <= |b*(k)|^2 + mu(k, k - 1)^2 * |b*(k - 1)|^2, multiplied through by d[k - 1]^2
+        if (delta_denominator * d[k] * d[k - 2] >= delta_numerator * d[k - 1] * d[k - 1] - delta_denominator * l(k, k - 1) * l(k, k - 1))
+          break;
+
+        std::swap(b(k), b(k - 1));
+        for (size_t j = 1; j + 2 <= k; ++j)
+          std::swap(l(k, j), l(k - 1, j));
+        const bigint lk = l(k, k - 1);
+        const bigint new_d = (d[k - 2] * d[k] + lk * lk) / d[k - 1];
+        for (size_t i = k + 1; i <= k_max; ++i) {
+          const bigint t = l(i, k);
+          l(i, k) = (d[k] * l(i, k - 1) - lk * t) / d[k - 1];
+          l(i, k - 1) = (new_d * t + lk * l(i, k)) / d[k];
+        }
+        d[k - 1] = new_d;
+        if (k > 2)
+          --k;
+      }
+
+      for (size_t j = k - 2; j >= 1; --j)
+        size_reduce(k, j);
+      ++k;
+    }
+  }
+
+  bigint evaluate_polynomial(std::span<const bigint> polynomial, const bigint& x) {
+    // Horner's method
+    bigint ret = 0;
+    for (auto iter = polynomial.rbegin(); iter != polynomial.rend(); ++iter) {
+      ret *= x;
+      ret += *iter;
+    }
+    return ret;
+  }
+
+  std::vector<bigint> integer_roots(std::span<const bigint> polynomial, const bigint& min, const bigint& max) {
+    if (min > max)
+      return {};
+    auto ret = sign_changes(polynomial, min, max);
+    std::erase_if(ret, [&](const bigint& x) { return evaluate_polynomial(polynomial, x) != 0; });
+    return ret;
+  }
+}
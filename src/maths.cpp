@@ -1,5 +1,9 @@
 #include "rubbishrsa/maths.hpp"
+#include "rubbishrsa/checkpoint.hpp"
+#include "rubbishrsa/factordb.hpp"
+#include "rubbishrsa/job.hpp"
 #include "rubbishrsa/log.hpp"
+#include "rubbishrsa/metrics.hpp"
 
 // Rubbish rng
 #include <boost/random/mersenne_twister.hpp>
@@ -7,7 +11,15 @@
 #include <boost/random/random_device.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
 
+#include <algorithm>
 #include <atomic>
+#include <bit>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <thread>
 
 namespace rubbishrsa {
@@ -27,6 +39,256 @@ namespace rubbishrsa {
       return n + res.coefficients.first;
   }
 
+  namespace {
+    // Below this many values per thread, starting the threads costs more than it saves
+    constexpr size_t min_modinv_chunk = 512;
+
+    // out = product (mod n), in [0, n) even when product is negative
+    void reduce_into(const bigint& product, const bigint& n, bigint& out) {
+      out = product % n;
+      if (out < 0)
+        out += n;
+    }
+
+    // Fills out with the running products of values (mod n), so that out[i] is the product of values[0..i]
+    void prefix_products(std::span<const bigint> values, std::span<bigint> out, const bigint& n) {
+      bigint product;
+      reduce_into(values[0], n, out[0]);
+      for (size_t i = 1; i < values.size(); ++i) {
+        product = out[i - 1] * values[i];
+        reduce_into(product, n, out[i]);
+      }
+    }
+
+    // Turns the running products in out into the inverse of each value, given the inverse of their product
+    void peel_inverses(std::span<const bigint> values, std::span<bigint> out, bigint inverse, const bigint& n) {
+      bigint product;
+      for (size_t i = values.size() - 1; i; --i) {
+        // 1/a_i = (a_0 ... a_(i - 1)) / (a_0 ... a_i)
+        product = inverse * out[i - 1];
+        reduce_into(product, n, out[i]);
+        // Leaves 1/(a_0 ... a_(i - 1)) for the next one down
+        product = inverse * values[i];
+        reduce_into(product, n, inverse);
+      }
+      out[0] = std::move(inverse);
+    }
+
+    // The inverse of a (mod n), or nothing if there is not one
+    std::optional<bigint> try_modinv(const bigint& a, const bigint& n) {
+      // egcd will not take a 0, which can never be inverted anyway
+      if (a == 0)
+        return std::nullopt;
+      auto res = egcd(a, n);
+      if (res.gcd != 1)
+        return std::nullopt;
+      // Normalised in the same way as modinv
+      if (res.coefficients.first < 0)
+        res.coefficients.first += n;
+      return std::move(res.coefficients.first);
+    }
+
+    // Montgomery's trick on a single thread, where the values started at offset in the whole batch
+    //
+    // If the product cannot be inverted, the halves are tried separately until the culprits are found
+    void invert_each(std::span<const bigint> values, std::span<bigint> out, const bigint& n, size_t offset,
+                     std::vector<size_t>& non_invertible) {
+      if (values.empty())
+        return;
+      prefix_products(values, out, n);
+      if (auto inverse = try_modinv(out.back(), n)) {
+        peel_inverses(values, out, std::move(*inverse), n);
+        return;
+      }
+      if (values.size() == 1) {
+        out[0] = 0;
+        non_invertible.push_back(offset);
+        return;
+      }
+      const auto half = values.size() / 2;
+      invert_each(values.first(half), out.first(half), n, offset, non_invertible);
+      invert_each(values.subspan(half), out.subspan(half), n, offset + half, non_invertible);
+    }
+  }
+
+  batch_modinv_result batch_modinv(std::span<const bigint> values, const bigint& n, unsigned int thread_count) {
+    batch_modinv_result ret;
+    ret.inverses.resize(values.size());
+
+    const size_t count = thread_count ? thread_count : std::thread::hardware_concurrency();
+    const size_t n_chunks = std::clamp<size_t>(values.size() / min_modinv_chunk, 1, count);
+    if (n_chunks == 1) {
+      invert_each(values, ret.inverses, n, 0, ret.non_invertible);
+      return ret;
+    }
+
+    // Each thread takes the running products of its own chunk, and then the totals of the chunks are inverted
+    // together, so that the whole batch still needs a single inversion
+    const auto chunk_begin = [&](size_t chunk_i) { return values.size() * chunk_i / n_chunks; };
+    const auto run_chunks = [&](auto func) {
+      std::vector<std::thread> pool;
+      for (size_t i = 0; i < n_chunks; ++i) {
+        pool.emplace_back([&, i]() {
+          const auto begin = chunk_begin(i);
+          const auto len = chunk_begin(i + 1) - begin;
+          func(i, values.subspan(begin, len), std::span{ret.inverses}.subspan(begin, len));
+        });
+      }
+      for (auto& thread : pool)
+        thread.join();
+    };
+
+    run_chunks([&](size_t, auto chunk_values, auto chunk_out) { prefix_products(chunk_values, chunk_out, n); });
+
+    std::vector<bigint> totals(n_chunks), total_inverses(n_chunks);
+    for (size_t i = 0; i < n_chunks; ++i)
+      totals[i] = ret.inverses[chunk_begin(i + 1) - 1];
+    std::vector<size_t> bad_chunks;
+    invert_each(totals, total_inverses, n, 0, bad_chunks);
+
+    std::vector<std::vector<size_t>> chunk_non_invertible(n_chunks);
+    run_chunks([&](size_t i, auto chunk_values, auto chunk_out) {
+      // A chunk with a bad value in it starts again by itself, to find which one it was
+      if (std::binary_search(bad_chunks.begin(), bad_chunks.end(), i))
+        invert_each(chunk_values, chunk_out, n, chunk_begin(i), chunk_non_invertible[i]);
+      else
+        peel_inverses(chunk_values, chunk_out, std::move(total_inverses[i]), n);
+    });
+
+    for (auto& i : chunk_non_invertible)
+      ret.non_invertible.insert(ret.non_invertible.end(), i.begin(), i.end());
+    return ret;
+  }
+
+  bigint iroot(const bigint& x, unsigned long k) {
+    if (k == 0)
+      throw std::invalid_argument("Cannot take a zeroth root!");
+    if (x < 0)
+      throw std::invalid_argument("Cannot take the root of a negative number!");
+    if (x < 2 || k == 1)
+      return x;
+
+    // Start from a power of 2 above the root, so that Newton's method comes down onto it from above
+    bigint root = bigint{1} << ((floor_log2(x) + k - 1) / k);
+    bigint next;
+    while (true) {
+      // r' = ((k - 1)r + x/r^(k - 1)) / k, which stops going down once it has passed the root
+      next = x / bmp::pow(root, k - 1);
+      next += (k - 1) * root;
+      next /= k;
+      if (next >= root)
+        return root;
+      root.swap(next);
+    }
+  }
+
+  namespace {
+    // Solves the CRT for [begin, end), returning the solution and the product of the moduli
+    std::pair<bigint, bigint> crt_tree(std::span<const bigint> residues, std::span<const bigint> moduli) {
+      if (moduli.size() == 1)
+        return {residues[0] % moduli[0], moduli[0]};
+
+      const auto half = moduli.size() / 2;
+      auto [x_1, m_1] = crt_tree(residues.first(half), moduli.first(half));
+      auto [x_2, m_2] = crt_tree(residues.subspan(half), moduli.subspan(half));
+      // x = x_1 + m_1 * t, where t makes it x_2 (mod m_2)
+      bigint t = ((x_2 - x_1) % m_2 + m_2) * modinv(m_1 % m_2, m_2) % m_2;
+      return {x_1 + m_1 * t, m_1 * m_2};
+    }
+  }
+
+  bigint crt(std::span<const bigint> residues, std::span<const bigint> moduli) {
+    if (residues.size() != moduli.size())
+      throw std::invalid_argument("Each residue needs a modulus!");
+    if (moduli.empty())
+      return 0;
+    return crt_tree(residues, moduli).first;
+  }
+
+  bigint multi_powm(std::span<const bigint> bases, std::span<const uint64_t> exponents, const bigint& n) {
+    if (bases.size() != exponents.size())
+      throw std::invalid_argument("Each base needs an exponent!");
+
+    bigint acc = 1;
+    bigint product;
+    // Setting up the buckets is not worth it for a handful of bases
+    if (bases.size() < 8) {
+      for (size_t i = 0; i < bases.size(); ++i) {
+        product = bmp::powm(bases[i], bigint{exponents[i]}, n);
+        product *= acc;
+        acc = product % n;
+      }
+      return acc;
+    }
+
+    const auto max_exponent = *std::max_element(exponents.begin(), exponents.end());
+    if (!max_exponent)
+      return acc % n;
+    // Each window costs 2^(window + 1) multiplications to add up the buckets, which is best kept below the
+    // multiplication per base that it takes to fill them
+    const auto window = std::clamp<unsigned int>(std::bit_width(bases.size()) - 3, 1, 16);
+    const uint64_t mask = (uint64_t{1} << window) - 1;
+
+    std::vector<bigint> buckets(mask + 1);
+    std::vector<bool> filled(mask + 1);
+    bigint running, total;
+    bool started = false;
+    for (int shift = (std::bit_width(max_exponent) - 1) / window * window; shift >= 0; shift -= window) {
+      if (started) {
+        for (unsigned int i = 0; i < window; ++i) {
+          product = acc * acc;
+          acc = product % n;
+        }
+      }
+
+      std::fill(filled.begin(), filled.end(), false);
+      for (size_t i = 0; i < bases.size(); ++i) {
+        const auto digit = (exponents[i] >> shift) & mask;
+        if (!digit)
+          continue;
+        if (filled[digit]) {
+          product = buckets[digit] * bases[i];
+          buckets[digit] = product % n;
+        }
+        else {
+          buckets[digit] = bases[i];
+          filled[digit] = true;
+        }
+      }
+
+      // Sums digit * bucket by keeping a running product from the top: bucket d ends up in d of the totals
+      bool have_running = false, have_total = false;
+      for (auto digit = mask; digit; --digit) {
+        if (filled[digit]) {
+          if (have_running) {
+            product = running * buckets[digit];
+            running = product % n;
+          }
+          else {
+            running = buckets[digit];
+            have_running = true;
+          }
+        }
+        if (!have_running)
+          continue;
+        if (have_total) {
+          product = total * running;
+          total = product % n;
+        }
+        else {
+          total = running;
+          have_total = true;
+        }
+      }
+      if (have_total) {
+        product = acc * total;
+        acc = product % n;
+        started = true;
+      }
+    }
+    return acc % n;
+  }
+
   // lcm(a,b) = a/gcd(a,b) * b
   bigint lcm(const bigint& a, const bigint& b) {
     return (a / egcd(a, b).gcd) * b;
@@ -116,38 +378,81 @@ namespace rubbishrsa {
     }
   }
 
+  namespace {
+    // Past this, each division costs more than the Miller-Rabin rounds it saves
+    constexpr uint32_t trial_division_bound = 4096;
+
+    // Fills out with a (very nearly) uniform random number below bound, writing the limbs directly
+    //
+    // uniform_int_distribution builds the number up with a bigint temporary for every 32 bits, which made it the
+    // biggest allocator in is_prime. The extra limb drawn here makes the bias from the modulo negligible
+    void random_below(const bigint& bound, boost::random::mt19937& rng, bigint& out) {
+      auto* z = out.backend().data();
+      const auto n_limbs = mpz_size(bound.backend().data()) + 1;
+      mp_limb_t* limbs = mpz_limbs_write(z, n_limbs);
+      for (size_t i = 0; i < n_limbs; ++i) {
+        mp_limb_t limb = 0;
+        for (size_t shift = 0; shift < GMP_NUMB_BITS; shift += 32)
+          limb |= static_cast<mp_limb_t>(rng()) << shift;
+        limbs[i] = limb;
+      }
+      mpz_limbs_finish(z, n_limbs);
+      out %= bound;
+    }
+  }
+
   // I will use boost random for this stuff, and stl's one doesn't support the bigint
   bool is_prime(const bigint& candidate, uint_fast8_t certainty_log_4) {
     // This in an implementation of the Miller-Rabin probabilistic primality test
-    bigint odd = candidate;
+
+    // The random bases below need some room, so the tiny cases are done by hand
+    if (candidate < 5)
+      return candidate == 2 || candidate == 3;
+    if (candidate % 2 == 0)
+      return false;
+
+    metrics::scoped_timer timer{metrics::phase::prime_test};
+
+    // Most composites have a small factor, and finding it is far cheaper than a round of Miller-Rabin
+    for (auto p : small_primes(trial_division_bound).subspan(1)) {
+      if (mpz_fdiv_ui(candidate.backend().data(), p) == 0)
+        return candidate == p;
+    }
+
+    // Write candidate - 1 as 2^exponent * odd
+    bigint odd = candidate - 1;
     size_t exponent = 0;
 
     // We keep the the non-power of 2 in i
-    while (odd % 2 != 0) {
+    while (odd % 2 == 0) {
       ++exponent;
       // A quicker way of doing i = 2
       odd >>= 1;
     }
 
-    bigint min = 2;
-    bigint max = candidate - 2;
     // We don't need a crypto rng here
     thread_local boost::random::mt19937 rng;
-    const boost::random::uniform_int_distribution<bigint> dist(std::move(min), std::move(max));
+    // The bases are drawn from [2, candidate - 2]
+    const bigint base_range = candidate - 3;
 
     // We do this a lot, so precompute it
     bigint candidate_minus_1 = candidate - 1;
 
-    bigint x;
+    // Reused by every round, so that only the first one allocates
+    bigint a, x, x_squared;
     for (uint_fast8_t iter = 0; iter < certainty_log_4; ++iter) {
-      bigint a = dist(rng);
+      metrics::add(metrics::counter::miller_rabin_rounds);
+      random_below(base_range, rng, a);
+      a += 2;
       x = bmp::powm(a, odd, candidate);
       // If we already have a congruence, then we have passed this iter
       if (x == 1 || x == candidate_minus_1)
         continue;
 
       for (decltype(exponent) i = 1; i < exponent; ++i) {
-        x = bmp::powm(x, 2, candidate);
+        // Squaring by hand is cheaper than powm, and means x is never copied
+        x_squared = x * x;
+        x = x_squared % candidate;
         if (x == candidate_minus_1)
           // Only way to quickly leave a nested loop
           //
@@ -166,7 +471,9 @@ next_iter: {}
     return true;
   }
 
-  bigint generate_prime(uint_fast16_t bits) {
+  bigint generate_prime(uint_fast16_t bits, unsigned int thread_count, job_control* job) {
+    metrics::scoped_timer timer{metrics::phase::prime_generation};
+
     // (1 << n) means 2^n, giving us a range of 2^(n-2) to 2^(n-1) inclusive
     //
     // The reason for keeping this half of the desired values is that 2 is the only even prime,
@@ -186,7 +493,9 @@ next_iter: {}
     std::vector<std::thread> pool;
     bigint ret;
     std::atomic<bool> stop = false;
-    for (unsigned int i = 0; i < std::thread::hardware_concurrency(); ++i) {
+    auto link = job ? job->link(stop) : job_control::link_guard{};
+    const auto count = thread_count ? thread_count : std::thread::hardware_concurrency();
+    for (unsigned int i = 0; i < count; ++i) {
       pool.emplace_back([&, i]() {
         // Removes warnings about i not being used
         (void)i;
@@ -198,6 +507,9 @@ next_iter: {}
         while (!stop) {
           // Get a random number, and make it odd
           candidate = dist(rng) * 2 + 1;
+          metrics::add(metrics::counter::prime_candidates);
+          if (job)
+            job->add_progress(1);
           // We will only log the candidates of one thread so that we keep the output synchronised
           RUBBISHRSA_LOG_TRACE(if (i == 0) std::cerr << "\tPrime candidate " << candidate.str() << std::endl);
           // Check if we have a prime, and check if we are the first thread to have one
@@ -211,50 +523,409 @@ next_iter: {}
     // Wait for each thread to finish
     for (auto& thread : pool) thread.join();
 
+    if (ret == 0 && job)
+      job->throw_if_stopped();
+
     RUBBISHRSA_LOG_TRACE(std::cerr << "Chose " << ret << " as prime" << std::endl);
 
     return ret;
   }
 
-  bigint pollard_rho(const bigint& n) {
+  namespace {
+    // A typical L1 data cache, so the segment being sieved never leaves it
+    constexpr size_t sieve_segment_bytes = 32 * 1024;
+    constexpr size_t sieve_segment_words = sieve_segment_bytes / sizeof(uint64_t);
+    constexpr uint64_t sieve_segment_bits = sieve_segment_bytes * 8;
+
+    struct prime_table {
+      uint32_t bound;
+      std::vector<uint32_t> primes;
+    };
+
+    std::atomic<const prime_table*> current_table = nullptr;
+    std::mutex table_mutex;
+    // Every table ever built, so that the spans handed out of older ones stay valid
+    std::vector<std::unique_ptr<prime_table>> all_tables;
+
+    // A plain odd-only sieve, which is quick enough at table sizes and gives the segmented sieve its base primes
+    std::unique_ptr<prime_table> build_table(uint32_t bound) {
+      metrics::scoped_timer timer{metrics::phase::sieve};
+
+      auto table = std::make_unique<prime_table>();
+      table->bound = bound;
+      if (bound < 2)
+        return table;
+      table->primes.push_back(2);
+
+      // Bit i represents 2i + 1
+      const uint64_t n_bits = (uint64_t{bound} + 1) / 2;
+      std::vector<uint64_t> composite((n_bits + 63) / 64);
+      for (uint64_t i = 1; i < n_bits; ++i) {
+        if (composite[i / 64] >> (i % 64) & 1)
+          continue;
+        const uint64_t p = 2 * i + 1;
+        table->primes.push_back(static_cast<uint32_t>(p));
+        for (uint64_t j = p * p / 2; j < n_bits; j += p)
+          composite[j / 64] |= uint64_t{1} << (j % 64);
+      }
+      return table;
+    }
+
+    uint64_t isqrt(uint64_t n) {
+      // The double is only out by a little, so nudge it into place
+      auto root = static_cast<uint64_t>(std::sqrt(static_cast<double>(n)));
+      while (root * root > n)
+        --root;
+      while ((root + 1) * (root + 1) <= n)
+        ++root;
+      return root;
+    }
+
+    void check_sieve_end(uint64_t end) {
+      if (end > sieve_limit)
+        throw std::invalid_argument("The sieve cannot go past 2^40!");
+    }
+  }
+
+  std::span<const uint32_t> small_primes(uint32_t bound) {
+    const auto* table = current_table.load(std::memory_order_acquire);
+    if (!table || table->bound < bound) {
+      std::unique_lock lock{table_mutex};
+      table = current_table.load(std::memory_order_relaxed);
+      if (!table || table->bound < bound) {
+        // Grow it geometrically, so that slowly rising bounds do not rebuild it every time
+        const auto new_bound = std::min<uint64_t>(std::max<uint64_t>(bound, table ? uint64_t{table->bound} * 2 : 0),
+                                                  std::numeric_limits<uint32_t>::max());
+        all_tables.push_back(build_table(static_cast<uint32_t>(new_bound)));
+        table = all_tables.back().get();
+        current_table.store(table, std::memory_order_release);
+      }
+    }
+    const auto last = std::upper_bound(table->primes.begin(), table->primes.end(), bound);
+    return {table->primes.data(), static_cast<size_t>(last - table->primes.begin())};
+  }
+
+  prime_sieve::prime_sieve(uint64_t begin, uint64_t end) : end_{end}, two_pending{begin <= 2 && 2 < end} {
+    check_sieve_end(end);
+
+    segment_start = std::max<uint64_t>(begin, 3) | 1;
+    if (segment_start < end) {
+      // Every composite below end has a factor no bigger than its square root, and we skip 2 as we only keep odds
+      auto primes = small_primes(static_cast<uint32_t>(isqrt(end - 1)));
+      base_primes = primes.empty() ? primes : primes.subspan(1);
+      next_multiple.reserve(base_primes.size());
+      for (uint64_t p : base_primes) {
+        // Anything smaller than p^2 with a factor of p has a smaller factor too
+        auto multiple = std::max(p * p, (segment_start + p - 1) / p * p);
+        if (multiple % 2 == 0)
+          multiple += p;
+        next_multiple.push_back((multiple - segment_start) / 2);
+      }
+      segment.resize(sieve_segment_words);
+    }
+
+    advance();
+  }
+
+  bool prime_sieve::sieve_segment() {
+    if (segment_start >= end_)
+      return false;
+    segment_bits = std::min(sieve_segment_bits, (end_ - segment_start + 1) / 2);
+
+    std::fill(segment.begin(), segment.end(), 0);
+    for (size_t i = 0; i < base_primes.size(); ++i) {
+      const uint64_t p = base_primes[i];
+      auto j = next_multiple[i];
+      // Odd multiples of p are 2p apart, which is p bits
+      for (; j < segment_bits; j += p)
+        segment[j / 64] |= uint64_t{1} << (j % 64);
+      next_multiple[i] = j - segment_bits;
+    }
+    // The bits past the end of a short last segment are not numbers we were asked about
+    if (segment_bits % 64)
+      segment[segment_bits / 64] |= ~uint64_t{0} << (segment_bits % 64);
+
+    word_i = 0;
+    word = ~segment[0];
+    return true;
+  }
+
+  void prime_sieve::advance() {
+    if (two_pending) {
+      two_pending = false;
+      current = 2;
+      return;
+    }
+
+    while (true) {
+      if (word) {
+        current = segment_start + 2 * (word_i * 64 + std::countr_zero(word));
+        // Clears the lowest bit
+        word &= word - 1;
+        return;
+      }
+      if (word_i + 1 < (segment_bits + 63) / 64) {
+        word = ~segment[++word_i];
+        continue;
+      }
+      segment_start += 2 * segment_bits;
+      if (!sieve_segment()) {
+        finished = true;
+        return;
+      }
+    }
+  }
+
+  uint64_t prime_sieve::count() {
+    if (finished)
+      return 0;
+    // The current prime has not been read yet
+    uint64_t total = 1 + std::popcount(word);
+    for (size_t i = word_i + 1; i < (segment_bits + 63) / 64; ++i)
+      total += std::popcount(~segment[i]);
+    while (true) {
+      segment_start += 2 * segment_bits;
+      if (!sieve_segment())
+        break;
+      for (size_t i = 0; i < (segment_bits + 63) / 64; ++i)
+        total += std::popcount(~segment[i]);
+    }
+    finished = true;
+    return total;
+  }
+
+  namespace {
+    // Splits [begin, end) into chunks, and has a pool of threads each call func(lo, hi) on chunks until they run out
+    template<typename Func>
+    void sieve_in_chunks(uint64_t begin, uint64_t end, unsigned int thread_count, Func&& func) {
+      check_sieve_end(end);
+      if (begin >= end)
+        return;
+      // Build the table up front, rather than have every thread wait on it
+      if (end > 2)
+        small_primes(static_cast<uint32_t>(isqrt(end - 1)));
+
+      const uint64_t count = thread_count ? thread_count : std::thread::hardware_concurrency();
+      // Big enough that setting up each chunk is nothing next to sieving it, and small enough to share out evenly
+      const uint64_t chunk = std::clamp<uint64_t>((end - begin) / (count * 8), 2 * sieve_segment_bits, 128 * sieve_segment_bits);
+      const uint64_t n_chunks = (end - begin + chunk - 1) / chunk;
+      std::atomic<uint64_t> next_chunk = 0;
+
+      std::vector<std::thread> pool;
+      for (uint64_t i = 0; i < std::min(count, n_chunks); ++i) {
+        pool.emplace_back([&]() {
+          for (uint64_t chunk_i; (chunk_i = next_chunk.fetch_add(1, std::memory_order_relaxed)) < n_chunks;) {
+            const auto lo = begin + chunk_i * chunk;
+            func(lo, std::min(end, lo + chunk));
+          }
+        });
+      }
+      for (auto& thread : pool)
+        thread.join();
+    }
+  }
+
+  void for_each_prime(uint64_t begin, uint64_t end, const std::function<void(std::span<const uint64_t>)>& func,
+                      unsigned int thread_count) {
+    metrics::scoped_timer timer{metrics::phase::sieve};
+    sieve_in_chunks(begin, end, thread_count, [&](uint64_t lo, uint64_t hi) {
+      thread_local std::vector<uint64_t> primes;
+      primes.clear();
+      for (auto p : prime_sieve{lo, hi})
+        primes.push_back(p);
+      func(primes);
+    });
+  }
+
+  uint64_t count_primes(uint64_t begin, uint64_t end, unsigned int thread_count) {
+    metrics::scoped_timer timer{metrics::phase::sieve};
+    std::atomic<uint64_t> total = 0;
+    sieve_in_chunks(begin, end, thread_count, [&](uint64_t lo, uint64_t hi) {
+      total.fetch_add(prime_sieve{lo, hi}.count(), std::memory_order_relaxed);
+    });
+    return total;
+  }
+
+  bigint pollard_rho_start(size_t walk) {
+    // Using primes will minimise the chance of collision, which means that walks are less likely to do redundant work
+    //
+    // 5 is skipped, as it is the second term of 2's sequence
+    const size_t index = walk < 2 ? walk : walk + 1;
+    for (uint32_t bound = 1 << 16; ; bound *= 2) {
+      auto primes = small_primes(bound);
+      if (index < primes.size())
+        return primes[index];
+    }
+  }
+
+  namespace {
+    // Leaves gcd(a, b) in a, using both as scratch
+    //
+    // Unlike egcd, this does not need to track the coefficients, so it can work in place without allocating
+    void gcd_in_place(bigint& a, bigint& b) {
+      while (b != 0) {
+        a %= b;
+        a.swap(b);
+      }
+    }
+  }
+
+  namespace {
+    // How many steps share a gcd. A gcd costs dozens of multiplications, so this makes it all but free, and the
+    // odd batch that has to be walked again (when the product of a batch shares every factor with n) costs little
+    constexpr uint_fast32_t rho_batch_size = 64;
+
+    // One step of a walk: x once, and y twice, along u_{i+1} = u_i^2 + c (mod n)
+    void rho_step(const bigint& n, bigint& x, bigint& y, unsigned long increment, bigint& square) {
+      // 1 iter for x
+      square = x * x; square += increment; x = square % n;
+      // 2 iters for y
+      square = y * y; square += increment; y = square % n;
+      square = y * y; square += increment; y = square % n;
+    }
+
+    // Leaves |x - y| in diff
+    void rho_difference(const bigint& x, const bigint& y, bigint& diff) {
+      diff = x - y;
+      if (diff < 0)
+        diff.backend().negate();
+    }
+  }
+
+  bigint pollard_rho_steps(const bigint& n, bigint& x, bigint& y, uint_fast32_t steps, const std::atomic<bool>& stop,
+                           unsigned long increment) {
+    // We are trying to find two elements in the sequence u_n such that u_i is congruent to u_j (mod p), but u_n is not equal to u_i
+    //
+    // With two such elements, we have (as a result of the remainder property of moduli) gcd(|u_i - u_j|, n) is not 1.
+    //
+    // This means that there is some common divisor between them, and the result of this gcd is a factor of n
+    //
+    // We step one position (x) forward by 1, and the other (y) by 2, to increase the size of the tested cycle.
+    //
+    // For some unknown reason, If we pick u_n = u_n^2 + a (mod n) as our random generator, we will find a result quicker.
+    //
+    // Rather than a gcd for every step, the differences of a batch of steps are multiplied together (mod n), and
+    // the product has a factor in common with n if and only if one of the differences does.
+
+    // Scratch space for each step, which stops growing after the first
+    bigint gcd, remainder, square, diff, product;
+    bigint batch_x, batch_y;
+    uint_fast32_t i = 0;
+    while (i < steps && !stop.load(std::memory_order_relaxed)) {
+      const auto batch = std::min(rho_batch_size, steps - i);
+      batch_x = x;
+      batch_y = y;
+      product = 1;
+      // Each step is written out in place, as the temporaries would otherwise be allocated and freed every time
+      for (uint_fast32_t j = 0; j < batch; ++j) {
+        rho_step(n, x, y, increment, square);
+        rho_difference(x, y, diff);
+        square = product * diff;
+        product = square % n;
+      }
+      gcd = product;
+      remainder = n;
+      gcd_in_place(gcd, remainder);
+      if (gcd == 1) {
+        i += batch;
+        continue;
+      }
+
+      // Something in the batch shares a factor with n, so we walk it again a step at a time to find the first
+      // difference that does. This is what stops a batch that finds p on one step and q on another from giving up
+      // with n, as the product would
+      //
+      // We don't need to worry about both elements being equal (unless it is prime),
+      // as we will happen upon a factor cycle far before that (with high probability)
+      //
+      // If they are, the gcd is n itself, which is how a cycle is reported
+      x = std::move(batch_x);
+      y = std::move(batch_y);
+      for (uint_fast32_t j = 0; j < batch; ++j) {
+        rho_step(n, x, y, increment, square);
+        rho_difference(x, y, gcd);
+        remainder = n;
+        gcd_in_place(gcd, remainder);
+        if (gcd != 1) {
+          i += j + 1;
+          break;
+        }
+      }
+      break;
+    }
+    metrics::add(metrics::counter::rho_iterations, i);
+    return gcd != 1 && gcd != 0 ? gcd : bigint{0};
+  }
+
+  bigint pollard_rho(const bigint& n, unsigned int thread_count, checkpoint* ckpt, job_control* job) {
+    // Every walk on a prime cycles without finding anything, so they would never stop, and walks on 2^k or p^2
+    // can all cycle mod n and mod the factor at once. These are all instant to spot
+    if (n < 4 || is_prime(n))
+      return n;
+    if (n % 2 == 0)
+      return 2;
+    if (auto root = iroot(n, 2); root * root == n)
+      return root;
+
     std::vector<std::thread> pool;
     std::atomic<bool> found = false;
+    auto link = job ? job->link(found) : job_control::link_guard{};
     bigint result;
 
-    // Using primes will minimise the chance of collision, which means that threads are less likely to do redundant work
-    // I have hand removed 5, as it is the second term of 2's sequence
-    constexpr static std::array<int, 128> primes{2, 3, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131, 137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223, 227, 229, 233, 239, 241, 251, 257, 263, 269, 271, 277, 281, 283, 293, 307, 311, 313, 317, 331, 337, 347, 349, 353, 359, 367, 373, 379, 383, 389, 397, 401, 409, 419, 421, 431, 433, 439, 443, 449, 457, 461, 463, 467, 479, 487, 491, 499, 503, 509, 521, 523, 541, 547, 557, 563, 569, 571, 577, 587, 593, 599, 601, 607, 613, 617, 619, 631, 641, 643, 647, 653, 659, 661, 673, 677, 683, 691, 701, 709, 719};
-    auto max_threads = std::min(static_cast<size_t>(std::thread::hardware_concurrency()), primes.size());
+    size_t max_threads = thread_count ? thread_count : std::thread::hardware_concurrency();
+    if (ckpt) {
+      // The walks are only meaningful with the starting points they were saved with
+      if (auto saved = ckpt->get_uint("rho.threads"))
+        max_threads = static_cast<size_t>(*saved);
+      else
+        ckpt->set("rho.threads", max_threads);
+    }
+    // Anything saved is read here, as a malformed value throws, and that must not happen on the walks' threads
+    std::vector<uint64_t> saved_restarts(max_threads);
+    std::vector<std::optional<bigint>> saved_x(max_threads), saved_y(max_threads);
+    if (ckpt) {
+      for (size_t i = 0; i < max_threads; ++i) {
+        saved_restarts[i] = ckpt->get_uint("rho.restarts." + std::to_string(i)).value_or(0);
+        saved_x[i] = ckpt->get_bigint("rho.x." + std::to_string(i));
+        saved_y[i] = ckpt->get_bigint("rho.y." + std::to_string(i));
+      }
+    }
+
     // Do Pollard's rho algorithm with each thread, each with a different polynomial
     for (size_t i = 0; i < max_threads; ++i) {
       pool.emplace_back([&, i]() {
-        bigint x = primes[i];
+        const auto x_key = "rho.x." + std::to_string(i), y_key = "rho.y." + std::to_string(i);
+        const auto restarts_key = "rho.restarts." + std::to_string(i);
+        // A walk that cycles without finding a factor starts again as a walk that nobody else is using
+        uint64_t restarts = saved_restarts[i];
+        auto walk = [&]() { return i + static_cast<size_t>(restarts) * max_threads; };
+
+        bigint x = pollard_rho_start(walk());
         bigint y = x;
-        bigint gcd;
+        if (saved_x[i])
+          x = std::move(*saved_x[i]);
+        if (saved_y[i])
+          y = std::move(*saved_y[i]);
 
+        // Walk in chunks, so that reporting and checkpointing stay out of the hot loop
         while (!found) {
-          // We are trying to find two elements in the sequence u_n such that u_i is congruent to u_j (mod p), but u_n is not equal to u_i
-          //
-          // With two such elements, we have (as a result of the remainder property of moduli) gcd(|u_i - u_j|, n) is not 1.
-          //
-          // This means that there is some common divisor between them, and the result of this gcd is a factor of n
-          //
-          // We step one position (x) forward by 1, and the other (y) by 2, to increase the size of the tested cycle.
-          //
-          // For some unknown reason, If we pick u_n = u_n^2 + a (mod n) as our random generator, we will find a result quicker.
-
-          // 1 iter for x
-          x = (x*x + 1) % n;
-          // 2 iters for y
-          y = (y*y + 1) % n;
-          y = (y*y + 1) % n;
-
-          // We don't need to worry about both elements being equal (unless it is prime),
-          // as we will happen upon a factor cycle far before that (with high probability)
-          gcd = egcd(bmp::abs(x - y), n).gcd;
-          // If we found something with a non-trivial gcd, that's a factor
-          if (gcd != 1 && !found.exchange(true))
-            result = gcd;
+          auto factor = pollard_rho_steps(n, x, y, 4096, found, pollard_rho_increment(walk()));
+          if (factor == n) {
+            ++restarts;
+            x = y = pollard_rho_start(walk());
+            if (ckpt)
+              ckpt->set(restarts_key, restarts);
+          }
+          else if (factor != 0 && !found.exchange(true))
+            result = std::move(factor);
+
+          if (job)
+            job->add_progress(4096);
+          if (ckpt) {
+            ckpt->set(x_key, x);
+            ckpt->set(y_key, y);
+            ckpt->maybe_save();
+          }
         }
       });
     }
@@ -262,6 +933,9 @@ next_iter: {}
     for (auto& thread : pool)
       thread.join();
 
+    if (result == 0 && job)
+      job->throw_if_stopped();
+
     return result;
   }
 
@@ -280,59 +954,181 @@ next_iter: {}
 //    }
 //  }
 
-  std::pair<bigint, bigint> factorise_semiprime(const bigint& semiprime) {
+  std::pair<bigint, bigint> factorise_semiprime(const bigint& semiprime, checkpoint* ckpt, job_control* job) {
+    metrics::scoped_timer timer{metrics::phase::factorisation};
+
+    auto db = active_factor_db();
+    if (db) {
+      if (auto known = db->find(semiprime)) {
+        metrics::add(metrics::counter::factor_db_hits);
+        return std::move(*known);
+      }
+      metrics::add(metrics::counter::factor_db_misses);
+    }
+
     size_t bits = floor_log2(semiprime);
 
+    std::pair<bigint, bigint> ret;
     // Pollard takes a bit too long when bits >= 83 on my system, and I'll knock off a few "Windows points"
     if (bits < 70) {
-      auto p = pollard_rho(semiprime);
+      auto p = pollard_rho(semiprime, 0, ckpt, job);
       auto q = semiprime / p;
-      return {p, q};
+      ret = {p, q};
     }
     // TODO: make this use quadratic sieve
     else {
-      auto p = pollard_rho(semiprime);
+      auto p = pollard_rho(semiprime, 0, ckpt, job);
       auto q = semiprime / p;
-      return {p, q};
+      ret = {p, q};
     }
+
+    // A prime "semiprime" only factorises as itself and 1, which is not worth remembering
+    if (db && ret.first > 1 && ret.second > 1)
+      remember_factors(*db, semiprime, ret.first, ret.second);
+    return ret;
   }
 
-  bigint ascii2bigint(std::string_view str) {
-    bigint data = 0;
-    for (auto i : str) {
-      // Cast the character to an unsigned integer type, and add it to the end of the number
-      data <<= 8;
-      data += static_cast<unsigned char>(i);
+  std::pair<bigint, bigint> recover_factors(const bigint& n, const bigint& e, const bigint& d) {
+    // Write e*d - 1 as 2^s * t
+    bigint t = e * d - 1;
+    size_t s = 0;
+    while (t != 0 && t % 2 == 0) {
+      t >>= 1;
+      ++s;
     }
-    return data;
+    if (s == 0)
+      throw std::invalid_argument("The exponents do not belong to this modulus!");
+
+    const bigint n_minus_1 = n - 1;
+    // Half of all bases will work, so we will not need to go far
+    for (bigint g = 2; g < n && g < 1000; ++g) {
+      bigint x = bmp::powm(g, t, n);
+      for (size_t i = 0; i < s; ++i) {
+        bigint y = bmp::powm(x, 2, n);
+        // x is a square root of 1 that is not +-1, so it shares a factor with n
+        if (y == 1 && x != 1 && x != n_minus_1) {
+          bigint p = egcd(x - 1, n).gcd;
+          bigint q = n / p;
+          return {std::move(p), std::move(q)};
+        }
+        x = std::move(y);
+      }
+    }
+    throw std::invalid_argument("The exponents do not belong to this modulus!");
+  }
+
+  size_t byte_length(const bigint& i) {
+    return (floor_log2(i) + 7) / 8;
+  }
+
+  void bytes2bigint(std::span<const std::byte> bytes, bigint& out) {
+    // Most significant word first, 1 byte words, native endianness for the words (irrelevant for bytes), no nails
+    mpz_import(out.backend().data(), bytes.size(), 1, 1, 0, 0, bytes.data());
+  }
+
+  bigint bytes2bigint(std::span<const std::byte> bytes) {
+    bigint ret;
+    bytes2bigint(bytes, ret);
+    return ret;
+  }
+
+  size_t bigint2bytes(const bigint& i, std::span<std::byte> out) {
+    const auto len = byte_length(i);
+    if (out.size() < len)
+      throw std::length_error("Output buffer is too small for the number");
+    if (len)
+      mpz_export(out.data(), nullptr, 1, 1, 0, 0, i.backend().data());
+    return len;
+  }
+
+  std::vector<std::byte> bigint2bytes(const bigint& i) {
+    std::vector<std::byte> ret(byte_length(i));
+    bigint2bytes(i, ret);
+    return ret;
+  }
+
+  void bigint2bytes_padded(const bigint& i, std::span<std::byte> out) {
+    const auto len = byte_length(i);
+    if (out.size() < len)
+      throw std::length_error("Output buffer is too small for the number");
+    const auto padding = out.size() - len;
+    std::fill(out.begin(), out.begin() + padding, std::byte{0});
+    bigint2bytes(i, out.subspan(padding));
+  }
+
+  void ascii2bigint(std::string_view str, bigint& out) {
+    bytes2bigint(std::as_bytes(std::span{str.data(), str.size()}), out);
+  }
+
+  bigint ascii2bigint(std::string_view str) {
+    bigint ret;
+    ascii2bigint(str, ret);
+    return ret;
   }
 
   bigint ascii2bigint(std::istream& in) {
-    bigint data = 0;
-    // Keep going until the end of the file
-    while (!in.eof()) {
-      data <<= 8;
-      data += in.get();
-    }
-    return data;
+    // Slurp it all up, and import it in one go
+    std::string data{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+    return ascii2bigint(data);
   }
 
-  std::string bigint2ascii(bigint data) {
-    std::string str;
-    str.reserve(2048);
-    // Read the string backwards
-    while (data) {
-      str.push_back(static_cast<char>(data & 0xFF));
-      data >>= 8;
+  size_t bigint2ascii(const bigint& i, std::span<char> out) {
+    return bigint2bytes(i, std::as_writable_bytes(out));
+  }
+
+  std::string bigint2ascii(const bigint& i) {
+    std::string ret(byte_length(i), '\0');
+    bigint2ascii(i, ret);
+    return ret;
+  }
+
+  namespace {
+    // Maps each char to its hex digit value, or 0xFF if it is not a hex digit
+    constexpr std::array<unsigned char, 256> hex_digit_table = []() {
+      std::array<unsigned char, 256> ret{};
+      for (auto& i : ret) i = 0xFF;
+      for (int i = 0; i < 10; ++i) ret['0' + i] = i;
+      for (int i = 0; i < 6; ++i) ret['a' + i] = ret['A' + i] = 10 + i;
+      return ret;
+    }();
+  }
+
+  void hex2bigint(std::string_view hex, bigint& out) {
+    auto* z = out.backend().data();
+    constexpr size_t digits_per_limb = GMP_NUMB_BITS / 4;
+    const size_t n_limbs = (hex.size() + digits_per_limb - 1) / digits_per_limb;
+    if (!n_limbs) {
+      mpz_set_ui(z, 0);
+      return;
     }
-    std::reverse(str.begin(), str.end());
-    return str;
+
+    // Fill the limbs directly, starting from the least significant digit at the end of the string
+    mp_limb_t* limbs = mpz_limbs_write(z, n_limbs);
+    const char* digit_ptr = hex.data() + hex.size();
+    for (size_t limb_i = 0; limb_i < n_limbs; ++limb_i) {
+      const size_t n_digits = std::min(digits_per_limb, static_cast<size_t>(digit_ptr - hex.data()));
+      mp_limb_t limb = 0;
+      // Or-ing all the digits together lets us check them all at once
+      unsigned char invalid = 0;
+      for (size_t shift = 0; shift < n_digits * 4; shift += 4) {
+        const auto digit = hex_digit_table[static_cast<unsigned char>(*--digit_ptr)];
+        invalid |= digit;
+        limb |= static_cast<mp_limb_t>(digit) << shift;
+      }
+      if (invalid & 0xF0) {
+        // Leave out in a valid state before bailing
+        mpz_limbs_finish(z, 0);
+        throw std::invalid_argument("Invalid hexadecimal number");
+      }
+      limbs[limb_i] = limb;
+    }
+    // This trims any leading zero limbs
+    mpz_limbs_finish(z, n_limbs);
   }
 
-  bigint hex2bigint(std::string_view str) {
-    // A slow way of doing it, but this is not a bottleneck
-    std::string con_str{"0x"};
-    con_str += str;
-    return bigint{con_str};
+  bigint hex2bigint(std::string_view hex) {
+    bigint ret;
+    hex2bigint(hex, ret);
+    return ret;
   }
 }
@@ -0,0 +1,230 @@
+#include <rubbishrsa/metrics.hpp>
+
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace rubbishrsa::metrics {
+  namespace {
+    using clock = std::chrono::steady_clock;
+
+    constexpr size_t n_counters = static_cast<size_t>(counter::count_);
+    constexpr size_t n_phases = static_cast<size_t>(phase::count_);
+    // Stops a long traced run from eating all the memory
+    constexpr size_t max_events_per_thread = 1 << 20;
+
+    struct trace_event {
+      uint64_t tid;
+      phase p;
+      clock::time_point start, end;
+    };
+
+    struct thread_state;
+
+    // Everything that outlives a single thread
+    struct registry {
+      std::mutex mutex;
+      std::vector<thread_state*> live;
+      std::array<uint64_t, n_counters> retired_counters{};
+      std::array<uint64_t, n_phases> retired_phase_count{}, retired_phase_ns{};
+      std::vector<trace_event> retired_events;
+      uint64_t dropped_events = 0;
+      uint64_t next_tid = 1;
+      clock::time_point epoch = clock::now();
+    };
+
+    registry& reg() {
+      static registry instance;
+      return instance;
+    }
+
+    // Each thread only ever writes to its own state, so the counters need no read-modify-write atomics
+    struct thread_state {
+      uint64_t tid;
+      std::array<std::atomic<uint64_t>, n_counters> counters{};
+      std::array<std::atomic<uint64_t>, n_phases> phase_count{}, phase_ns{};
+      // Only taken when tracing, and only contended when exporting
+      std::mutex events_mutex;
+      std::vector<trace_event> events;
+      uint64_t dropped_events = 0;
+
+      thread_state() {
+        auto& r = reg();
+        std::unique_lock lock{r.mutex};
+        tid = r.next_tid++;
+        r.live.push_back(this);
+      }
+
+      ~thread_state() {
+        // Fold everything into the registry, so nothing is lost when the thread finishes
+        auto& r = reg();
+        std::unique_lock lock{r.mutex};
+        for (size_t i = 0; i < n_counters; ++i)
+          r.retired_counters[i] += counters[i].load(std::memory_order_relaxed);
+        for (size_t i = 0; i < n_phases; ++i) {
+          r.retired_phase_count[i] += phase_count[i].load(std::memory_order_relaxed);
+          r.retired_phase_ns[i] += phase_ns[i].load(std::memory_order_relaxed);
+        }
+        std::unique_lock events_lock{events_mutex};
+        r.retired_events.insert(r.retired_events.end(), events.begin(), events.end());
+        r.dropped_events += dropped_events;
+        std::erase(r.live, this);
+      }
+    };
+
+    thread_state& local() {
+      thread_local thread_state state;
+      return state;
+    }
+
+    void bump(std::atomic<uint64_t>& value, uint64_t n) {
+      value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    double seconds(clock::duration d) {
+      return std::chrono::duration<double>(d).count();
+    }
+
+    double micros_since(clock::time_point epoch, clock::time_point t) {
+      return std::chrono::duration<double, std::micro>(t - epoch).count();
+    }
+  }
+
+  const char* name(counter c) {
+    switch (c) {
+      case counter::prime_candidates: return "prime_candidates";
+      case counter::miller_rabin_rounds: return "miller_rabin_rounds";
+      case counter::rho_iterations: return "rho_iterations";
+      case counter::brute_candidates: return "brute_candidates";
+      case counter::sig_candidates: return "sig_candidates";
+      case counter::gmp_allocations: return "gmp_allocations";
+      case counter::heap_allocations: return "heap_allocations";
+      case counter::context_cache_hits: return "context_cache_hits";
+      case counter::context_cache_misses: return "context_cache_misses";
+      case counter::factor_db_hits: return "factor_db_hits";
+      case counter::factor_db_misses: return "factor_db_misses";
+      default: return "unknown";
+    }
+  }
+
+  const char* name(phase p) {
+    switch (p) {
+      case phase::prime_generation: return "prime_generation";
+      case phase::prime_test: return "prime_test";
+      case phase::sieve: return "sieve";
+      case phase::factorisation: return "factorisation";
+      case phase::brute_force: return "brute_force";
+      case phase::key_io: return "key_io";
+      case phase::crt: return "crt";
+      case phase::lattice: return "lattice";
+      default: return "unknown";
+    }
+  }
+
+  void detail::add(counter c, uint64_t n) {
+    bump(local().counters[static_cast<size_t>(c)], n);
+  }
+
+  void detail::record(phase p, clock::time_point start, clock::time_point end) {
+    auto& state = local();
+    if (stats_enabled()) {
+      bump(state.phase_count[static_cast<size_t>(p)], 1);
+      bump(state.phase_ns[static_cast<size_t>(p)], std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }
+    if (trace_enabled()) {
+      std::unique_lock lock{state.events_mutex};
+      if (state.events.size() < max_events_per_thread)
+        state.events.push_back({state.tid, p, start, end});
+      else
+        ++state.dropped_events;
+    }
+  }
+
+  void enable(bool stats, bool trace) {
+    reset();
+    detail::stats_on = stats;
+    detail::trace_on = trace;
+  }
+
+  void reset() {
+    auto& r = reg();
+    std::unique_lock lock{r.mutex};
+    for (auto* state : r.live) {
+      for (auto& i : state->counters) i = 0;
+      for (auto& i : state->phase_count) i = 0;
+      for (auto& i : state->phase_ns) i = 0;
+      std::unique_lock events_lock{state->events_mutex};
+      state->events.clear();
+      state->dropped_events = 0;
+    }
+    r.retired_counters = {};
+    r.retired_phase_count = {};
+    r.retired_phase_ns = {};
+    r.retired_events.clear();
+    r.dropped_events = 0;
+    r.epoch = clock::now();
+  }
+
+  uint64_t total(counter c) {
+    auto& r = reg();
+    std::unique_lock lock{r.mutex};
+    auto ret = r.retired_counters[static_cast<size_t>(c)];
+    for (auto* state : r.live)
+      ret += state->counters[static_cast<size_t>(c)].load(std::memory_order_relaxed);
+    return ret;
+  }
+
+  void write_stats_json(std::ostream& os) {
+    auto& r = reg();
+    std::unique_lock lock{r.mutex};
+    const double elapsed = seconds(clock::now() - r.epoch);
+
+    auto counters = r.retired_counters;
+    auto phase_count = r.retired_phase_count;
+    auto phase_ns = r.retired_phase_ns;
+    for (auto* state : r.live) {
+      for (size_t i = 0; i < n_counters; ++i)
+        counters[i] += state->counters[i].load(std::memory_order_relaxed);
+      for (size_t i = 0; i < n_phases; ++i) {
+        phase_count[i] += state->phase_count[i].load(std::memory_order_relaxed);
+        phase_ns[i] += state->phase_ns[i].load(std::memory_order_relaxed);
+      }
+    }
+
+    os << std::setprecision(9)
+       << "{\n  \"elapsed_seconds\": " << elapsed << ",\n  \"counters\": {";
+    for (size_t i = 0; i < n_counters; ++i)
+      os << (i ? ",\n" : "\n") << "    \"" << name(static_cast<counter>(i)) << "\": {\"total\": " << counters[i]
+         << ", \"per_second\": " << (elapsed > 0 ? counters[i] / elapsed : 0) << '}';
+    os << "\n  },\n  \"phases\": {";
+    for (size_t i = 0; i < n_phases; ++i)
+      os << (i ? ",\n" : "\n") << "    \"" << name(static_cast<phase>(i)) << "\": {\"count\": " << phase_count[i]
+         << ", \"total_seconds\": " << phase_ns[i] / 1e9 << '}';
+    os << "\n  }\n}\n";
+  }
+
+  void write_chrome_trace(std::ostream& os) {
+    auto& r = reg();
+    std::unique_lock lock{r.mutex};
+
+    std::vector<trace_event> events = r.retired_events;
+    uint64_t dropped = r.dropped_events;
+    for (auto* state : r.live) {
+      std::unique_lock events_lock{state->events_mutex};
+      events.insert(events.end(), state->events.begin(), state->events.end());
+      dropped += state->dropped_events;
+    }
+
+    // Complete ("X") events, with times in microseconds since the metrics were enabled
+    os << std::fixed << std::setprecision(3) << "{\"traceEvents\": [";
+    for (size_t i = 0; i < events.size(); ++i) {
+      const auto& e = events[i];
+      os << (i ? ",\n" : "\n") << "{\"name\": \"" << name(e.p) << "\", \"cat\": \"rubbishrsa\", \"ph\": \"X\", \"pid\": 1"
+         << ", \"tid\": " << e.tid
+         << ", \"ts\": " << micros_since(r.epoch, e.start)
+         << ", \"dur\": " << micros_since(e.start, e.end) << '}';
+    }
+    os << "\n], \"displayTimeUnit\": \"ms\", \"otherData\": {\"dropped_events\": " << dropped << "}}\n";
+  }
+}
@@ -0,0 +1,475 @@
+#include <rubbishrsa/server.hpp>
+
+#include <rubbishrsa/attack.hpp>
+#include <rubbishrsa/job.hpp>
+#include <rubbishrsa/log.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <filesystem>
+#include <iomanip>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <thread>
+
+namespace rubbishrsa::server {
+  namespace {
+    namespace asio = boost::asio;
+    using protocol = asio::local::stream_protocol;
+    using clock = std::chrono::steady_clock;
+
+    // Anything bigger than this is not a request for a key of any sensible size, and the connection is dropped
+    constexpr uint32_t max_request_size = 1 << 20;
+
+    constexpr std::array<std::string_view, 6> operation_names = {"enc", "dec", "sign", "verify", "crack", "stats"};
+
+    // Something wrong with a single request, which is answered with the message rather than dropping the connection
+    struct request_error : std::runtime_error {
+      using std::runtime_error::runtime_error;
+    };
+
+    // Counts latencies in buckets that are each about 6% wide, so that any percentile can be read off later
+    //
+    // Recording is a single relaxed increment, so that every worker can record without taking a lock
+    class latency_histogram {
+    public:
+      void record(clock::duration latency) {
+        const auto ns = static_cast<uint64_t>(std::max<int64_t>(std::chrono::nanoseconds{latency}.count(), 0));
+        buckets[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+      }
+
+      /// Writes the count, the percentiles and the maximum (in microseconds) as a JSON object
+      void write_json(std::ostream& os) const {
+        std::array<uint64_t, n_buckets> counts;
+        uint64_t total = 0;
+        for (size_t i = 0; i < n_buckets; ++i)
+          total += counts[i] = buckets[i].load(std::memory_order_relaxed);
+
+        os << "{\"count\": " << total;
+        for (auto [label, q] : {std::pair{"p50", 0.5}, {"p90", 0.9}, {"p99", 0.99}, {"p999", 0.999}, {"max", 1.0}}) {
+          const auto target = static_cast<uint64_t>(std::ceil(q * static_cast<double>(total)));
+          uint64_t seen = 0;
+          size_t i = 0;
+          for (; total && i < n_buckets; ++i) {
+            if ((seen += counts[i]) >= std::max<uint64_t>(target, 1))
+              break;
+          }
+          os << ", \"" << label << "_us\": " << (total ? static_cast<double>(bucket_top(i)) / 1e3 : 0);
+        }
+        os << '}';
+      }
+
+    private:
+      // Each power of two is split into 16 buckets
+      static constexpr unsigned int sub_bucket_bits = 4;
+      static constexpr size_t n_buckets = (64 - sub_bucket_bits + 1) << sub_bucket_bits;
+
+      std::array<std::atomic<uint64_t>, n_buckets> buckets = {};
+
+      static size_t bucket_of(uint64_t ns) {
+        if (ns < (uint64_t{1} << sub_bucket_bits))
+          return ns;
+        const unsigned int shift = std::bit_width(ns) - 1 - sub_bucket_bits;
+        return ((shift + 1) << sub_bucket_bits) + ((ns >> shift) & ((1 << sub_bucket_bits) - 1));
+      }
+
+      // The largest latency that goes in the bucket
+      static uint64_t bucket_top(size_t bucket) {
+        if (bucket < (size_t{1} << sub_bucket_bits))
+          return bucket;
+        const unsigned int shift = (bucket >> sub_bucket_bits) - 1;
+        const uint64_t mantissa = (bucket & ((1 << sub_bucket_bits) - 1)) | (uint64_t{1} << sub_bucket_bits);
+        return ((mantissa + 1) << shift) - 1;
+      }
+    };
+
+    struct request {
+      operation op = operation::stats;
+      uint64_t id = 0;
+      std::string key;
+      bigint data;
+      bool is_json;
+    };
+
+    uint64_t read_be(const unsigned char* bytes, size_t len) {
+      uint64_t ret = 0;
+      for (size_t i = 0; i < len; ++i)
+        ret = (ret << 8) | bytes[i];
+      return ret;
+    }
+
+    void write_be(std::string& out, uint64_t value, size_t len) {
+      for (size_t i = len; i--;)
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+
+    operation parse_operation(std::string_view name) {
+      for (size_t i = 0; i < operation_names.size(); ++i) {
+        if (operation_names[i] == name)
+          return static_cast<operation>(i + 1);
+      }
+      throw request_error("Unknown op '" + std::string{name} + "'");
+    }
+
+    // Fills in as much of req as it can before throwing, so that an error can still be matched to its request
+    void parse_request(std::string_view body, request& req) {
+      req.is_json = body.size() && body.front() == '{';
+      if (req.is_json) {
+        boost::property_tree::ptree tree;
+        try {
+          std::istringstream ss{std::string{body}};
+          boost::property_tree::read_json(ss, tree);
+          req.id = tree.get<uint64_t>("id", 0);
+          req.op = parse_operation(tree.get<std::string>("op"));
+          req.key = tree.get<std::string>("key", "");
+          req.data = hex2bigint(tree.get<std::string>("data", "0"));
+        }
+        catch (const request_error&) {
+          throw;
+        }
+        catch (const std::exception& e) {
+          throw request_error(std::string{"Bad JSON request: "} + e.what());
+        }
+        return;
+      }
+
+      const auto* bytes = reinterpret_cast<const unsigned char*>(body.data());
+      if (body.size() < 10)
+        throw request_error("Truncated request");
+      req.id = read_be(bytes + 1, 8);
+      const auto op = bytes[0];
+      if (op < 1 || op > operation_names.size())
+        throw request_error("Unknown op " + std::to_string(op));
+      req.op = static_cast<operation>(op);
+      const size_t key_len = bytes[9];
+      if (body.size() < 10 + key_len)
+        throw request_error("Truncated request");
+      req.key = body.substr(10, key_len);
+      req.data = bytes2bigint(std::as_bytes(std::span{body.substr(10 + key_len)}));
+    }
+
+    std::string json_escape(std::string_view str) {
+      std::string ret;
+      for (char c : str) {
+        if (c == '"' || c == '\\') {
+          ret.push_back('\\');
+          ret.push_back(c);
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+          std::ostringstream ss;
+          ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c);
+          ret += ss.str();
+        }
+        else
+          ret.push_back(c);
+      }
+      return ret;
+    }
+
+    // Frames the body with its length
+    std::string frame(std::string_view body) {
+      std::string ret;
+      ret.reserve(4 + body.size());
+      write_be(ret, body.size(), 4);
+      ret += body;
+      return ret;
+    }
+
+    class server {
+    public:
+      server(asio::io_context& io, const std::string& socket_path, const options& opts) :
+        io{io}, acceptor{io, protocol::endpoint{socket_path}}, signals{io}, opts{opts},
+        workers{opts.thread_count ? opts.thread_count : std::thread::hardware_concurrency()} {
+        if (!opts.max_in_flight)
+          throw std::invalid_argument("At least one request must be allowed in flight");
+        if (opts.stop_on_signals) {
+          signals.add(SIGINT);
+          signals.add(SIGTERM);
+          signals.async_wait([this](boost::system::error_code ec, int) {
+            if (!ec)
+              stop();
+          });
+        }
+        accept();
+      }
+
+      // Only to be called on the io thread
+      void stop() {
+        if (stopping)
+          return;
+        stopping = true;
+        RUBBISHRSA_LOG_INFO(std::cerr << "Shutting down" << std::endl);
+        cancel_jobs.request_stop();
+        boost::system::error_code ignored;
+        acceptor.close(ignored);
+        signals.cancel(ignored);
+        io.stop();
+      }
+
+      // Waits for the requests already being worked on, which have all been cancelled if they were cracks
+      void join() {
+        workers.join();
+      }
+
+      void write_stats_json(std::ostream& os) const {
+        os << '{';
+        for (size_t i = 0; i < latencies.size(); ++i) {
+          os << (i ? ", " : "") << '"' << operation_names[i] << "\": ";
+          latencies[i].write_json(os);
+        }
+        os << '}';
+      }
+
+    private:
+      struct connection {
+        uint64_t id;
+        protocol::socket socket;
+        std::array<unsigned char, 4> length;
+        std::string body;
+        std::deque<std::string> outbox;
+        size_t in_flight = 0;
+        bool reading = false, closed = false;
+
+        connection(uint64_t id, protocol::socket socket) : id{id}, socket{std::move(socket)} {}
+      };
+      using connection_ptr = std::shared_ptr<connection>;
+
+      asio::io_context& io;
+      protocol::acceptor acceptor;
+      asio::signal_set signals;
+      const options& opts;
+      asio::thread_pool workers;
+      std::stop_source cancel_jobs;
+      // Each crack takes every core, so only opts.max_cracks of them may run at once
+      std::atomic<unsigned int> cracks_running = 0;
+      std::array<latency_histogram, operation_names.size()> latencies;
+      uint64_t next_connection = 0;
+      bool stopping = false;
+
+      void accept() {
+        acceptor.async_accept([this](boost::system::error_code ec, protocol::socket socket) {
+          if (ec)
+            return;
+          auto c = std::make_shared<connection>(next_connection++, std::move(socket));
+          RUBBISHRSA_LOG_TRACE(std::cerr << "Client " << c->id << " connected" << std::endl);
+          read(c);
+          accept();
+        });
+      }
+
+      void close(const connection_ptr& c) {
+        if (c->closed)
+          return;
+        c->closed = true;
+        boost::system::error_code ignored;
+        c->socket.close(ignored);
+        RUBBISHRSA_LOG_TRACE(std::cerr << "Client " << c->id << " disconnected" << std::endl);
+      }
+
+      void read(connection_ptr c) {
+        c->reading = true;
+        asio::async_read(c->socket, asio::buffer(c->length), [this, c](boost::system::error_code ec, size_t) {
+          if (ec) {
+            close(c);
+            return;
+          }
+          const auto len = static_cast<uint32_t>(read_be(c->length.data(), c->length.size()));
+          if (len > max_request_size) {
+            RUBBISHRSA_LOG_INFO(std::cerr << "Dropping client " << c->id << ", who sent a request of " << len << " bytes" << std::endl);
+            close(c);
+            return;
+          }
+          c->body.resize(len);
+          asio::async_read(c->socket, asio::buffer(c->body), [this, c](boost::system::error_code ec, size_t) {
+            c->reading = false;
+            if (ec) {
+              close(c);
+              return;
+            }
+            dispatch(c, std::move(c->body), clock::now());
+            // Once enough requests are in flight, we wait for one to finish before reading any more
+            if (c->in_flight < opts.max_in_flight)
+              read(c);
+          });
+        });
+      }
+
+      void dispatch(const connection_ptr& c, std::string body, clock::time_point arrived) {
+        ++c->in_flight;
+        asio::post(workers, [this, c, body = std::move(body), arrived]() {
+          request req;
+          std::string response;
+          bool ok = true;
+          try {
+            parse_request(body, req);
+            response = handle(req);
+          }
+          catch (const std::exception& e) {
+            ok = false;
+            response = e.what();
+          }
+          response = frame(req.is_json ? json_response(req, ok, response) : binary_response(req, ok, response));
+          if (ok)
+            latencies[static_cast<size_t>(req.op) - 1].record(clock::now() - arrived);
+
+          asio::post(io, [this, c, response = std::move(response)]() mutable {
+            --c->in_flight;
+            if (c->closed)
+              return;
+            send(c, std::move(response));
+            if (!c->reading && c->in_flight < opts.max_in_flight)
+              read(c);
+          });
+        });
+      }
+
+      void send(const connection_ptr& c, std::string framed) {
+        c->outbox.push_back(std::move(framed));
+        if (c->outbox.size() == 1)
+          write(c);
+      }
+
+      void write(connection_ptr c) {
+        asio::async_write(c->socket, asio::buffer(c->outbox.front()), [this, c](boost::system::error_code ec, size_t) {
+          // Errors are left to the reader to notice
+          if (ec)
+            return;
+          c->outbox.pop_front();
+          if (c->outbox.size())
+            write(c);
+        });
+      }
+
+      // Finds a key that can do the op, preferring the private keys
+      const public_key& find_public_key(const std::string& name) const {
+        if (auto iter = opts.private_keys.find(name); iter != opts.private_keys.end())
+          return iter->second;
+        if (auto iter = opts.public_keys.find(name); iter != opts.public_keys.end())
+          return iter->second;
+        throw request_error("Unknown key '" + name + "'");
+      }
+
+      const private_key& find_private_key(const std::string& name) const {
+        if (auto iter = opts.private_keys.find(name); iter != opts.private_keys.end())
+          return iter->second;
+        if (opts.public_keys.count(name))
+          throw request_error("Key '" + name + "' is only a public key");
+        throw request_error("Unknown key '" + name + "'");
+      }
+
+      static void check_fits(const bigint& data, const public_key& key) {
+        if (data >= key.n)
+          throw request_error("The data is too big for a modulus this small");
+      }
+
+      // Does the work for a request, and returns the result (as hex for JSON, and bytes for binary)
+      std::string handle(const request& req) {
+        bigint result;
+        switch (req.op) {
+          case operation::enc: {
+            const auto& key = find_public_key(req.key);
+            check_fits(req.data, key);
+            key.raw_encrypt(req.data, result);
+            break;
+          }
+          case operation::dec: {
+            const auto& key = find_private_key(req.key);
+            check_fits(req.data, key);
+            result = key.raw_decrypt(req.data);
+            break;
+          }
+          case operation::sign: {
+            const auto& key = find_private_key(req.key);
+            check_fits(req.data, key);
+            result = key.raw_sign(req.data);
+            break;
+          }
+          case operation::verify: {
+            const auto& key = find_public_key(req.key);
+            check_fits(req.data, key);
+            key.raw_verify(req.data, result);
+            break;
+          }
+          case operation::crack: {
+            public_key key;
+            if (req.key.size())
+              key = find_public_key(req.key);
+            else
+              key.n = req.data;
+            if (key.n < 4)
+              throw request_error("There is no modulus to crack");
+            struct crack_slot {
+              std::atomic<unsigned int>& running;
+              ~crack_slot() { --running; }
+            } slot{cracks_running};
+            if (cracks_running++ >= opts.max_cracks)
+              throw request_error("Too many cracks are already running");
+            job_control job{{cancel_jobs.get_token()}};
+            result = attack::crack_key(key, nullptr, &job).d;
+            break;
+          }
+          case operation::stats: {
+            std::ostringstream ss;
+            write_stats_json(ss);
+            return ss.str();
+          }
+        }
+        if (req.is_json)
+          return result.str(0, std::ios::hex);
+        auto bytes = bigint2bytes(result);
+        return {reinterpret_cast<const char*>(bytes.data()), bytes.size()};
+      }
+
+      static std::string json_response(const request& req, bool ok, const std::string& result) {
+        std::string ret = "{\"id\": " + std::to_string(req.id);
+        if (!ok)
+          ret += ", \"error\": \"" + json_escape(result) + "\"}";
+        // The stats are JSON already
+        else if (req.op == operation::stats)
+          ret += ", \"result\": " + result + '}';
+        else
+          ret += ", \"result\": \"" + result + "\"}";
+        return ret;
+      }
+
+      static std::string binary_response(const request& req, bool ok, const std::string& result) {
+        std::string ret;
+        ret.reserve(9 + result.size());
+        write_be(ret, req.id, 8);
+        ret.push_back(ok ? 0 : 1);
+        ret += result;
+        return ret;
+      }
+    };
+  }
+
+  void serve(const std::string& socket_path, const options& opts, std::stop_token stop) {
+    // Clear away the socket from any previous run, or else we cannot bind, but nothing else, as the path could
+    // easily be a typo
+    if (std::filesystem::is_socket(socket_path))
+      std::filesystem::remove(socket_path);
+    else if (std::filesystem::exists(socket_path))
+      throw std::invalid_argument("'" + socket_path + "' already exists, and is not a socket");
+
+    asio::io_context io;
+    server s{io, socket_path, opts};
+    std::stop_callback on_stop{stop, [&]() { asio::post(io, [&]() { s.stop(); }); }};
+
+    RUBBISHRSA_LOG_INFO(std::cerr << "Serving " << opts.private_keys.size() + opts.public_keys.size()
+                                  << " keys on " << socket_path << std::endl);
+    io.run();
+    s.join();
+
+    if (std::filesystem::is_socket(socket_path))
+      std::filesystem::remove(socket_path);
+    RUBBISHRSA_LOG_INFO(std::cerr << "Latencies: "; s.write_stats_json(std::cerr); std::cerr << std::endl);
+  }
+}
@@ -0,0 +1,45 @@
+#include "test.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace rubbishrsa::test {
+  void batch_modinv() {
+    const bigint p = fixed_prime(128, 1), q = fixed_prime(128, 2), n = p * q;
+
+    // Big enough to be split between threads, with a few values that share a factor with n scattered through it
+    std::vector<bigint> values;
+    std::vector<size_t> non_invertible;
+    bigint x = 12345;
+    for (size_t i = 0; i < 5000; ++i) {
+      x = (x * x + 1) % n;
+      if (i % 997 == 3) {
+        non_invertible.push_back(i);
+        values.push_back(i % 2 ? p * i : q);
+      } else {
+        values.push_back(x);
+      }
+    }
+    values.push_back(0);
+    non_invertible.push_back(values.size() - 1);
+
+    for (unsigned int threads : {1u, 4u}) {
+      const auto result = rubbishrsa::batch_modinv(values, n, threads);
+      const auto suffix = " (" + std::to_string(threads) + " threads)";
+      check(result.non_invertible == non_invertible, "the values sharing a factor with n are reported" + suffix);
+      bool all_match = result.inverses.size() == values.size();
+      for (size_t i = 0; all_match && i < values.size(); ++i) {
+        if (std::find(non_invertible.begin(), non_invertible.end(), i) != non_invertible.end())
+          all_match = result.inverses[i] == 0;
+        else
+          all_match = result.inverses[i] == modinv(values[i], n);
+      }
+      check(all_match, "every inverse matches modinv" + suffix);
+    }
+
+    const auto single = rubbishrsa::batch_modinv(std::span{values}.first(1), n, 1);
+    check(single.inverses == std::vector{modinv(values[0], n)} && single.non_invertible.empty(), "a single value");
+    const auto empty = rubbishrsa::batch_modinv({}, n, 1);
+    check(empty.inverses.empty() && empty.non_invertible.empty(), "no values");
+  }
+}
@@ -0,0 +1,73 @@
+#include "test.hpp"
+
+#include <rubbishrsa/blocks.hpp>
+
+#include <sstream>
+
+namespace rubbishrsa::test {
+  namespace {
+    std::string pattern(size_t size) {
+      std::string ret(size, '\0');
+      for (size_t i = 0; i < size; ++i)
+        ret[i] = static_cast<char>(i * 131 + 7);
+      return ret;
+    }
+  }
+
+  void blocks() {
+    const auto key = fixed_key(512);
+    const auto other = fixed_key(512, 2);
+    const size_t payload = block_payload_size(key.n);
+    check(payload == byte_length(key.n) - 3, "payload leaves room for the length and a byte of headroom");
+    check_throws<std::invalid_argument>([]() { (void)block_payload_size(bigint{0xFFFFFF}); }, "a modulus too small for blocks");
+
+    // Lengths either side of each block boundary, including nothing at all, with and without threads
+    for (size_t size : {size_t{0}, size_t{1}, payload - 1, payload, payload + 1, 2 * payload, 37 * payload + 5}) {
+      const auto message = pattern(size);
+      for (unsigned int threads : {1u, 3u}) {
+        std::istringstream in{message};
+        std::ostringstream encrypted;
+        encrypt_blocks(key, in, encrypted, threads);
+        check(encrypted.str().size() % byte_length(key.n) == 0, "encrypted blocks are the size of the modulus");
+
+        std::istringstream encrypted_in{encrypted.str()};
+        std::ostringstream decrypted;
+        decrypt_blocks(key, encrypted_in, decrypted, threads);
+        check(decrypted.str() == message, "decrypt_blocks reverses encrypt_blocks for " + std::to_string(size) + " bytes");
+
+        std::istringstream sign_in{message};
+        std::ostringstream signed_out;
+        sign_blocks(key, sign_in, signed_out, threads);
+        std::istringstream verify_in{signed_out.str()};
+        std::ostringstream verified;
+        verify_blocks(key, verify_in, verified, threads);
+        check(verified.str() == message, "verify_blocks recovers what sign_blocks signed for " + std::to_string(size) + " bytes");
+      }
+    }
+
+    const auto message = pattern(3 * payload + 10);
+    std::istringstream in{message};
+    std::ostringstream encrypted_out;
+    encrypt_blocks(key, in, encrypted_out);
+    const auto encrypted = encrypted_out.str();
+    auto decrypt = [](const private_key& k, const std::string& data) {
+      std::istringstream is{data};
+      std::ostringstream os;
+      decrypt_blocks(k, is, os);
+    };
+    check_throws<std::invalid_argument>([&]() { decrypt(key, encrypted.substr(0, encrypted.size() - 1)); },
+                                        "a stream cut off mid block");
+    check_throws<std::invalid_argument>([&]() { decrypt(key, encrypted.substr(0, encrypted.size() - byte_length(key.n))); },
+                                        "a stream missing its last block");
+    check_throws<std::invalid_argument>([&]() { decrypt(other, encrypted); }, "decrypting with the wrong key");
+
+    std::istringstream sign_in{message};
+    std::ostringstream signed_out;
+    sign_blocks(key, sign_in, signed_out);
+    auto tampered = signed_out.str();
+    tampered[byte_length(key.n) + 5] ^= 1;
+    std::istringstream verify_in{tampered};
+    std::ostringstream verified;
+    check_throws<std::invalid_argument>([&]() { verify_blocks(key, verify_in, verified); }, "a tampered signature block");
+  }
+}
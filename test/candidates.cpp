@@ -0,0 +1,90 @@
+#include "test.hpp"
+
+#include <rubbishrsa/candidates.hpp>
+
+#include <set>
+#include <sstream>
+
+namespace rubbishrsa::test {
+  void candidates() {
+    using attack::mask_generator;
+    using attack::mangle_rule;
+
+    // Every candidate, in order, from both at() and a cursor over the whole mask
+    {
+      mask_generator mask{"a?d?h"};
+      check(mask.size() == 160, "mask size is the product of its charsets");
+      check(mask.at(0) == "a00", "first candidate");
+      check(mask.at(17) == "a11", "candidates count up from the last position");
+      check(mask.at(159) == "a9f", "last candidate");
+      check_throws<std::out_of_range>([&]() { (void)mask.at(160); }, "index past the end");
+
+      auto cursor = mask.slice(0, mask.size());
+      bigint value;
+      bool all_match = true;
+      for (unsigned int i = 0; i < 160; ++i)
+        all_match &= cursor.next(value) && value == ascii2bigint(mask.at(i));
+      check(all_match, "cursor agrees with at()");
+      check(!cursor.next(value), "cursor stops at the end of its slice");
+    }
+
+    // A slice in the middle, crossing a wrap of the lower position
+    {
+      mask_generator mask{"?u?l"};
+      auto cursor = mask.slice(20, 10);
+      bigint value;
+      bool all_match = true;
+      for (unsigned int i = 20; i < 30; ++i)
+        all_match &= cursor.next(value) && value == ascii2bigint(mask.at(i));
+      check(all_match, "slice over a wrap agrees with at()");
+      check(!cursor.next(value), "slice yields exactly its count");
+    }
+
+    {
+      mask_generator mask{"??x"};
+      check(mask.size() == 1 && mask.at(0) == "?x", "?? is a literal question mark");
+      mask_generator::cursor empty;
+      bigint value;
+      check(!empty.next(value), "default constructed cursor is empty");
+    }
+    check_throws<std::invalid_argument>([]() { mask_generator{"ab?"}; }, "unfinished placeholder");
+    check_throws<std::invalid_argument>([]() { mask_generator{"?z"}; }, "unknown placeholder");
+
+    // The rules, against what hashcat gives
+    auto apply = [](std::string_view rule, std::string word) { return mangle_rule::parse(rule).apply(std::move(word)); };
+    check(apply(":", "p@ss") == "p@ss", ": does nothing");
+    check(apply("c $1 $!", "pASSWORD") == "Password1!", "capitalise and append");
+    check(apply("u", "abc") == "ABC" && apply("l", "AbC") == "abc" && apply("t", "AbC") == "aBc", "case rules");
+    check(apply("C", "abc") == "aBC", "C inverts capitalisation");
+    check(apply("T1", "abc") == "aBc" && apply("T9", "abc") == "abc", "toggle at a position, ignoring past the end");
+    check(apply("r", "abc") == "cba" && apply("d", "ab") == "abab" && apply("f", "ab") == "abba", "reverse, duplicate, reflect");
+    check(apply("{", "abc") == "bca" && apply("}", "abc") == "cab", "rotations");
+    check(apply("[", "abc") == "bc" && apply("]", "abc") == "ab", "truncations");
+    check(apply("D1", "abc") == "ac" && apply("'2", "abcd") == "ab", "delete at and truncate at");
+    check(apply("^x", "abc") == "xabc", "prepend");
+    check(apply("sa@", "banana") == "b@n@n@" && apply("@a", "banana") == "bnn", "substitute and purge");
+    check(apply("TA", std::string(11, 'a')) == "aaaaaaaaaaA", "positions past 9 are letters");
+    check_throws<std::invalid_argument>([]() { mangle_rule::parse("$"); }, "append without a character");
+    check_throws<std::invalid_argument>([]() { mangle_rule::parse("X"); }, "unknown rule function");
+
+    std::istringstream rules_file{"# a comment\n\nc\n$1\n"};
+    check(mangle_rule::parse_all(rules_file).size() == 2, "parse_all skips comments and blank lines");
+
+    // And both ends of it together, against a real (if tiny) key
+    const auto key = fixed_key(256);
+    {
+      mask_generator mask{"?l?d?d"};
+      const auto c = key.raw_encrypt(ascii2bigint("q42"));
+      auto found = attack::brute_force_ptext(key, c, mask, 2);
+      check(found && bigint2ascii(*found) == "q42", "mask brute force finds the message");
+      auto missing = attack::brute_force_ptext(key, key.raw_encrypt(ascii2bigint("Q42")), mask, 2);
+      check(!missing, "mask brute force gives up on a message outside the mask");
+    }
+    {
+      const std::vector<std::string> words{"dragon", "password", "monkey"};
+      std::vector<mangle_rule> rules{mangle_rule::parse(":"), mangle_rule::parse("c $1"), mangle_rule::parse("r")};
+      auto found = attack::brute_force_ptext(key, key.raw_encrypt(ascii2bigint("Password1")), words, rules, 2);
+      check(found && bigint2ascii(*found) == "Password1", "rule brute force finds the mangled word");
+    }
+  }
+}
@@ -0,0 +1,92 @@
+#include "test.hpp"
+
+#include <rubbishrsa/attack.hpp>
+#include <rubbishrsa/checkpoint.hpp>
+
+#include <filesystem>
+#include <fstream>
+
+namespace rubbishrsa::test {
+  namespace {
+    void write_file(const std::string& path, const std::string& contents) {
+      std::ofstream os{path};
+      os << contents;
+    }
+  }
+
+  void checkpoint() {
+    using rubbishrsa::checkpoint;
+    const auto path = temp_path("checkpoint");
+
+    // What is saved comes back
+    {
+      checkpoint saved{path, "the job", std::chrono::seconds{0}};
+      check(!saved.load(), "load is false without a file");
+      saved.set("a", bigint{"0x123456789abcdef0123456789"});
+      saved.set("b", 42ull);
+      saved.save();
+
+      checkpoint loaded{path, "the job"};
+      check(loaded.load(), "load is true with a file");
+      check(loaded.get_bigint("a") == bigint{"0x123456789abcdef0123456789"}, "bigints survive a save");
+      check(loaded.get_uint("b") == 42ull, "uints survive a save");
+      check(!loaded.get_uint("c"), "missing values are std::nullopt");
+
+      checkpoint other{path, "another job"};
+      check_throws<std::invalid_argument>([&]() { other.load(); }, "a checkpoint for another job");
+
+      loaded.remove();
+      check(!std::filesystem::exists(path), "remove deletes the file");
+    }
+
+    // Anything malformed is caught on load (or by the typed getters), rather than on a search's threads
+    for (const char* contents : {"job=j\nnot a pair\n", "job=j\nrho.x.0=zz\n", "job=j\nrho.x.0=\n"}) {
+      write_file(path, contents);
+      checkpoint bad{path, "j"};
+      check_throws<std::invalid_argument>([&]() { bad.load(); }, std::string{"malformed checkpoint: "} + contents);
+    }
+    {
+      write_file(path, "job=j\nrange.threads=ff\nbig=123456789012345678901234567890\n");
+      checkpoint typed{path, "j"};
+      typed.load();
+      check_throws<std::invalid_argument>([&]() { (void)typed.get_uint("range.threads"); }, "hex read as a uint");
+      check_throws<std::invalid_argument>([&]() { (void)typed.get_uint("big"); }, "a uint that does not fit");
+    }
+
+    // A save that cannot be written only fails for save() itself
+    {
+      checkpoint unwritable{temp_path("no-such-dir") + "/checkpoint", "j", std::chrono::seconds{0}};
+      unwritable.set("a", 1ull);
+      unwritable.maybe_save();
+      check(true, "maybe_save does not throw");
+      check_throws<std::exception>([&]() { unwritable.save(); }, "save throws if it cannot write");
+    }
+
+    // A range search resumes from its saved cursor: past the answer it misses it, and before it finds it
+    const auto key = fixed_key(256);
+    const bigint answer = 5000;
+    const auto c = key.raw_encrypt(answer);
+    for (auto [cursor, should_find] : {std::pair<bigint, bool>{answer + 1, false}, {answer - 100, true}}) {
+      write_file(path, "job=range\nrange.threads=1\nrange.cursor.0=" + cursor.str(0, std::ios::hex) + '\n');
+      checkpoint resumed{path, "range"};
+      resumed.load();
+      auto found = attack::brute_force_ptext(key, c, 0, 6000, 4, &resumed);
+      check(found.has_value() == should_find, "range search resumes from the saved cursor");
+      check(!found || *found == answer, "resumed range search finds the answer");
+    }
+
+    // Rho walks resume from their saved x and y, to the same factor
+    {
+      const auto n = fixed_prime(24, 1) * fixed_prime(24, 2);
+      const std::atomic<bool> stop = false;
+      bigint x = pollard_rho_start(0), y = x;
+      (void)pollard_rho_steps(n, x, y, 64, stop, pollard_rho_increment(0));
+      write_file(path, "job=rho\nrho.threads=1\nrho.x.0=" + x.str(0, std::ios::hex) + "\nrho.y.0=" + y.str(0, std::ios::hex) + '\n');
+      checkpoint resumed{path, "rho"};
+      resumed.load();
+      auto p = pollard_rho(n, 0, &resumed);
+      check(p > 1 && p < n && n % p == 0, "resumed rho finds a factor");
+    }
+    std::filesystem::remove(path);
+  }
+}
@@ -0,0 +1,69 @@
+#include "test.hpp"
+
+#include <rubbishrsa/context_cache.hpp>
+
+#include <vector>
+
+namespace rubbishrsa::test {
+  namespace {
+    /// A fixed key that has forgotten its primes, as one loaded from JSON has
+    private_key without_primes(uint64_t seed) {
+      auto key = fixed_key(256, seed);
+      key.primes.clear();
+      return key;
+    }
+  }
+
+  void context_cache() {
+    const auto key = without_primes(1);
+
+    // The CRT gives the same answer as a plain exponentiation, including for values that share a factor with n
+    {
+      const auto ctx = key_context::from_private_key(key);
+      check(ctx.p * ctx.q == key.n, "the context recovers the factors");
+      bool all_match = true;
+      for (const bigint& x : std::vector<bigint>{0, 1, 2, key.n - 1, ctx.p, ctx.q * 5, bigint{"0x123456789abcdef"}})
+        all_match = all_match && ctx.exponentiate_private(x) == bmp::powm(x, key.d, key.n);
+      check(all_match, "exponentiate_private matches powm");
+    }
+
+    // Least recently used contexts are dropped first, but stay valid while they are held
+    {
+      const auto keys = std::vector{without_primes(1), without_primes(2), without_primes(3)};
+      rubbishrsa::context_cache cache{key_context::from_private_key(keys[0]).memory_used() * 5 / 2};
+      const auto first = cache.get(keys[0]);
+      cache.get(keys[1]);
+      check(cache.get(keys[0]) == first, "a cached context is reused");
+      cache.get(keys[2]);
+      auto stats = cache.stats();
+      check(stats.hits == 1 && stats.misses == 3 && stats.evictions == 1 && stats.entries == 2, "the cache counts");
+
+      // keys[1] was the least recently used
+      cache.get(keys[0]);
+      check(cache.stats().hits == 2, "the recently used context is kept");
+      cache.get(keys[1]);
+      check(cache.stats().misses == 4, "the least recently used context is dropped");
+
+      cache.clear();
+      check(cache.stats().entries == 0 && cache.stats().bytes == 0, "clear empties the cache");
+      check(first->exponentiate_private(2) == bmp::powm(bigint{2}, keys[0].d, keys[0].n), "a held context outlives the cache entry");
+
+      cache.set_max_bytes(0);
+      cache.get(keys[0]);
+      check(cache.stats().entries == 0, "nothing is kept without room");
+    }
+
+    // Once enabled, keys without primes go through the shared cache, and still give the right answers
+    {
+      enable_context_cache(1 << 20);
+      const auto before = shared_context_cache().stats();
+      const bigint m = 0xbeef;
+      const bool decrypts = key.raw_decrypt(key.raw_encrypt(m)) == m && key.raw_sign(m) == bmp::powm(m, key.d, key.n);
+      const auto after = shared_context_cache().stats();
+      enable_context_cache(0);
+      check(decrypts, "decryption and signing through the shared cache");
+      check(after.misses == before.misses + 1 && after.hits == before.hits + 1, "the shared cache is used");
+      check(key.raw_decrypt(key.raw_encrypt(m)) == m, "decryption once the cache is turned off");
+    }
+  }
+}
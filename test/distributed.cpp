@@ -0,0 +1,61 @@
+#include "test.hpp"
+
+#include <rubbishrsa/distributed.hpp>
+
+#include <boost/system/system_error.hpp>
+
+#include <thread>
+
+namespace rubbishrsa::test {
+  namespace {
+    /// Runs a coordinator for source, with a worker in another thread, and returns what it found
+    std::optional<bigint> run(distributed::work_source& source) {
+      const auto address = "unix:" + temp_path("coordinator");
+      std::thread worker{[&]() {
+        // The coordinator might not be listening yet
+        for (int tries = 0; tries < 100; ++tries) {
+          try {
+            distributed::work(address, 2);
+            return;
+          } catch (const boost::system::system_error&) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{20});
+          }
+        }
+      }};
+      auto ret = distributed::coordinate(address, source);
+      worker.join();
+      return ret;
+    }
+  }
+
+  void distributed() {
+    const auto key = fixed_key(256);
+
+    // A range search finds its plaintext, however the range splits into units
+    {
+      const bigint answer = 1234;
+      const auto c = key.raw_encrypt(answer);
+      auto source = distributed::range_source(key, c, 1000, 2000, 100);
+      auto found = run(*source);
+      check(found && *found == answer, "distributed range search finds the plaintext");
+
+      auto missing = distributed::range_source(key, c, 0, 999, 128);
+      check(!run(*missing), "distributed range search ends without the plaintext");
+    }
+
+    // Results are checked before the search ends on them
+    {
+      auto source = distributed::range_source(key, key.raw_encrypt(10), 0, 100, 10);
+      check(source->check(10), "a real result passes");
+      check(!source->check(11), "a wrong result fails");
+    }
+
+    // Rho walks are handed out, and their factor found
+    {
+      const auto p = fixed_prime(24, 1), q = fixed_prime(24, 2);
+      auto source = distributed::rho_source(p * q, 1000);
+      auto found = run(*source);
+      check(found && (*found == p || *found == q), "distributed rho finds a factor");
+    }
+  }
+}
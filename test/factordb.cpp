@@ -0,0 +1,113 @@
+#include "test.hpp"
+
+#include <rubbishrsa/attack.hpp>
+#include <rubbishrsa/factordb.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace rubbishrsa::test {
+  namespace {
+    struct semiprime {
+      bigint n, p, q;
+    };
+
+    std::vector<semiprime> semiprimes(size_t count) {
+      std::vector<semiprime> ret;
+      for (size_t i = 0; i < count; ++i) {
+        bigint p = fixed_prime(40, 2 * i), q = fixed_prime(40, 2 * i + 1);
+        ret.push_back({p * q, std::move(p), std::move(q)});
+      }
+      return ret;
+    }
+
+    void remove_db(const std::string& path) {
+      for (const char* suffix : {"", ".idx", ".lock"})
+        std::filesystem::remove(path + suffix);
+    }
+  }
+
+  void factordb() {
+    const auto path = temp_path("factordb"), other_path = temp_path("factordb-other");
+    remove_db(path);
+    remove_db(other_path);
+    // Enough to make the index grow a few times
+    const auto entries = semiprimes(300);
+
+    {
+      factor_db db{path};
+      check(db.size() == 0 && !db.find(entries[0].n), "a new database is empty");
+      bool all_added = true;
+      for (const auto& [n, p, q] : entries)
+        all_added = all_added && db.add(n, p, q);
+      check(all_added && db.size() == entries.size(), "every modulus is added");
+      check(!db.add(entries[7].n, entries[7].q, entries[7].p), "a modulus is only added once");
+      check_throws<std::invalid_argument>([&]() { db.add(entries[0].n + 2, entries[0].p, entries[0].q); },
+                                          "factors that do not multiply to n");
+      check_throws<std::invalid_argument>([&]() { db.add(entries[0].n, 1, entries[0].n); }, "trivial factors");
+    }
+
+    auto all_found = [&](factor_db& db) {
+      for (const auto& [n, p, q] : entries) {
+        auto found = db.find(n);
+        if (!found || found->first * found->second != n || found->first == 1 || found->second == 1)
+          return false;
+      }
+      return !db.find(entries[0].n * 3);
+    };
+
+    {
+      factor_db db{path};
+      check(all_found(db), "the database is read back when reopened");
+    }
+
+    // The index is rebuilt from the log if it goes missing, and lines appended to the log by hand are found
+    std::filesystem::remove(path + ".idx");
+    const bigint p = fixed_prime(40, 1000), q = fixed_prime(40, 1001);
+    {
+      std::ofstream log{path, std::ios::app};
+      log << std::hex << p * q << ' ' << p << ' ' << q << '\n' << "123 4";
+    }
+    {
+      factor_db db{path};
+      check(all_found(db), "the index is rebuilt from the log");
+      check(db.find(p * q).has_value(), "a line appended by hand is found");
+      check(db.size() == entries.size() + 1, "a partly written line is ignored");
+    }
+
+    // What one database exports, another imports
+    {
+      factor_db db{path}, other{other_path};
+      std::stringstream ss;
+      db.export_to(ss);
+      check(other.import_from(ss) == entries.size() + 1 && all_found(other), "export and import");
+
+      std::stringstream bad{"f 3 5\nnot hex\n"};
+      check_throws<std::invalid_argument>([&]() { other.import_from(bad); }, "importing a malformed line");
+      check(other.find(15).has_value(), "lines before a malformed one are imported");
+    }
+
+    // Once in use, the database short cuts factorisation, and records what crack_key finds
+    {
+      auto db = std::make_shared<factor_db>(other_path);
+      use_factor_db(db);
+      const auto [found_p, found_q] = factorise_semiprime(entries[3].n);
+      check(found_p * found_q == entries[3].n, "factorise_semiprime with the database");
+
+      const auto key = fixed_key(96, 5);
+      public_key pubkey = key;
+      check(!db->find(key.n), "the key is not in the database yet");
+      check(attack::crack_key(pubkey, nullptr, nullptr, attack::crack_method::factor).d == key.d, "crack_key cracks the key");
+      check(db->find(key.n).has_value(), "crack_key records the factors");
+      use_factor_db(nullptr);
+
+      remember_factors(*db, key.n, 3, 5);
+      check(db->size() == entries.size() + 3, "remember_factors logs rather than throws");
+    }
+
+    remove_db(path);
+    remove_db(other_path);
+  }
+}
@@ -0,0 +1,65 @@
+#include "test.hpp"
+
+#include <rubbishrsa/attack.hpp>
+#include <rubbishrsa/job.hpp>
+
+#include <algorithm>
+#include <mutex>
+
+namespace rubbishrsa::test {
+  void job() {
+    // Stopping sets every linked flag, including ones linked afterwards, and only while they are linked
+    {
+      std::stop_source source;
+      job_control job{{.stop = source.get_token()}};
+      std::atomic<bool> before = false, after = false, unlinked = false;
+      auto guard = job.link(before);
+      { auto short_lived = job.link(unlinked); }
+      check(!job.stopped() && !before, "nothing is stopped to start with");
+      job.throw_if_stopped();
+
+      source.request_stop();
+      check(job.stopped() && before && !unlinked, "a stop request sets linked flags");
+      auto late = job.link(after);
+      check(after, "linking to a stopped job sets the flag straight away");
+      check_throws<job_cancelled>([&]() { job.throw_if_stopped(); }, "a stopped job");
+    }
+
+    const auto key = fixed_key(256);
+    const auto c = key.raw_encrypt(bigint{1} << 200);
+
+    // A search that runs past its deadline stops with deadline_exceeded
+    {
+      job_control job{{.deadline = job_control::clock::now() + std::chrono::milliseconds{50}}};
+      check_throws<deadline_exceeded>([&]() { attack::brute_force_ptext(key, c, 0, bigint{1} << 64, 2, nullptr, &job); },
+                                      "a search past its deadline");
+    }
+
+    // Progress is reported as the search goes, and a stop from the progress callback ends it
+    {
+      std::stop_source source;
+      uint64_t reported = 0;
+      std::mutex mutex;
+      job_control job{{
+        .stop = source.get_token(),
+        .on_progress = [&](const job_progress& progress) {
+          std::scoped_lock lock{mutex};
+          reported = std::max(reported, progress.done);
+          if (reported > 10000)
+            source.request_stop();
+        },
+        .progress_interval = std::chrono::milliseconds{0},
+      }};
+      check_throws<job_cancelled>([&]() { attack::brute_force_ptext(key, c, 0, bigint{1} << 64, 2, nullptr, &job); },
+                                  "a search stopped from its progress callback");
+      check(reported > 10000 && job.progress() >= reported, "progress is reported");
+    }
+
+    // Without a job, or with one that never stops, a search finishes as normal
+    {
+      job_control job;
+      auto found = attack::brute_force_ptext(key, key.raw_encrypt(777), 0, 1000, 2, nullptr, &job);
+      check(found && *found == 777, "a job that is never stopped does not get in the way");
+    }
+  }
+}
@@ -0,0 +1,92 @@
+#include "test.hpp"
+
+#include <sstream>
+#include <vector>
+
+namespace rubbishrsa::test {
+  namespace {
+    template<typename Key>
+    Key round_trip(const Key& key, key_format format) {
+      std::stringstream ss;
+      key.serialise(ss, format);
+      return Key::deserialise(ss);
+    }
+
+    bool same_primes(const private_key& a, const private_key& b) {
+      if (a.primes.size() != b.primes.size())
+        return false;
+      for (size_t i = 0; i < a.primes.size(); ++i)
+        if (a.primes[i].prime != b.primes[i].prime || a.primes[i].exponent != b.primes[i].exponent ||
+            a.primes[i].coefficient != b.primes[i].coefficient)
+          return false;
+      return true;
+    }
+  }
+
+  void keys() {
+    for (unsigned int prime_count : {2u, 3u, 4u}) {
+      const auto key = fixed_key(512, 1, prime_count);
+      const auto suffix = " (" + std::to_string(prime_count) + " primes)";
+
+      // The CRT, with any number of primes, gives the same answer as a single exponentiation by d
+      bigint product = 1;
+      for (const auto& prime : key.primes)
+        product *= prime.prime;
+      check(key.primes.size() == prime_count && product == key.n, "the primes multiply to n" + suffix);
+      bool all_match = true;
+      for (const bigint& x : std::vector<bigint>{0, 1, 2, key.n - 1, key.primes.back().prime * 3, bigint{"0xdeadbeefcafe"}})
+        all_match = all_match && key.raw_decrypt(x) == bmp::powm(x, key.d, key.n) && key.raw_sign(x) == key.raw_decrypt(x);
+      check(all_match, "the CRT matches powm" + suffix);
+      check(key.raw_decrypt(key.raw_encrypt(12345)) == 12345, "decryption undoes encryption" + suffix);
+
+      for (auto format : {key_format::json, key_format::der, key_format::pem}) {
+        const auto format_suffix = suffix + " (format " + std::to_string(static_cast<int>(format)) + ")";
+        const auto loaded = round_trip(key, format);
+        check(loaded.n == key.n && loaded.e == key.e && loaded.d == key.d, "a private key round trips" + format_suffix);
+        // JSON never held the primes
+        check(format == key_format::json || same_primes(loaded, key), "the primes round trip" + format_suffix);
+
+        const auto pubkey = round_trip(static_cast<const public_key&>(key), format);
+        check(pubkey.n == key.n && pubkey.e == key.e, "a public key round trips" + format_suffix);
+      }
+    }
+
+    // Two prime keys that have forgotten their primes get them back from d for PKCS#1, but others cannot
+    {
+      auto key = fixed_key(512);
+      key.primes.clear();
+      const auto loaded = round_trip(key, key_format::der);
+      check(loaded.d == key.d && loaded.primes.size() == 2, "a two prime key without its primes is written as PKCS#1");
+
+      auto multi = fixed_key(512, 1, 3);
+      multi.primes.clear();
+      std::stringstream ss;
+      check_throws<std::invalid_argument>([&]() { multi.serialise(ss, key_format::der); },
+                                          "writing PKCS#1 for a multi-prime key without its primes");
+      check_throws<std::invalid_argument>([&]() { multi.serialise(ss, key_format::pem); },
+                                          "writing PEM for a multi-prime key without its primes");
+      check(round_trip(multi, key_format::json).d == multi.d, "JSON needs no primes");
+    }
+
+    // Keys are checked as they are made and loaded
+    {
+      const auto p = fixed_prime(128, 1), q = fixed_prime(128, 2);
+      check_throws<std::invalid_argument>([&]() { private_key::from_primes({p, q * 3}); }, "a composite prime");
+      check_throws<std::invalid_argument>([&]() { private_key::from_primes({p}); }, "a single prime");
+      check_throws<std::invalid_argument>([&]() { private_key::from_primes({p, p}); }, "a repeated prime");
+      check_throws<std::invalid_argument>([&]() { private_key::from_factors(p, q, (p - 1) * (q - 1)); },
+                                          "an exponent that cannot be inverted");
+
+      std::stringstream der;
+      fixed_key(512, 1, 3).serialise(der, key_format::der);
+      auto bytes = der.str();
+      // Flip a bit in the last prime's coefficient, which then no longer fits
+      bytes[bytes.size() - 5] ^= 1;
+      std::stringstream tampered{bytes};
+      check_throws<std::invalid_argument>([&]() { private_key::deserialise(tampered); }, "a tampered key");
+
+      std::stringstream garbage{"not a key"};
+      check_throws<std::invalid_argument>([&]() { private_key::deserialise(garbage); }, "something that is not a key");
+    }
+  }
+}
@@ -0,0 +1,89 @@
+#include "test.hpp"
+
+#include <rubbishrsa/attack.hpp>
+#include <rubbishrsa/lattice.hpp>
+
+#include <vector>
+
+namespace rubbishrsa::test {
+  namespace {
+    using basis_t = std::vector<std::vector<bigint>>;
+
+    bigint determinant_3(const basis_t& m) {
+      return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+             m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    }
+
+    bigint norm_squared(const std::vector<bigint>& v) {
+      bigint ret = 0;
+      for (const auto& x : v)
+        ret += x * x;
+      return ret;
+    }
+  }
+
+  void lattice() {
+    // The example from Wikipedia's article on LLL, which reduces to (0, 1, 0), (1, 0, 1), (-1, 0, 2)
+    {
+      const basis_t original{{1, 1, 1}, {-1, 0, 2}, {3, 5, 6}};
+      for (auto [numerator, denominator] : {std::pair{3u, 4u}, {99u, 100u}}) {
+        auto basis = original;
+        lll_reduce(basis, numerator, denominator);
+        const auto suffix = " (delta " + std::to_string(numerator) + '/' + std::to_string(denominator) + ")";
+        check(norm_squared(basis[0]) == 1 && norm_squared(basis[1]) == 2 && norm_squared(basis[2]) == 5,
+              "the textbook basis is reduced" + suffix);
+        check(abs(determinant_3(basis)) == abs(determinant_3(original)), "the reduced basis spans the same lattice" + suffix);
+      }
+    }
+
+    // Long vectors that hide a short one, 7 b_1 - 5 b_2 + b_3 = (2, 6, -7), have it (or something shorter) found
+    {
+      basis_t basis{{1000003, 1, 0}, {1400004, 1, 1}, {1, 4, -2}};
+      lll_reduce(basis);
+      check(norm_squared(basis[0]) <= 2 * 2 + 6 * 6 + 7 * 7, "the hidden short vector is found");
+    }
+
+    check_throws<std::invalid_argument>([]() {
+      basis_t basis{{1, 2}, {2, 4}};
+      lll_reduce(basis);
+    }, "a dependent basis");
+    check_throws<std::invalid_argument>([]() {
+      basis_t basis{{1, 2}, {3}};
+      lll_reduce(basis);
+    }, "vectors of different lengths");
+    check_throws<std::invalid_argument>([]() {
+      basis_t basis{{1, 0}, {0, 1}};
+      lll_reduce(basis, 1, 4);
+    }, "delta of 1/4");
+
+    // (x - 3)(x + 5)(x - 100) = x^3 - 98x^2 - 215x + 1500, and (x - 7)^2 = x^2 - 14x + 49
+    {
+      const std::vector<bigint> cubic{1500, -215, -98, 1}, square{49, -14, 1}, none{1, 0, 1}, zero{0, 0};
+      check(evaluate_polynomial(cubic, 10) == 7 * 15 * -90 && evaluate_polynomial(cubic, 0) == 1500, "evaluate_polynomial");
+      check(integer_roots(cubic, -1000, 1000) == std::vector<bigint>{-5, 3, 100}, "the roots of a cubic");
+      check(integer_roots(cubic, 3, 99) == std::vector<bigint>{3}, "roots are limited to the range");
+      check(integer_roots(square, -100, 100) == std::vector<bigint>{7}, "a repeated root");
+      check(integer_roots(none, -100, 100).empty(), "a polynomial with no real roots");
+      check(integer_roots(zero, -100, 100).empty(), "the zero polynomial");
+    }
+
+    // Coppersmith's attack recovers the end of a message under e = 3, within its bound
+    {
+      public_key pubkey;
+      pubkey.e = 3;
+      pubkey.n = fixed_key(1024).n;
+      const bigint prefix{"0x5468652073656372657420636f6465206973"};
+      for (unsigned int unknown_bits : {16u, 128u}) {
+        const bigint unknown = bigint{"0x9234567890abcdef1234567890abcdef"} >> (128 - unknown_bits);
+        const auto c = pubkey.raw_encrypt((prefix << unknown_bits) + unknown);
+        auto found = attack::stereotyped_ptext(pubkey, c, prefix, unknown_bits);
+        check(found && *found == (prefix << unknown_bits) + unknown, "stereotyped_ptext with " + std::to_string(unknown_bits) + " unknown bits");
+      }
+      check(!attack::stereotyped_ptext(pubkey, pubkey.raw_encrypt(prefix << 400), prefix, 400), "too many unknown bits");
+
+      public_key big_e = pubkey;
+      big_e.e = 65537;
+      check(!attack::stereotyped_ptext(big_e, big_e.raw_encrypt(prefix << 16), prefix, 16), "too big an e");
+    }
+  }
+}
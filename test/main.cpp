@@ -0,0 +1,48 @@
+//! Correctness checks for the library
+//!
+//! Pass the names of the groups to run, or nothing to run them all. Exits with 1 if any check fails
+
+#include "test.hpp"
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv) {
+  const std::map<std::string, void(*)()> groups = {
+    {"candidates", &rubbishrsa::test::candidates},
+    {"pipeline", &rubbishrsa::test::pipeline},
+    {"blocks", &rubbishrsa::test::blocks},
+    {"checkpoint", &rubbishrsa::test::checkpoint},
+    {"distributed", &rubbishrsa::test::distributed},
+    {"job", &rubbishrsa::test::job},
+    {"shortcuts", &rubbishrsa::test::shortcuts},
+    {"verify_batch", &rubbishrsa::test::verify_batch},
+    {"batch_modinv", &rubbishrsa::test::batch_modinv},
+    {"context_cache", &rubbishrsa::test::context_cache},
+    {"factordb", &rubbishrsa::test::factordb},
+    {"keys", &rubbishrsa::test::keys},
+    {"lattice", &rubbishrsa::test::lattice},
+  };
+
+  std::vector<std::string> selected{argv + 1, argv + argc};
+  if (selected.empty())
+    for (auto& [name, func] : groups)
+      selected.push_back(name);
+
+  for (const auto& name : selected) {
+    auto iter = groups.find(name);
+    if (iter == groups.end()) {
+      std::cerr << "ERROR: Unknown test group '" << name << '\'' << std::endl;
+      return 1;
+    }
+    iter->second();
+  }
+
+  if (auto failures = rubbishrsa::test::failures()) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  return 0;
+}
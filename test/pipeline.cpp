@@ -0,0 +1,82 @@
+#include "test.hpp"
+
+#include <rubbishrsa/pipeline.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+namespace rubbishrsa::test {
+  void pipeline() {
+    const auto key = fixed_key(512);
+
+    // Uneven amounts of work, so that results finish out of order and have to be put back in it
+    {
+      size_t next = 0, reads = 0, writes = 0, most_in_flight = 0;
+      std::vector<bigint> written;
+      ordered_parallel_map(
+        [&]() -> std::optional<size_t> {
+          if (next == 500)
+            return std::nullopt;
+          most_in_flight = std::max(most_in_flight, ++reads - writes);
+          return next++;
+        },
+        [&](size_t i) {
+          if (i % 7 == 0)
+            std::this_thread::sleep_for(std::chrono::microseconds{200});
+          return key.raw_sign(bigint{i + 2});
+        },
+        [&](bigint signature) {
+          ++writes;
+          written.push_back(std::move(signature));
+        },
+        4, 8);
+
+      bool in_order = written.size() == 500;
+      for (size_t i = 0; in_order && i < written.size(); ++i)
+        in_order = key.raw_verify(written[i]) == i + 2;
+      check(in_order, "results are written in input order");
+      check(most_in_flight <= 8, "no more than max_in_flight items are read ahead of the writer");
+    }
+
+    // The first exception gets out, and stops the rest
+    {
+      std::atomic<size_t> worked = 0;
+      size_t next = 0;
+      check_throws<std::runtime_error>([&]() {
+        ordered_parallel_map(
+          [&]() -> std::optional<size_t> { return next < 100000 ? std::optional{next++} : std::nullopt; },
+          [&](size_t i) {
+            ++worked;
+            if (i == 10)
+              throw std::runtime_error("bad item");
+            return i;
+          },
+          [](size_t) {}, 2);
+      }, "an exception from work is rethrown");
+      check(worked < 100000, "an exception stops the rest of the work");
+    }
+    {
+      size_t next = 0;
+      check_throws<std::invalid_argument>([&]() {
+        ordered_parallel_map(
+          [&]() -> std::optional<size_t> { return next < 100 ? std::optional{next++} : std::nullopt; },
+          [](size_t i) { return i; },
+          [](size_t i) {
+            if (i == 50)
+              throw std::invalid_argument("bad result");
+          }, 2);
+      }, "an exception from write is rethrown");
+    }
+
+    // Nothing at all is fine too
+    {
+      bool wrote = false;
+      ordered_parallel_map([]() -> std::optional<int> { return std::nullopt; }, [](int i) { return i; },
+                           [&](int) { wrote = true; }, 2);
+      check(!wrote, "empty input writes nothing");
+    }
+  }
+}
@@ -0,0 +1,77 @@
+#include "test.hpp"
+
+#include <rubbishrsa/attack.hpp>
+
+#include <vector>
+
+namespace rubbishrsa::test {
+  namespace {
+    public_key make_key(bigint e, bigint n) {
+      public_key ret;
+      ret.e = std::move(e);
+      ret.n = std::move(n);
+      return ret;
+    }
+  }
+
+  void shortcuts() {
+    const auto n_1 = fixed_key(512, 1).n, n_2 = fixed_key(512, 2).n, n_3 = fixed_key(512, 3).n;
+    // Only the public halves are used here, so e need not be coprime to phi
+    const auto small_1 = make_key(3, n_1), small_2 = make_key(3, n_2), small_3 = make_key(3, n_3), big_1 = make_key(65537, n_1);
+
+    // Small messages are recovered by a plain e'th root, and large ones are not
+    {
+      const bigint m = bigint{"0x123456789abcdef"};
+      auto found = attack::small_message_root(small_1, small_1.raw_encrypt(m));
+      check(found && *found == m, "small_message_root recovers a message whose cube is below n");
+      check(!attack::small_message_root(small_1, small_1.raw_encrypt(n_1 - 2)), "small_message_root on a large message");
+    }
+
+    // The same message under two coprime exponents and one modulus is recovered
+    const bigint m = (bigint{1} << 500) + 12345;
+    {
+      auto found = attack::common_modulus(small_1, small_1.raw_encrypt(m), big_1, big_1.raw_encrypt(m));
+      check(found && *found == m, "common_modulus recovers the message");
+      const auto even = make_key(6, n_1);
+      check(!attack::common_modulus(small_1, small_1.raw_encrypt(m), even, even.raw_encrypt(m)),
+            "common_modulus with exponents that share a factor");
+      check(!attack::common_modulus(small_1, small_1.raw_encrypt(m), small_2, small_2.raw_encrypt(m)),
+            "common_modulus with different moduli");
+    }
+
+    // With e = 3, three encryptions under different moduli are enough
+    {
+      const std::vector keys{small_1, small_2, small_3};
+      const std::vector c{small_1.raw_encrypt(m), small_2.raw_encrypt(m), small_3.raw_encrypt(m)};
+      auto found = attack::hastad_broadcast(keys, c);
+      check(found && *found == m, "hastad_broadcast recovers the message");
+      check_throws<std::invalid_argument>([&]() {
+        attack::hastad_broadcast(std::span{keys}.first(2), std::span{c}.first(2));
+      }, "hastad_broadcast with fewer than e keys");
+
+      // shortcut_ptext finds the group of three among the rest
+      const std::vector mixed{big_1, small_1, make_key(65537, n_2), small_2, small_3};
+      std::vector<bigint> mixed_c;
+      for (const auto& key : mixed)
+        mixed_c.push_back(key.raw_encrypt(m));
+      found = attack::shortcut_ptext(mixed, mixed_c);
+      check(found && *found == m, "shortcut_ptext recovers the message");
+      check(!attack::shortcut_ptext(std::span{mixed}.first(1), std::span{mixed_c}.first(1)),
+            "shortcut_ptext with a single ordinary encryption");
+    }
+
+    // Wiener's attack recovers a key with a small d, and not one with an ordinary d
+    {
+      const auto p = fixed_prime(260, 10), q = fixed_prime(252, 11);
+      const bigint phi = (p - 1) * (q - 1);
+      bigint d = (bigint{1} << 100) + 1;
+      while (gcd(d, phi) != 1)
+        d += 2;
+      const auto weak = make_key(modinv(d, phi), p * q);
+      auto key = attack::wiener(weak);
+      check(key && key->n == weak.n && key->e == weak.e, "wiener recovers a key with a small d");
+      check(key && bmp::powm(weak.raw_encrypt(42), key->d, key->n) == 42, "the key from wiener decrypts");
+      check(!attack::wiener(fixed_key(512)), "wiener on an ordinary key");
+    }
+  }
+}
@@ -0,0 +1,51 @@
+#include "test.hpp"
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+#include <filesystem>
+#include <iostream>
+#include <unistd.h>
+
+namespace rubbishrsa::test {
+  namespace {
+    size_t failed = 0;
+  }
+
+  void check(bool condition, std::string_view what, std::source_location where) {
+    if (condition)
+      return;
+    ++failed;
+    std::cerr << where.file_name() << ':' << where.line() << ": FAILED: " << what << std::endl;
+  }
+
+  size_t failures() {
+    return failed;
+  }
+
+  bigint fixed_prime(uint_fast16_t bits, uint64_t seed) {
+    boost::random::mt19937 rng{static_cast<uint32_t>(seed)};
+    bigint min = 1; min <<= (bits - 1);
+    bigint max = min * 2 - 1;
+    boost::random::uniform_int_distribution<bigint> dist{min, max};
+    bigint candidate = dist(rng) | 1;
+    while (!is_prime(candidate, 32))
+      candidate += 2;
+    return candidate;
+  }
+
+  private_key fixed_key(uint_fast16_t bits, uint64_t seed, unsigned int prime_count) {
+    if (prime_count == 2)
+      return private_key::from_factors(fixed_prime(bits / 2 + 4, seed * 2), fixed_prime(bits / 2 - 3, seed * 2 + 1));
+    std::vector<bigint> primes;
+    for (unsigned int i = 0; i < prime_count; ++i)
+      primes.push_back(fixed_prime(bits / prime_count + (i < bits % prime_count), seed * prime_count + i));
+    return private_key::from_primes(std::move(primes));
+  }
+
+  std::string temp_path(std::string_view name) {
+    auto ret = std::filesystem::temp_directory_path() / ("rubbishrsa-test-" + std::to_string(getpid()) + '-' + std::string{name});
+    std::filesystem::remove(ret);
+    return ret.string();
+  }
+}
@@ -0,0 +1,54 @@
+//! A tiny, dependency free test harness, where each group of checks is run by CTest as its own test
+
+#pragma once
+
+#include <rubbishrsa/keys.hpp>
+
+#include <cstdint>
+#include <source_location>
+#include <string>
+#include <string_view>
+
+namespace rubbishrsa::test {
+  /// Records (and prints) a failure if the condition is false, carrying on either way
+  void check(bool condition, std::string_view what, std::source_location where = std::source_location::current());
+
+  /// Checks that calling the function throws an Exception
+  template<typename Exception, typename Func>
+  void check_throws(Func&& func, std::string_view what, std::source_location where = std::source_location::current()) {
+    bool threw = false;
+    try {
+      func();
+    }
+    catch (const Exception&) {
+      threw = true;
+    }
+    check(threw, what, where);
+  }
+
+  /// The number of checks that have failed so far
+  size_t failures();
+
+  /// A deterministic prime of exactly the given number of bits, so that failures can be reproduced
+  bigint fixed_prime(uint_fast16_t bits, uint64_t seed);
+  /// A deterministic key with a modulus of (about) the given number of bits, made of prime_count primes
+  private_key fixed_key(uint_fast16_t bits, uint64_t seed = 1, unsigned int prime_count = 2);
+
+  /// A path in the temporary directory that no other test (or run) is using, which is removed if it exists
+  std::string temp_path(std::string_view name);
+
+  // Each group of checks
+  void candidates();
+  void pipeline();
+  void blocks();
+  void checkpoint();
+  void distributed();
+  void job();
+  void shortcuts();
+  void verify_batch();
+  void batch_modinv();
+  void context_cache();
+  void factordb();
+  void keys();
+  void lattice();
+}
@@ -0,0 +1,57 @@
+#include "test.hpp"
+
+#include <vector>
+
+namespace rubbishrsa::test {
+  namespace {
+    /// The first fixed key whose modulus is the given residue mod 4
+    private_key key_with_residue(unsigned int residue) {
+      for (uint64_t seed = 1;; ++seed)
+        if (auto key = fixed_key(256, seed); key.n % 4 == residue)
+          return key;
+    }
+  }
+
+  void verify_batch() {
+    for (unsigned int residue : {1u, 3u}) {
+      const auto key = key_with_residue(residue);
+      const auto suffix = " (n = " + std::to_string(residue) + " mod 4)";
+
+      std::vector<bigint> messages, signatures;
+      for (unsigned int i = 0; i < 37; ++i) {
+        messages.push_back(bigint{1000 + i} * 7919);
+        signatures.push_back(bmp::powm(messages.back(), key.d, key.n));
+      }
+      check(key.verify_batch(messages, signatures) == std::vector<bool>(messages.size(), true),
+            "every valid signature passes" + suffix);
+
+      auto expect = [&](std::vector<bigint> sigs, std::vector<size_t> bad, const std::string& what) {
+        std::vector<bool> expected(messages.size(), true);
+        for (auto i : bad)
+          expected[i] = false;
+        check(key.verify_batch(messages, sigs) == expected, what + suffix);
+      };
+
+      auto tampered = signatures;
+      tampered[5] += 1;
+      expect(tampered, {5}, "a single bad signature is picked out");
+
+      // -1 has order 2, so a negated signature (or a pair of them) can slip past a plain product check
+      auto negated = signatures;
+      negated[11] = key.n - negated[11];
+      expect(negated, {11}, "a negated signature is picked out");
+      negated[30] = key.n - negated[30];
+      expect(negated, {11, 30}, "a negated pair is picked out");
+
+      tampered[0] = 0;
+      tampered[36] = signatures[35];
+      expect(tampered, {0, 5, 36}, "several bad signatures are picked out");
+
+      check(key.verify_batch({}, {}).empty(), "an empty batch" + suffix);
+    }
+
+    const auto key = fixed_key(256);
+    const std::vector<bigint> one{1};
+    check_throws<std::invalid_argument>([&]() { (void)key.verify_batch(one, {}); }, "spans of different lengths");
+  }
+}